@@ -0,0 +1,182 @@
+/**
+ * @file asyncLog.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the asynchronous ring-buffer logger: producers claim a slot
+ *      with one compare-and-swap (bounded MPSC queue with per-slot sequence
+ *      numbers), a background thread formats and writes the records.
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "asyncLog.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// One ring slot, a cache line. sequence == position means free for that
+// position, sequence == position + 1 means written and ready to drain.
+typedef struct
+{
+    uint64_t sequence;
+    const char *format;
+    uint64_t level;
+    unsigned long long args[LOG_MAX_ARGS];
+} log_slot_t;
+
+LOG_LEVEL async_log_level = LOG_LEVEL_OFF;
+
+static log_slot_t log_ring[LOG_RING_SIZE] __attribute__((aligned(64)));
+static uint64_t log_enqueue_position __attribute__((aligned(64)));
+static uint64_t log_dequeue_position __attribute__((aligned(64)));
+static uint64_t log_drop_count;
+static FILE *log_out;
+static pthread_t log_thread;
+static bool log_running;
+
+static const char *const log_level_names[] = {"off", "error", "warn", "info", "debug"};
+
+void log_record(LOG_LEVEL level, const char *format, const unsigned long long args[LOG_MAX_ARGS])
+{
+    uint64_t position = __atomic_load_n(&log_enqueue_position, __ATOMIC_RELAXED);
+    log_slot_t *slot;
+
+    while (1)
+    {
+        slot = &log_ring[position & (LOG_RING_SIZE - 1)];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&log_enqueue_position, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Ring full: the drain thread is behind, drop rather than block
+            __atomic_fetch_add(&log_drop_count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+            position = __atomic_load_n(&log_enqueue_position, __ATOMIC_RELAXED);
+    }
+
+    slot->format = format;
+    slot->level = level;
+    memcpy(slot->args, args, sizeof(slot->args));
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Format and write every ready record.
+ *
+ * @return uint64_t records written
+ */
+static uint64_t log_drain(void)
+{
+    uint64_t written = 0;
+
+    while (1)
+    {
+        uint64_t position = log_dequeue_position;
+        log_slot_t *slot = &log_ring[position & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1)
+            break;
+
+        fprintf(log_out, slot->format, slot->args[0], slot->args[1], slot->args[2], slot->args[3], slot->args[4]);
+        __atomic_store_n(&slot->sequence, position + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        log_dequeue_position = position + 1;
+        written++;
+    }
+    return written;
+}
+
+/**
+ * @brief Drain thread: write records as they arrive, flush whenever the ring
+ *      empties so redirected output stays current, sleep briefly when idle.
+ *
+ * @param arg unused
+ * @return void* NULL
+ */
+static void *log_drain_thread(void *arg)
+{
+    struct timespec idle = {.tv_sec = 0, .tv_nsec = LOG_DRAIN_IDLE_NS};
+    uint64_t reported_drops = 0;
+    (void)arg;
+
+    while (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+    {
+        if (log_drain() > 0)
+        {
+            uint64_t drops = __atomic_load_n(&log_drop_count, __ATOMIC_RELAXED);
+            if (drops != reported_drops)
+            {
+                fprintf(log_out, "Log: %llu records dropped, ring full\n", (unsigned long long)(drops - reported_drops));
+                reported_drops = drops;
+            }
+            fflush(log_out);
+        }
+        else
+            nanosleep(&idle, NULL);
+    }
+    log_drain();
+    fflush(log_out);
+    return NULL;
+}
+
+void log_init(FILE *out, LOG_LEVEL level)
+{
+    for (uint64_t i = 0; i < LOG_RING_SIZE; i++)
+        log_ring[i].sequence = i;
+    log_enqueue_position = 0;
+    log_dequeue_position = 0;
+    log_drop_count = 0;
+    log_out = out;
+    log_running = true;
+    if (pthread_create(&log_thread, NULL, log_drain_thread, NULL) != 0)
+    {
+        perror("ERROR: Starting log thread");
+        exit(EXIT_FAILURE);
+    }
+    log_set_level(level);
+}
+
+void log_shutdown(void)
+{
+    // Only the first caller joins, error() may race with a normal shutdown
+    if (!__atomic_exchange_n(&log_running, false, __ATOMIC_ACQ_REL))
+        return;
+    log_set_level(LOG_LEVEL_OFF);
+    pthread_join(log_thread, NULL);
+}
+
+void log_set_level(LOG_LEVEL level)
+{
+    __atomic_store_n(&async_log_level, level, __ATOMIC_RELAXED);
+}
+
+bool log_parse_level(const char *name, LOG_LEVEL *level)
+{
+    for (unsigned int i = 0; i < sizeof(log_level_names) / sizeof(log_level_names[0]); i++)
+        if (strcmp(name, log_level_names[i]) == 0)
+        {
+            *level = (LOG_LEVEL)i;
+            return true;
+        }
+    return false;
+}
+
+const char *log_level_name(LOG_LEVEL level)
+{
+    return level <= LOG_LEVEL_DEBUG ? log_level_names[level] : "unknown";
+}
+
+uint64_t log_dropped(void)
+{
+    return __atomic_load_n(&log_drop_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file asyncLog.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the asynchronous ring-buffer logger
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef ASYNCLOG_H /* include guard */
+#define ASYNCLOG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ring buffer records (power of two) and integer arguments per record
+#define LOG_RING_SIZE 65536
+#define LOG_MAX_ARGS 5
+#define LOG_DRAIN_IDLE_NS 1000000
+
+// Log levels, changeable at runtime with log_set_level():
+typedef enum
+{
+    LOG_LEVEL_OFF = 0,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+} LOG_LEVEL;
+
+// Current level, read on every LOG_EVENT(). Use log_set_level() to change it.
+extern LOG_LEVEL async_log_level;
+
+/**
+ * @brief Whether records at this level are currently kept.
+ *
+ * @param level record level
+ * @return true if LOG_EVENT() at this level would log
+ */
+static inline bool log_enabled(LOG_LEVEL level)
+{
+    return level != LOG_LEVEL_OFF && level <= __atomic_load_n(&async_log_level, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Log a record. Only the format pointer and the integer arguments are
+ *      copied into the ring, formatting happens on the drain thread. So the
+ *      format must be a string with static lifetime (a literal), arguments are
+ *      converted to unsigned long long and must be printed with ll conversions
+ *      (%llu, %llX, ...). No %s: strings belong in the format itself.
+ *      When the ring is full the record is dropped and counted, never waited for.
+ */
+#define LOG_EVENT(level, format, ...)                                                          \
+    do                                                                                         \
+    {                                                                                          \
+        if (log_enabled(level))                                                                \
+            log_record((level), (format), (const unsigned long long[LOG_MAX_ARGS]){__VA_ARGS__}); \
+    } while (0)
+
+/**
+ * @brief LOG_EVENT() for a format without arguments, which standard C does
+ *      not allow to leave the variadic arguments empty for.
+ */
+#define LOG_TEXT(level, format)                                                     \
+    do                                                                              \
+    {                                                                               \
+        if (log_enabled(level))                                                     \
+            log_record((level), (format), (const unsigned long long[LOG_MAX_ARGS]){0}); \
+    } while (0)
+
+/**
+ * @brief Start the drain thread writing records to out.
+ *
+ * @param out stream the drain thread writes and flushes
+ * @param level initial level
+ */
+void log_init(FILE *out, LOG_LEVEL level);
+
+/**
+ * @brief Drain the remaining records and stop the drain thread.
+ */
+void log_shutdown(void);
+
+/**
+ * @brief Change the level, effective immediately on all threads.
+ *
+ * @param level new level
+ */
+void log_set_level(LOG_LEVEL level);
+
+/**
+ * @brief Parse a level name: off, error, warn, info or debug.
+ *
+ * @param name level name
+ * @param level parsed level
+ * @return true if the name is known
+ */
+bool log_parse_level(const char *name, LOG_LEVEL *level);
+
+/**
+ * @brief Name of a level, for messages.
+ *
+ * @param level level
+ * @return const char* level name
+ */
+const char *log_level_name(LOG_LEVEL level);
+
+/**
+ * @brief Records dropped because the ring was full, since log_init().
+ *
+ * @return uint64_t dropped records
+ */
+uint64_t log_dropped(void);
+
+/**
+ * @brief Copy a record into the ring; use LOG_EVENT() instead.
+ *
+ * @param level record level
+ * @param format static format string
+ * @param args LOG_MAX_ARGS arguments
+ */
+void log_record(LOG_LEVEL level, const char *format, const unsigned long long args[LOG_MAX_ARGS]);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file benchData.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the synthetic subscribers and requests shared by the
+ *      benchmarks, the load generator and the fuzzer
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "benchData.h"
+
+static uint64_t rng_state = BENCH_RANDOM_DEFAULT_SEED;
+
+void bench_random_seed(uint64_t seed)
+{
+    rng_state = seed | 1; // xorshift never leaves 0
+}
+
+uint64_t bench_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+uint32_t bench_random_subscriber(void)
+{
+    return 1000000000U + (uint32_t)(bench_random() % 3000000000U);
+}
+
+void bench_generate_database(verification_database_t verification_database[], size_t db_size)
+{
+    for (size_t i = 0; i < db_size; i++)
+    {
+        verification_database[i].src_sub_no = bench_random_subscriber();
+        verification_database[i].technology = (SUBSCRIBER_TECHNOLOGY)(SUB_2G + bench_random() % 4);
+        verification_database[i].paid = bench_random() & 1;
+    }
+}
+
+void bench_generate_request(subscriber_packet_t *packet, const verification_database_t verification_database[],
+                            size_t db_size)
+{
+    reset_subscriber_packet(packet);
+    if (bench_random() & 1)
+    {
+        const verification_database_t *hit = &verification_database[bench_random() % db_size];
+        update_subscriber_packet(packet, 0, SUB_ACC_PER, 0, hit->technology, hit->src_sub_no);
+    }
+    else
+        update_subscriber_packet(packet, 0, SUB_ACC_PER, 0, SUB_2G + bench_random() % 4, bench_random_subscriber());
+}
@@ -0,0 +1,64 @@
+/**
+ * @file benchData.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the synthetic subscribers and requests shared by
+ *      the benchmarks, the load generator and the fuzzer
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BENCHDATA_H /* include guard */
+#define BENCHDATA_H
+
+#include "customProtocol.h"
+
+// Seed of bench_random() until bench_random_seed() is called
+#define BENCH_RANDOM_DEFAULT_SEED 0x2545F4914F6CDD1DULL
+
+/**
+ * @brief Restart the random sequence, for reproducible runs.
+ *
+ * @param seed any value
+ */
+void bench_random_seed(uint64_t seed);
+
+/**
+ * @brief Next number of a xorshift64* sequence, reproducible without
+ *      depending on rand(). Not thread safe.
+ *
+ * @return uint64_t random number
+ */
+uint64_t bench_random(void);
+
+/**
+ * @brief A random 10-digit subscriber number.
+ *
+ * @return uint32_t subscriber number
+ */
+uint32_t bench_random_subscriber(void);
+
+/**
+ * @brief Fill a synthetic database with random 10-digit subscribers.
+ *
+ * @param verification_database database to fill
+ * @param db_size number of entries
+ */
+void bench_generate_database(verification_database_t verification_database[], size_t db_size);
+
+/**
+ * @brief Fill a request: half are database hits, half are random numbers that
+ *      are almost always misses.
+ *
+ * @param packet packet to fill
+ * @param verification_database database to draw hits from
+ * @param db_size number of database entries
+ */
+void bench_generate_request(subscriber_packet_t *packet, const verification_database_t verification_database[],
+                            size_t db_size);
+
+#endif
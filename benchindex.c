@@ -0,0 +1,99 @@
+/**
+ * @file benchindex.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Microbenchmark comparing the linear verify_subscriber() scan against the
+ *      hash-indexed verify_subscriber_indexed() lookup across database sizes
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "customProtocol.h"
+#include "benchData.h"
+#include "subscriberIndex.h"
+
+// Benchmark settings:
+#define BENCH_MAX_DB_SIZE 10000000
+#define BENCH_INDEX_LOOKUPS 4000000
+#define BENCH_SCAN_WORK 400000000ULL // Total entries the linear scan may visit per size
+#define BENCH_MIN_SCAN_LOOKUPS 16
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv optional maximum database size (default 10M)
+ * @return int 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    size_t max_db_size = BENCH_MAX_DB_SIZE;
+    if (argc == 2)
+        max_db_size = strtoull(argv[1], NULL, 10);
+    else if (argc > 2)
+    {
+        printf("Usage: [max_db_size]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    verification_database_t *verification_database = malloc(max_db_size * sizeof(verification_database_t));
+    subscriber_packet_t *queries = malloc(BENCH_INDEX_LOOKUPS * sizeof(subscriber_packet_t));
+    if (verification_database == NULL || queries == NULL)
+        error("ERROR: Allocating benchmark memory");
+
+    printf("%12s %14s %14s %10s %12s\n", "db_size", "scan ns/op", "index ns/op", "speedup", "index bytes");
+    for (size_t db_size = 100; db_size <= max_db_size; db_size *= 10)
+    {
+        subscriber_index_t subscriber_index;
+        volatile uint32_t sink = 0;
+        size_t scan_lookups = BENCH_SCAN_WORK / db_size;
+        uint64_t start, scan_ns, index_ns;
+
+        if (scan_lookups > BENCH_INDEX_LOOKUPS)
+            scan_lookups = BENCH_INDEX_LOOKUPS;
+        if (scan_lookups < BENCH_MIN_SCAN_LOOKUPS)
+            scan_lookups = BENCH_MIN_SCAN_LOOKUPS;
+
+        bench_generate_database(verification_database, db_size);
+        for (size_t i = 0; i < BENCH_INDEX_LOOKUPS; i++)
+            bench_generate_request(&queries[i], verification_database, db_size);
+        subscriber_index_build(&subscriber_index, verification_database, db_size);
+
+        // Old path: linear scan
+        start = monotonic_time_ns();
+        for (size_t i = 0; i < scan_lookups; i++)
+            sink += verify_subscriber(verification_database, db_size, &queries[i]);
+        scan_ns = monotonic_time_ns() - start;
+
+        // New path: hash index
+        start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_INDEX_LOOKUPS; i++)
+            sink += verify_subscriber_indexed(&subscriber_index, &queries[i]);
+        index_ns = monotonic_time_ns() - start;
+
+        // Both paths must agree on every scanned query
+        for (size_t i = 0; i < scan_lookups; i++)
+            if (verify_subscriber(verification_database, db_size, &queries[i]) !=
+                verify_subscriber_indexed(&subscriber_index, &queries[i]))
+            {
+                fprintf(stderr, "ERROR: index and scan disagree at db_size %zu\n", db_size);
+                exit(EXIT_FAILURE);
+            }
+
+        double scan_per_op = (double)scan_ns / scan_lookups;
+        double index_per_op = (double)index_ns / BENCH_INDEX_LOOKUPS;
+        printf("%12zu %14.1f %14.1f %9.0fx %12llu\n", db_size, scan_per_op, index_per_op,
+               scan_per_op / index_per_op,
+               (unsigned long long)(subscriber_index.capacity * sizeof(subscriber_slot_t)));
+        subscriber_index_free(&subscriber_index);
+        (void)sink;
+    }
+
+    free(queries);
+    free(verification_database);
+    return EXIT_SUCCESS;
+}
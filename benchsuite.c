@@ -0,0 +1,915 @@
+/**
+ * @file benchsuite.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Benchmark suite run by `make bench`: packet validation, lookup, database
+ *      load and end-to-end loopback request/response against myserver, at
+ *      several database sizes, written as CSV for comparing versions
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "customProtocol.h"
+#include "benchData.h"
+#include "subscriberIndex.h"
+#include "rttEstimator.h"
+#include "packetBatch.h"
+#include "subscriberFilter.h"
+#include "subscriberTable.h"
+#include "numaTopology.h"
+#include "responseCache.h"
+#include "replayWindow.h"
+#include "requestReader.h"
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Benchmark settings:
+#define BENCH_DEFAULT_MAX_DB_SIZE 1000000
+#define BENCH_REPEATS 5                // Each measurement is the median of these runs
+#define BENCH_VALIDATE_PACKETS 1000000 // One in 16 is invalid
+#define BENCH_LOOKUPS 1000000
+#define BENCH_CLIENT_REQUESTS 1000000 // Requests in the client input file
+#define BENCH_BATCH 64 // Packets per batch call, as with myserver -b 64
+#define BENCH_CACHE_ENTRIES 4096 // As with myserver -C 4096, repeated requests fit
+#define BENCH_REPLAY_CLIENTS (1U << 19) // Clients sending in the lookup_replay rows
+#define BENCH_REPLAY_WINDOW (1U << 20)  // As with myserver -D 1048576
+#define BENCH_SCAN_WORK 100000000ULL // Total entries the linear scan may visit per run
+#define BENCH_MIN_SCAN_LOOKUPS 16
+#define BENCH_LOOPBACK_NS 1000000000ULL
+#define BENCH_LOOPBACK_TIMEOUT_NS 200000000ULL
+#define BENCH_LOOPBACK_WINDOW 64
+#define BENCH_LOOPBACK_FRAME_RECORDS 64 // Requests per batch frame in the loopback_batch row
+#define BENCH_LOOPBACK_KEYS ((MAX_CLIENT_ID + 1) * PACKET_GROUP_SIZE)
+#define BENCH_SERVER_START_TRIES 200 // 50 ms apart
+#define BENCH_CSV_HEADER "version,benchmark,db_size,operations,ns_per_op,ops_per_sec,p50_ns,p99_ns,lost\n"
+
+// Where results go:
+typedef struct
+{
+    FILE *out;
+    const char *version;
+} bench_report_t;
+
+/**
+ * @brief Write one result row, and a readable line on stderr.
+ *
+ * @param report output
+ * @param benchmark benchmark name
+ * @param db_size database size
+ * @param operations operations per run
+ * @param ns time for one run of all operations
+ * @param latency loopback latencies, NULL for the in-process benchmarks
+ * @param lost loopback requests without a response
+ */
+static void report_result(const bench_report_t *report, const char *benchmark, size_t db_size,
+                          uint64_t operations, uint64_t ns, const latency_histogram_t *latency, uint64_t lost)
+{
+    double ns_per_op = operations ? (double)ns / operations : 0;
+    double ops_per_sec = ns ? operations * 1e9 / ns : 0;
+
+    fprintf(report->out, "%s,%s,%zu,%llu,%.2f,%.0f,", report->version, benchmark, db_size,
+            (unsigned long long)operations, ns_per_op, ops_per_sec);
+    if (latency != NULL)
+        fprintf(report->out, "%llu,%llu,%llu\n",
+                (unsigned long long)latency_histogram_percentile(latency, 50),
+                (unsigned long long)latency_histogram_percentile(latency, 99), (unsigned long long)lost);
+    else
+        fprintf(report->out, ",,\n");
+    fflush(report->out);
+    fprintf(stderr, "%-22s %10zu %12.1f ns/op %14.0f ops/s\n", benchmark, db_size, ns_per_op, ops_per_sec);
+}
+
+/**
+ * @brief Median of the repeated runs' times.
+ *
+ * @param runs run times, sorted in place
+ * @return uint64_t median
+ */
+static uint64_t median_ns(uint64_t runs[BENCH_REPEATS])
+{
+    for (int i = 1; i < BENCH_REPEATS; i++)
+        for (int j = i; j > 0 && runs[j - 1] > runs[j]; j--)
+        {
+            uint64_t swap = runs[j];
+            runs[j] = runs[j - 1];
+            runs[j - 1] = swap;
+        }
+    return runs[BENCH_REPEATS / 2];
+}
+
+/**
+ * @brief Write a database in the text format read_verification_database() reads.
+ *
+ * @param verification_database database to write
+ * @param db_size number of entries
+ * @param filename file to write
+ */
+static void write_database(verification_database_t verification_database[], size_t db_size, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+        error("ERROR: Writing benchmark database");
+    fprintf(fp, "%zu\n", db_size);
+    for (size_t i = 0; i < db_size; i++)
+        fprintf(fp, "%u\n%d\n%d\n", verification_database[i].src_sub_no,
+                verification_database[i].technology, verification_database[i].paid);
+    if (fclose(fp) != 0)
+        error("ERROR: Writing benchmark database");
+}
+
+/**
+ * @brief check_subscriber_packet(), the server's validation, over a mix of
+ *      valid and corrupted packets.
+ *
+ * @param report output
+ * @param packets scratch space for BENCH_VALIDATE_PACKETS packets
+ */
+static void bench_validate(const bench_report_t *report, subscriber_packet_t packets[])
+{
+    uint64_t runs[BENCH_REPEATS];
+    volatile unsigned int sink = 0;
+
+    for (size_t i = 0; i < BENCH_VALIDATE_PACKETS; i++)
+    {
+        reset_subscriber_packet(&packets[i]);
+        update_subscriber_packet(&packets[i], i & MAX_CLIENT_ID, SUB_ACC_PER, i % PACKET_GROUP_SIZE,
+                                 SUB_2G + i % 4, 1000000000U + (uint32_t)i);
+        if ((bench_random() & 15) == 0)
+            packets[i].end_packet ^= 1;
+    }
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_VALIDATE_PACKETS; i++)
+            sink += check_subscriber_packet(&packets[i], sizeof(subscriber_packet_t));
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "validate", 0, BENCH_VALIDATE_PACKETS, median_ns(runs), NULL, 0);
+
+    // The same packets in receive batches, per batch implementation
+    uint32_t packet_sizes[BENCH_BATCH];
+    PACKET_VALIDATION results[BENCH_BATCH];
+    for (unsigned int i = 0; i < BENCH_BATCH; i++)
+        packet_sizes[i] = sizeof(subscriber_packet_t);
+    for (unsigned int impl = 0; impl < PACKET_BATCH_IMPL_COUNT; impl++)
+    {
+        char name[64];
+        if (!packet_batch_supported(impl))
+            continue;
+        for (int r = 0; r < BENCH_REPEATS; r++)
+        {
+            uint64_t start = monotonic_time_ns();
+            for (size_t i = 0; i + BENCH_BATCH <= BENCH_VALIDATE_PACKETS; i += BENCH_BATCH)
+                sink += check_subscriber_packets_with(impl, &packets[i], packet_sizes, results, BENCH_BATCH);
+            runs[r] = monotonic_time_ns() - start;
+        }
+        snprintf(name, sizeof(name), "validate_batch_%s", packet_batch_impl_name(impl));
+        report_result(report, name, 0, BENCH_VALIDATE_PACKETS / BENCH_BATCH * BENCH_BATCH, median_ns(runs), NULL, 0);
+    }
+    (void)sink;
+}
+
+/**
+ * @brief Look up a batch the way myserver -D does: prefetch the clients'
+ *      sets, then their rings, answer the duplicates from the replay window,
+ *      and look up the rest together and remember their responses.
+ *
+ * @param window replay window, synced
+ * @param index hash index
+ * @param requests the batch as the replay window sees it
+ * @param packets the batch's requests
+ * @param statuses set to each request's status
+ * @param n number of requests, up to BENCH_BATCH
+ */
+static void replay_lookup_batch(replay_window_t *window, const subscriber_index_t *index,
+                                const replay_request_t *requests, const subscriber_packet_t *packets,
+                                SUBSCRIBER_PACKET_TYPE *statuses, unsigned int n)
+{
+    subscriber_packet_t lookups[BENCH_BATCH];
+    SUBSCRIBER_PACKET_TYPE lookup_statuses[BENCH_BATCH];
+    unsigned int positions[BENCH_BATCH], misses = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+        replay_window_prefetch(window, &requests[i]);
+    for (unsigned int i = 0; i < n; i++)
+        replay_window_prefetch_ring(window, &requests[i]);
+    for (unsigned int i = 0; i < n; i++)
+        if (!replay_window_find(window, &requests[i], &statuses[i]))
+        {
+            lookups[misses] = packets[i];
+            positions[misses++] = i;
+        }
+    subscriber_index_lookup_batch(index, lookups, lookup_statuses, misses);
+    for (unsigned int m = 0; m < misses; m++)
+    {
+        statuses[positions[m]] = lookup_statuses[m];
+        replay_window_insert(window, &requests[positions[m]], lookup_statuses[m]);
+    }
+}
+
+/**
+ * @brief verify_subscriber() linear scan and the hash index myserver uses.
+ *
+ * @param report output
+ * @param verification_database database
+ * @param db_size number of entries
+ * @param queries scratch space for BENCH_LOOKUPS packets
+ */
+static void bench_lookup(const bench_report_t *report, verification_database_t verification_database[],
+                         size_t db_size, subscriber_packet_t queries[])
+{
+    uint64_t runs[BENCH_REPEATS];
+    volatile unsigned int sink = 0;
+    subscriber_index_t subscriber_index;
+    size_t scan_lookups = BENCH_SCAN_WORK / db_size;
+
+    if (scan_lookups > BENCH_LOOKUPS)
+        scan_lookups = BENCH_LOOKUPS;
+    if (scan_lookups < BENCH_MIN_SCAN_LOOKUPS)
+        scan_lookups = BENCH_MIN_SCAN_LOOKUPS;
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+        bench_generate_request(&queries[i], verification_database, db_size);
+    subscriber_index_build(&subscriber_index, verification_database, db_size);
+
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < scan_lookups; i++)
+            sink += verify_subscriber(verification_database, db_size, &queries[i]);
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_scan", db_size, scan_lookups, median_ns(runs), NULL, 0);
+
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+            sink += verify_subscriber_indexed(&subscriber_index, &queries[i]);
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_index", db_size, BENCH_LOOKUPS, median_ns(runs), NULL, 0);
+
+    // Receive batches with the home slots prefetched ahead
+    SUBSCRIBER_PACKET_TYPE statuses[BENCH_BATCH];
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+        {
+            subscriber_index_lookup_batch(&subscriber_index, &queries[i], statuses, BENCH_BATCH);
+            sink += statuses[BENCH_BATCH - 1];
+        }
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_batch", db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH, median_ns(runs), NULL, 0);
+
+    // Retransmissions: the same BENCH_CACHE_ENTRIES / 2 requests again and
+    // again, answered by the response cache after the first round
+    response_cache_t cache;
+    SUBSCRIBER_PACKET_TYPE status;
+    response_cache_init(&cache, BENCH_CACHE_ENTRIES);
+    response_cache_sync(&cache, 1, 0);
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+        {
+            const subscriber_packet_t *query = &queries[i % (BENCH_CACHE_ENTRIES / 2)];
+            if (!response_cache_find(&cache, query, &status))
+            {
+                status = verify_subscriber_indexed(&subscriber_index, (subscriber_packet_t *)query);
+                response_cache_insert(&cache, query, status);
+            }
+            sink += status;
+        }
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_cache_repeat", db_size, BENCH_LOOKUPS, median_ns(runs), NULL, 0);
+    response_cache_free(&cache);
+
+    // Requests from BENCH_REPLAY_CLIENTS clients through the replay window: new
+    // ones, then the same again as retransmissions, 1M requests later
+    replay_window_t replay;
+    replay_request_t *requests = malloc(BENCH_LOOKUPS * sizeof(replay_request_t));
+    uint64_t duplicate_runs[BENCH_REPEATS];
+    if (requests == NULL)
+        error("Error: Allocating replay requests");
+    replay_window_init(&replay, BENCH_REPLAY_WINDOW);
+    replay_window_sync(&replay, 1, 0);
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        replay_request_t request = {.port = htons(PORT), .version = SUBSCRIBER_PROTOCOL_VERSION};
+        request.client_id = (uint32_t)(i % BENCH_REPLAY_CLIENTS);
+        request.address = htonl(0x0A000000 + request.client_id);
+        request.src_sub_no = queries[i].src_sub_no;
+        request.technology = queries[i].technology;
+        requests[i] = request;
+    }
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+            requests[i].sequence_no = (uint32_t)(r * BENCH_LOOKUPS + i) / BENCH_REPLAY_CLIENTS;
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+        {
+            replay_lookup_batch(&replay, &subscriber_index, &requests[i], &queries[i], statuses, BENCH_BATCH);
+            sink += statuses[BENCH_BATCH - 1];
+        }
+        runs[r] = monotonic_time_ns() - start;
+        start = monotonic_time_ns();
+        for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+        {
+            replay_lookup_batch(&replay, &subscriber_index, &requests[i], &queries[i], statuses, BENCH_BATCH);
+            sink += statuses[BENCH_BATCH - 1];
+        }
+        duplicate_runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_replay_new", db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH, median_ns(runs),
+                  NULL, 0);
+    report_result(report, "lookup_replay_duplicate", db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH,
+                  median_ns(duplicate_runs), NULL, 0);
+    replay_window_free(&replay);
+    free(requests);
+
+    // The same through the negative-lookup filter, half the requests are misses
+    subscriber_filter_t filter;
+    subscriber_filter_stats_t filter_stats = {0};
+    subscriber_filter_build(&filter, &subscriber_index, 0);
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+            sink += subscriber_filter_lookup(&filter, &subscriber_index, queries[i].src_sub_no, queries[i].technology,
+                                             &filter_stats);
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_filter", db_size, BENCH_LOOKUPS, median_ns(runs), NULL, 0);
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+        {
+            subscriber_filter_lookup_batch(&filter, &subscriber_index, &queries[i], statuses, BENCH_BATCH, &filter_stats);
+            sink += statuses[BENCH_BATCH - 1];
+        }
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_batch_filter", db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH, median_ns(runs), NULL, 0);
+    fprintf(stderr, "%-22s %10zu  %llu bytes, false positive rate %.3f%%\n", "filter", db_size,
+            (unsigned long long)(filter.block_count * sizeof(subscriber_filter_block_t)),
+            100 * subscriber_filter_false_positive_rate(&filter_stats));
+    subscriber_filter_free(&filter);
+
+    // The packed table with an empty overlay index, as myserver -P serves it
+    subscriber_table_t packed;
+    subscriber_index_t overlay;
+    subscriber_table_build(&packed, verification_database, db_size);
+    subscriber_index_build_reserved(&overlay, NULL, 0, subscriber_table_overlay_keys(&packed));
+    filter.blocks = NULL;
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+            sink += subscriber_table_lookup(&packed, &overlay, queries[i].src_sub_no, queries[i].technology);
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_packed", db_size, BENCH_LOOKUPS, median_ns(runs), NULL, 0);
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+        {
+            subscriber_table_lookup_batch(&filter, &packed, &overlay, &queries[i], statuses, BENCH_BATCH, &filter_stats);
+            sink += statuses[BENCH_BATCH - 1];
+        }
+        runs[r] = monotonic_time_ns() - start;
+    }
+    report_result(report, "lookup_batch_packed", db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH, median_ns(runs), NULL, 0);
+    fprintf(stderr, "%-22s %10zu  %.2f bytes/subscriber (%u-bit entries), index %.2f bytes/subscriber\n", "packed", db_size,
+            (double)subscriber_table_memory_bytes(&packed) / packed.count, packed.entry_bits,
+            (double)subscriber_index_memory_bytes(&subscriber_index) / subscriber_index.count);
+    subscriber_index_free(&overlay);
+    subscriber_table_free(&packed);
+
+    subscriber_index_free(&subscriber_index);
+    (void)sink;
+}
+
+// An index copied by a thread pinned to a NUMA node, so its pages are there:
+typedef struct
+{
+    const subscriber_index_t *index;
+    subscriber_index_t copy;
+} bench_index_copy_t;
+
+/**
+ * @brief Copy an index. Thread entry point.
+ *
+ * @param arg bench_index_copy_t
+ * @return void* NULL
+ */
+static void *copy_index(void *arg)
+{
+    bench_index_copy_t *job = arg;
+    subscriber_index_copy(&job->copy, job->index);
+    return NULL;
+}
+
+/**
+ * @brief Open a counter of the calling thread's loads served from another
+ *      NUMA node's memory (perf's node-load-misses).
+ *
+ * @return int perf event descriptor, disabled, or -1 without the counter
+ */
+static int open_remote_load_counter(void)
+{
+    struct perf_event_attr attr = {
+        .size = sizeof(attr),
+        .type = PERF_TYPE_HW_CACHE,
+        .config = PERF_COUNT_HW_CACHE_NODE | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+        .disabled = 1,
+        .exclude_kernel = 1,
+    };
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief Batched lookups from node 0's CPUs into an index in node 0's memory,
+ *      and into one in the last node's memory, as myserver without -N serves
+ *      half its workers on a dual-socket host. Counts remote-memory loads when
+ *      the CPU exposes them. The remote row needs two or more nodes.
+ *
+ * @param report output
+ * @param verification_database database
+ * @param db_size number of entries
+ * @param queries BENCH_LOOKUPS packets from bench_lookup()
+ */
+static void bench_numa(const bench_report_t *report, verification_database_t verification_database[], size_t db_size,
+                       subscriber_packet_t queries[])
+{
+    static const char *const names[] = {"lookup_numa_local", "lookup_numa_remote"};
+    SUBSCRIBER_PACKET_TYPE statuses[BENCH_BATCH];
+    uint64_t runs[BENCH_REPEATS];
+    volatile unsigned int sink = 0;
+    subscriber_index_t subscriber_index;
+    numa_topology_t numa;
+    cpu_set_t saved;
+    int counter;
+
+    numa_topology_read(&numa);
+    if (sched_getaffinity(0, sizeof(saved), &saved) < 0)
+        error("ERROR: sched_getaffinity");
+    numa_topology_pin(&numa, 0);
+    subscriber_index_build(&subscriber_index, verification_database, db_size);
+    counter = open_remote_load_counter();
+
+    for (unsigned int k = 0; k < (numa.node_count > 1 ? 2u : 1u); k++)
+    {
+        unsigned int node = k ? numa.node_count - 1 : 0;
+        bench_index_copy_t job = {.index = &subscriber_index};
+        uint64_t remote_loads = 0, value;
+        char remote[32] = "n/a";
+        pthread_t thread;
+
+        numa_topology_start(&numa, node, &thread, copy_index, &job);
+        pthread_join(thread, NULL);
+        for (int r = 0; r < BENCH_REPEATS; r++)
+        {
+            uint64_t start = monotonic_time_ns();
+            if (counter >= 0)
+            {
+                ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+                ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+            }
+            for (size_t i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+            {
+                subscriber_index_lookup_batch(&job.copy, &queries[i], statuses, BENCH_BATCH);
+                sink += statuses[BENCH_BATCH - 1];
+            }
+            runs[r] = monotonic_time_ns() - start;
+            if (counter >= 0)
+            {
+                ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(counter, &value, sizeof(value)) == sizeof(value))
+                    remote_loads += value;
+            }
+        }
+        report_result(report, names[k], db_size, BENCH_LOOKUPS / BENCH_BATCH * BENCH_BATCH, median_ns(runs), NULL, 0);
+        if (counter >= 0)
+            snprintf(remote, sizeof(remote), "%.3f", (double)remote_loads / ((uint64_t)BENCH_REPEATS * BENCH_LOOKUPS));
+        fprintf(stderr, "%-22s %10zu  index on node %d (%d%% of pages), %s remote-memory loads/lookup\n", "numa", db_size,
+                numa.ids[node],
+                numa_topology_local_percent(&numa, node, job.copy.slots, subscriber_index_memory_bytes(&job.copy)),
+                remote);
+        subscriber_index_free(&job.copy);
+    }
+    if (numa.node_count == 1)
+        fprintf(stderr, "%-22s %10zu  one NUMA node, no remote row\n", "numa", db_size);
+
+    if (counter >= 0)
+        close(counter);
+    subscriber_index_free(&subscriber_index);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved) != 0)
+        error("ERROR: Restoring CPU affinity");
+    (void)sink;
+}
+
+/**
+ * @brief Database load: parsing the text file, building the index, and
+ *      mapping a compiled image. Operations are database entries.
+ *
+ * @param report output
+ * @param db_size number of entries
+ * @param text_path text database written by write_database()
+ * @param image_path image file to write and map
+ */
+static void bench_load(const bench_report_t *report, size_t db_size, const char *text_path, const char *image_path)
+{
+    uint64_t parse_runs[BENCH_REPEATS], build_runs[BENCH_REPEATS], map_runs[BENCH_REPEATS];
+
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        verification_database_t *loaded = NULL;
+        subscriber_index_t subscriber_index;
+
+        uint64_t start = monotonic_time_ns();
+        size_t loaded_size = read_verification_database(&loaded, (char *)text_path);
+        parse_runs[r] = monotonic_time_ns() - start;
+
+        start = monotonic_time_ns();
+        subscriber_index_build(&subscriber_index, loaded, loaded_size);
+        build_runs[r] = monotonic_time_ns() - start;
+
+        if (r == 0)
+            subscriber_index_save(&subscriber_index, image_path);
+        subscriber_index_free(&subscriber_index);
+        free(loaded);
+
+        start = monotonic_time_ns();
+        subscriber_index_map(&subscriber_index, image_path);
+        map_runs[r] = monotonic_time_ns() - start;
+        subscriber_index_free(&subscriber_index);
+    }
+    report_result(report, "load_text", db_size, db_size, median_ns(parse_runs), NULL, 0);
+    report_result(report, "load_index_build", db_size, db_size, median_ns(build_runs), NULL, 0);
+    report_result(report, "load_image_map", db_size, db_size, median_ns(map_runs), NULL, 0);
+}
+
+/**
+ * @brief myclient's request reader: parse an input file of requests through
+ *      the parser thread and its queue, without sending them.
+ *
+ * @param report output
+ * @param verification_database database to draw requests from
+ * @param db_size number of database entries
+ * @param path input file to write and read
+ */
+static void bench_client_read(const bench_report_t *report, verification_database_t verification_database[],
+                              size_t db_size, const char *path)
+{
+    uint64_t runs[BENCH_REPEATS];
+    subscriber_packet_t packet;
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+        error("ERROR: Writing benchmark requests");
+    fprintf(fp, "%d\n", BENCH_CLIENT_REQUESTS);
+    for (unsigned int i = 0; i < BENCH_CLIENT_REQUESTS; i++)
+    {
+        bench_generate_request(&packet, verification_database, db_size);
+        fprintf(fp, "%u\n%u\n%u\n%u\n", i & MAX_CLIENT_ID, i, packet.technology, packet.src_sub_no);
+    }
+    if (fclose(fp) != 0)
+        error("ERROR: Writing benchmark requests");
+
+    request_reader_t *reader = malloc(sizeof(request_reader_t));
+    if (reader == NULL)
+        error("ERROR: Allocating benchmark memory");
+    for (int r = 0; r < BENCH_REPEATS; r++)
+    {
+        uint64_t start = monotonic_time_ns(), count = 0;
+        request_reader_open(reader, path);
+        while (request_reader_next(reader, &packet, true) == REQUEST_READ_OK)
+            count++;
+        request_reader_close(reader);
+        runs[r] = monotonic_time_ns() - start;
+        if (count != BENCH_CLIENT_REQUESTS)
+            error("ERROR: Request reader lost requests");
+    }
+    free(reader);
+    report_result(report, "client_request_read", 0, BENCH_CLIENT_REQUESTS, median_ns(runs), NULL, 0);
+}
+
+/**
+ * @brief Find a free loopback UDP port for the server.
+ *
+ * @return int port number
+ */
+static int free_port(void)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &addr_len) < 0)
+        error("ERROR: Finding a free port");
+    close(sock);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Closed-loop request/response over loopback for BENCH_LOOPBACK_NS.
+ *      Requests are matched to responses by (client_id, segment_no).
+ *
+ * @param sock connected socket
+ * @param window requests kept in flight
+ * @param frame_records requests per batch frame, 0 to send single packets
+ * @param verification_database database to draw requests from
+ * @param db_size number of entries
+ * @param latency histogram to fill
+ * @param lost requests without a response within BENCH_LOOPBACK_TIMEOUT_NS
+ * @return uint64_t completed requests
+ */
+static uint64_t run_loopback(int sock, unsigned int window, unsigned int frame_records,
+                             verification_database_t verification_database[], size_t db_size,
+                             latency_histogram_t *latency, uint64_t *lost)
+{
+    static uint64_t sent_ns[BENCH_LOOPBACK_KEYS];
+    static subscriber_packet_t pending[BENCH_LOOPBACK_KEYS];
+    static bool in_flight[BENCH_LOOPBACK_KEYS];
+    static batch_frame_t frame, datagram;
+    subscriber_packet_t responses[BATCH_MAX_RECORDS];
+    unsigned int in_flight_count = 0, next_key = 0, response_count;
+    ssize_t size;
+    uint64_t completed = 0, start = monotonic_time_ns(), now = start, next_scan = start;
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+
+    memset(in_flight, false, sizeof(in_flight));
+    reset_batch_frame(&frame);
+    latency_histogram_init(latency);
+    *lost = 0;
+    while (now - start < BENCH_LOOPBACK_NS)
+    {
+        while (in_flight_count < window)
+        {
+            while (in_flight[next_key])
+                next_key = (next_key + 1) % BENCH_LOOPBACK_KEYS;
+            subscriber_packet_t *packet = &pending[next_key];
+            bench_generate_request(packet, verification_database, db_size);
+            packet->client_id = next_key / PACKET_GROUP_SIZE;
+            packet->segment_no = next_key % PACKET_GROUP_SIZE;
+            sent_ns[next_key] = monotonic_time_ns();
+            if (frame_records > 0)
+                add_batch_record(&frame, packet);
+            else if (send(sock, packet, sizeof(*packet), 0) < 0 && errno != ENOBUFS && errno != EAGAIN)
+                error("ERROR: send");
+            // A frame goes out when full, or once the window is
+            if (frame.count > 0 && (frame.count == frame_records || in_flight_count + 1 == window))
+            {
+                if (send(sock, &frame, finish_batch_frame(&frame), 0) < 0 && errno != ENOBUFS && errno != EAGAIN)
+                    error("ERROR: send");
+                reset_batch_frame(&frame);
+            }
+            in_flight[next_key] = true;
+            in_flight_count++;
+            next_key = (next_key + 1) % BENCH_LOOPBACK_KEYS;
+        }
+
+        if (poll(&pfd, 1, 10) < 0 && errno != EINTR)
+            error("ERROR: poll");
+        while ((size = recv(sock, &datagram, sizeof(datagram), MSG_DONTWAIT)) >= 0)
+        {
+            uint64_t received = monotonic_time_ns();
+            response_count = batch_frame_responses(&datagram, size, responses);
+            for (unsigned int r = 0; r < response_count; r++)
+            {
+                if (responses[r].segment_no >= PACKET_GROUP_SIZE)
+                    continue;
+                unsigned int key = responses[r].client_id * PACKET_GROUP_SIZE + responses[r].segment_no;
+                if (!in_flight[key] || pending[key].src_sub_no != responses[r].src_sub_no)
+                    continue;
+                latency_histogram_record(latency, received - sent_ns[key]);
+                in_flight[key] = false;
+                in_flight_count--;
+                completed++;
+            }
+        }
+
+        now = monotonic_time_ns();
+        if (now >= next_scan)
+        {
+            for (unsigned int key = 0; key < BENCH_LOOPBACK_KEYS; key++)
+                if (in_flight[key] && now - sent_ns[key] > BENCH_LOOPBACK_TIMEOUT_NS)
+                {
+                    in_flight[key] = false;
+                    in_flight_count--;
+                    (*lost)++;
+                }
+            next_scan = now + BENCH_LOOPBACK_TIMEOUT_NS / 10;
+        }
+    }
+
+    // Let the last responses arrive so they don't leak into the next run
+    uint64_t drain_end = monotonic_time_ns() + BENCH_LOOPBACK_TIMEOUT_NS;
+    while (in_flight_count > 0 && monotonic_time_ns() < drain_end)
+    {
+        if (poll(&pfd, 1, 10) > 0)
+            while ((size = recv(sock, &datagram, sizeof(datagram), MSG_DONTWAIT)) >= 0)
+            {
+                response_count = batch_frame_responses(&datagram, size, responses);
+                for (unsigned int r = 0; r < response_count; r++)
+                    if (responses[r].segment_no < PACKET_GROUP_SIZE &&
+                        in_flight[responses[r].client_id * PACKET_GROUP_SIZE + responses[r].segment_no])
+                    {
+                        in_flight[responses[r].client_id * PACKET_GROUP_SIZE + responses[r].segment_no] = false;
+                        in_flight_count--;
+                    }
+            }
+    }
+    *lost += in_flight_count;
+    return completed;
+}
+
+/**
+ * @brief End-to-end request/response against a myserver child process on
+ *      loopback, one request in flight (latency) and a window (throughput).
+ *
+ * @param report output
+ * @param server_path myserver executable
+ * @param database_path database for the server
+ * @param verification_database database to draw requests from
+ * @param db_size number of entries
+ */
+static void bench_loopback(const bench_report_t *report, const char *server_path, const char *database_path,
+                           verification_database_t verification_database[], size_t db_size)
+{
+    char port_arg[16];
+    int port = free_port();
+    pid_t server_pid;
+
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    server_pid = fork();
+    if (server_pid < 0)
+        error("ERROR: fork");
+    if (server_pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(server_path, server_path, "-v", "off", port_arg, database_path, (char *)NULL);
+        perror("ERROR: Starting myserver");
+        _exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons(port),
+                                 .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0)
+        error("ERROR: Opening loopback socket");
+
+    // Probe until the server has loaded the database and answers
+    bool ready = false;
+    for (int i = 0; i < BENCH_SERVER_START_TRIES && !ready; i++)
+    {
+        subscriber_packet_t probe, response;
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        bench_generate_request(&probe, verification_database, db_size);
+        send(sock, &probe, sizeof(probe), 0);
+        if (poll(&pfd, 1, 50) > 0 && recv(sock, &response, sizeof(response), MSG_DONTWAIT) > 0)
+            ready = true;
+        else
+            usleep(50000); // ECONNREFUSED returns at once while the server isn't bound yet
+    }
+    if (!ready)
+    {
+        kill(server_pid, SIGKILL);
+        waitpid(server_pid, NULL, 0);
+        fprintf(stderr, "ERROR: %s did not answer on port %d\n", server_path, port);
+        exit(EXIT_FAILURE);
+    }
+
+    latency_histogram_t *latency = malloc(sizeof(latency_histogram_t));
+    if (latency == NULL)
+        error("ERROR: Allocating histogram");
+    uint64_t lost, completed;
+
+    completed = run_loopback(sock, 1, 0, verification_database, db_size, latency, &lost);
+    report_result(report, "loopback_window_1", db_size, completed, BENCH_LOOPBACK_NS, latency, lost);
+    completed = run_loopback(sock, BENCH_LOOPBACK_WINDOW, 0, verification_database, db_size, latency, &lost);
+    report_result(report, "loopback_window_64", db_size, completed, BENCH_LOOPBACK_NS, latency, lost);
+    // The same window in one batch frame, then a window of several frames
+    completed = run_loopback(sock, BENCH_LOOPBACK_WINDOW, BENCH_LOOPBACK_FRAME_RECORDS, verification_database,
+                             db_size, latency, &lost);
+    report_result(report, "loopback_batch_64", db_size, completed, BENCH_LOOPBACK_NS, latency, lost);
+    completed = run_loopback(sock, 16 * BENCH_LOOPBACK_WINDOW, BENCH_LOOPBACK_FRAME_RECORDS, verification_database,
+                             db_size, latency, &lost);
+    report_result(report, "loopback_batch_64_window_1024", db_size, completed, BENCH_LOOPBACK_NS, latency, lost);
+
+    free(latency);
+    close(sock);
+    kill(server_pid, SIGINT);
+    waitpid(server_pid, NULL, 0);
+}
+
+/**
+ * @brief Print usage and exit.
+ *
+ * @param program argv[0]
+ */
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-o results.csv] [-n max_db_size] [-V version] [-s myserver] [-L]\n"
+                    "  -L  skip the loopback benchmarks\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return int 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    bench_report_t report = {.out = stdout, .version = "unknown"};
+    size_t max_db_size = BENCH_DEFAULT_MAX_DB_SIZE;
+    const char *server_path = "./myserver";
+    bool loopback = true, append = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:V:s:L")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            append = access(optarg, F_OK) == 0;
+            if ((report.out = fopen(optarg, "a")) == NULL)
+                error("ERROR: Opening results file");
+            break;
+        case 'n':
+            max_db_size = strtoull(optarg, NULL, 10);
+            break;
+        case 'V':
+            report.version = optarg;
+            break;
+        case 's':
+            server_path = optarg;
+            break;
+        case 'L':
+            loopback = false;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || max_db_size < 1000)
+        usage(argv[0]);
+
+    // Results from several versions accumulate in one file, the header goes in once
+    if (!append)
+        fprintf(report.out, BENCH_CSV_HEADER);
+
+    char text_path[] = "/tmp/benchsuite_XXXXXX", image_path[sizeof(text_path) + 4];
+    int text_fd = mkstemp(text_path);
+    if (text_fd < 0)
+        error("ERROR: Creating benchmark database file");
+    close(text_fd);
+    snprintf(image_path, sizeof(image_path), "%s.img", text_path);
+
+    size_t scratch = BENCH_VALIDATE_PACKETS > BENCH_LOOKUPS ? BENCH_VALIDATE_PACKETS : BENCH_LOOKUPS;
+    verification_database_t *verification_database = malloc(max_db_size * sizeof(verification_database_t));
+    subscriber_packet_t *packets = malloc(scratch * sizeof(subscriber_packet_t));
+    if (verification_database == NULL || packets == NULL)
+        error("ERROR: Allocating benchmark memory");
+
+    bench_validate(&report, packets);
+    for (size_t db_size = 1000; db_size <= max_db_size; db_size *= 10)
+    {
+        bench_generate_database(verification_database, db_size);
+        write_database(verification_database, db_size, text_path);
+        bench_lookup(&report, verification_database, db_size, packets);
+        bench_numa(&report, verification_database, db_size, packets);
+        bench_load(&report, db_size, text_path, image_path);
+        if (loopback)
+            bench_loopback(&report, server_path, image_path, verification_database, db_size);
+    }
+    // After the sizes, so their generated databases stay the same as before
+    bench_client_read(&report, verification_database, 1000, text_path);
+
+    unlink(text_path);
+    unlink(image_path);
+    free(packets);
+    free(verification_database);
+    if (report.out != stdout)
+        fclose(report.out);
+    return EXIT_SUCCESS;
+}
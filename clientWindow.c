@@ -0,0 +1,88 @@
+/**
+ * @file clientWindow.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the client's sliding window of in-flight requests
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "clientWindow.h"
+
+void client_window_init(client_window_t *window, unsigned int window_size)
+{
+    memset(window, DEFAULT_VALUE, sizeof(*window));
+    window->window_size = window_size;
+}
+
+client_request_t *client_window_add(
+    client_window_t *window, const subscriber_packet_t *packet, uint64_t request_no,
+    uint64_t now_ns, uint64_t timeout_ns)
+{
+    unsigned int key = client_request_key(packet->client_id, packet->segment_no);
+    client_request_t *request = &window->requests[key];
+
+    request->packet = *packet;
+    request->request_no = request_no;
+    request->sent_ns = now_ns;
+    request->deadline_ns = now_ns + timeout_ns;
+    request->attempts = 0;
+    request->position = window->in_flight_count;
+    request->in_flight = true;
+    window->in_flight[window->in_flight_count++] = key;
+    return request;
+}
+
+client_request_t *client_window_match(client_window_t *window, const subscriber_packet_t *response)
+{
+    client_request_t *request;
+
+    if (response->segment_no >= PACKET_GROUP_SIZE)
+        return NULL;
+    request = &window->requests[client_request_key(response->client_id, response->segment_no)];
+    if (!request->in_flight ||
+        request->packet.technology != response->technology ||
+        request->packet.src_sub_no != response->src_sub_no)
+        return NULL;
+    return request;
+}
+
+void client_window_remove(client_window_t *window, client_request_t *request)
+{
+    // Swap-remove from the in-flight list:
+    unsigned int last = window->in_flight[--window->in_flight_count];
+    window->in_flight[request->position] = last;
+    window->requests[last].position = request->position;
+    request->in_flight = false;
+}
+
+client_request_t *client_window_next_expired(client_window_t *window, uint64_t now_ns)
+{
+    client_request_t *expired = NULL;
+
+    // Oldest deadline first, so retries go out in the order they were due
+    for (unsigned int i = 0; i < window->in_flight_count; i++)
+    {
+        client_request_t *request = &window->requests[window->in_flight[i]];
+        if (request->deadline_ns <= now_ns && (expired == NULL || request->deadline_ns < expired->deadline_ns))
+            expired = request;
+    }
+    return expired;
+}
+
+uint64_t client_window_next_deadline(const client_window_t *window)
+{
+    uint64_t deadline = UINT64_MAX;
+
+    for (unsigned int i = 0; i < window->in_flight_count; i++)
+    {
+        const client_request_t *request = &window->requests[window->in_flight[i]];
+        if (request->deadline_ns < deadline)
+            deadline = request->deadline_ns;
+    }
+    return deadline;
+}
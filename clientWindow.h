@@ -0,0 +1,138 @@
+/**
+ * @file clientWindow.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the client's sliding window of in-flight requests
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CLIENTWINDOW_H /* include guard */
+#define CLIENTWINDOW_H
+
+#include "customProtocol.h"
+
+// Requests are matched to responses by (client_id, segment_no), so at most one
+// request per key can be in flight and the window can't exceed the key space.
+#define CLIENT_WINDOW_KEYS ((MAX_CLIENT_ID + 1) * PACKET_GROUP_SIZE)
+#define DEFAULT_WINDOW_SIZE 1
+#define MAX_WINDOW_SIZE CLIENT_WINDOW_KEYS
+
+// One in-flight request:
+typedef struct
+{
+    subscriber_packet_t packet; // As sent, for retransmission
+    uint64_t request_no;        // Position in the input, for reporting
+    uint64_t sent_ns;           // Last (re)transmission
+    uint64_t deadline_ns;       // ACK timer expiry
+    unsigned int attempts;      // Retransmissions so far, 0 for the original
+    unsigned int position;      // Index in the window's in-flight list
+    bool in_flight;
+} client_request_t;
+
+// Custom Protocol client window:
+typedef struct
+{
+    client_request_t requests[CLIENT_WINDOW_KEYS]; // Indexed by request key
+    uint16_t in_flight[CLIENT_WINDOW_KEYS];        // Keys of in-flight requests, unordered
+    unsigned int in_flight_count;
+    unsigned int window_size;
+} client_window_t;
+
+/**
+ * @brief Key of a request or response in the window.
+ *
+ * @param client_id client ID
+ * @param segment_no segment number, below PACKET_GROUP_SIZE
+ * @return unsigned int key
+ */
+static inline unsigned int client_request_key(uint8_t client_id, uint8_t segment_no)
+{
+    return client_id * PACKET_GROUP_SIZE + segment_no;
+}
+
+/**
+ * @brief Initialize an empty window.
+ *
+ * @param window window to initialize
+ * @param window_size maximum requests in flight, 1 - MAX_WINDOW_SIZE
+ */
+void client_window_init(client_window_t *window, unsigned int window_size);
+
+/**
+ * @brief Whether another request may be sent now.
+ *
+ * @param window client window
+ * @return true if fewer than window_size requests are in flight
+ */
+static inline bool client_window_has_room(const client_window_t *window)
+{
+    return window->in_flight_count < window->window_size;
+}
+
+/**
+ * @brief Whether a request with this key is already in flight. A new request
+ *      with the same key must wait, or its response would be ambiguous.
+ *
+ * @param window client window
+ * @param packet request to check
+ * @return true if the key is taken
+ */
+static inline bool client_window_is_busy(const client_window_t *window, const subscriber_packet_t *packet)
+{
+    return window->requests[client_request_key(packet->client_id, packet->segment_no)].in_flight;
+}
+
+/**
+ * @brief Add a request that was just sent.
+ *
+ * @param window client window, must have room and the key must be free
+ * @param packet request as sent
+ * @param request_no position in the input
+ * @param now_ns send time
+ * @param timeout_ns ACK timer
+ * @return client_request_t* the in-flight request
+ */
+client_request_t *client_window_add(
+    client_window_t *window, const subscriber_packet_t *packet, uint64_t request_no,
+    uint64_t now_ns, uint64_t timeout_ns);
+
+/**
+ * @brief Find the in-flight request a response answers.
+ *
+ * @param window client window
+ * @param response received response
+ * @return client_request_t* the request, NULL for a stale or unknown response
+ */
+client_request_t *client_window_match(client_window_t *window, const subscriber_packet_t *response);
+
+/**
+ * @brief Remove a completed or abandoned request.
+ *
+ * @param window client window
+ * @param request request from client_window_add()
+ */
+void client_window_remove(client_window_t *window, client_request_t *request);
+
+/**
+ * @brief Find an in-flight request whose ACK timer has expired.
+ *
+ * @param window client window
+ * @param now_ns current time
+ * @return client_request_t* an expired request, NULL if none
+ */
+client_request_t *client_window_next_expired(client_window_t *window, uint64_t now_ns);
+
+/**
+ * @brief Earliest ACK timer expiry in the window.
+ *
+ * @param window client window
+ * @return uint64_t deadline, UINT64_MAX when nothing is in flight
+ */
+uint64_t client_window_next_deadline(const client_window_t *window);
+
+#endif
@@ -12,6 +12,7 @@
  */
 
 #include "customProtocol.h"
+#include <ctype.h>
 
 /**
  * @brief Error function
@@ -20,14 +21,17 @@
  */
 void error(const char *msg)
 {
+    int saved_errno = errno;
+    log_shutdown();
+    errno = saved_errno;
     perror(msg);
     exit(EXIT_FAILURE);
 }
 
 SUBSCRIBER_PACKET_TYPE verify_subscriber(
-    verification_database_t verification_database[], uint8_t db_size, subscriber_packet_t *subscriber_packet)
+    verification_database_t verification_database[], size_t db_size, subscriber_packet_t *subscriber_packet)
 {
-    for (int i = 0; i < db_size; i++)
+    for (size_t i = 0; i < db_size; i++)
     {
         if (verification_database[i].src_sub_no == subscriber_packet->src_sub_no &&
             verification_database[i].technology == subscriber_packet->technology)
@@ -41,36 +45,403 @@ SUBSCRIBER_PACKET_TYPE verify_subscriber(
     return SUB_NOT_EXIST;
 }
 
-bool is_valid_subscriber_packet(subscriber_packet_t *packet)
+/**
+ * @brief Parse the next unsigned decimal number, skipping any separators
+ *      before it. Eight digits at a time are converted with SWAR arithmetic,
+ *      so a 10-digit subscriber number takes one 64-bit chunk plus two digits.
+ *
+ * @param p current position in the text
+ * @param end end of the text
+ * @param value parsed number
+ * @return const char* position after the number, NULL if no number is left
+ */
+static inline const char *parse_database_number(const char *p, const char *end, uint64_t *value)
 {
-    if (packet->start_packet != START_PACKET)
+    uint64_t v = 0, chunk;
+
+    while (p < end && (unsigned char)(*p - '0') > 9)
+        p++;
+    if (p == end)
+        return NULL;
+
+    // All eight bytes are digits when each high nibble is 3 and adding 6 doesn't carry out of it
+    while (end - p >= 8)
+    {
+        memcpy(&chunk, p, sizeof(chunk));
+        if ((chunk & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+            ((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL)
+            break;
+        chunk -= 0x3030303030303030ULL;
+        chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFULL;
+        chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFULL;
+        chunk = (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFFULL;
+        v = v * 100000000ULL + chunk;
+        p += 8;
+    }
+    while (p < end && (unsigned char)(*p - '0') <= 9)
+        v = v * 10 + (uint64_t)(*p++ - '0');
+
+    *value = v;
+    return p;
+}
+
+/**
+ * @brief Read in the verification database.
+ *
+ * @param verification_database set to the allocated database, left NULL on failure
+ * @param filename text database
+ * @param exact whether the rows must match the entry count, otherwise a
+ *      short file is warned about and what was read is kept
+ * @param db_size set to the database size
+ * @return const char* NULL if read, otherwise what is wrong (errno is set
+ *      when a system call failed)
+ */
+static const char *parse_verification_database(verification_database_t **verification_database,
+                                               const char *filename, bool exact, size_t *db_size)
+{
+    int fd;
+    struct stat st;
+    const char *text, *p, *end, *problem = NULL;
+    uint64_t count = 0, src_sub_no, technology, paid;
+    size_t i;
+
+    *verification_database = NULL;
+
+    // Map the file:
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return "Error opening file";
+    if (fstat(fd, &st) < 0)
     {
-        printf("Error: Invalid start packet 0x%04X\n", packet->start_packet);
-        return false;
+        close(fd);
+        return "ERROR: fstat verification database";
     }
-    if (packet->packet_type < SUB_ACC_PER ||
-        packet->packet_type > SUB_ACC_OK)
+    if (st.st_size == 0)
+    {
+        close(fd);
+        errno = EINVAL;
+        return "ERROR: Empty verification database file";
+    }
+    text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+        return "ERROR: mmap verification database";
+    madvise((void *)text, st.st_size, MADV_SEQUENTIAL);
+    p = text;
+    end = text + st.st_size;
+
+    // Read the number of database entries, bounded by what the file can hold:
+    while (exact && p < end && isspace((unsigned char)*p))
+        p++;
+    if ((exact && (p == end || !isdigit((unsigned char)*p))) || (p = parse_database_number(p, end, &count)) == NULL)
+    {
+        munmap((void *)text, st.st_size);
+        errno = EINVAL;
+        return "ERROR: Missing verification database entry count";
+    }
+    if (count > (uint64_t)st.st_size / MIN_DATABASE_ROW_SIZE)
+    {
+        if (exact)
+        {
+            munmap((void *)text, st.st_size);
+            errno = EINVAL;
+            return "ERROR: Database rows don't match the header count";
+        }
+        count = (uint64_t)st.st_size / MIN_DATABASE_ROW_SIZE;
+    }
+
+    // Allocate the database, at least one entry so the pointer is always valid:
+    *verification_database = malloc((count ? count : 1) * sizeof(verification_database_t));
+    if (*verification_database == NULL)
+    {
+        munmap((void *)text, st.st_size);
+        return "ERROR: Allocating verification database";
+    }
+
+    // Read in verification database entries, three numbers per subscriber:
+    for (i = 0; i < count; i++)
+    {
+        if ((p = parse_database_number(p, end, &src_sub_no)) == NULL ||
+            (p = parse_database_number(p, end, &technology)) == NULL ||
+            (p = parse_database_number(p, end, &paid)) == NULL)
+            break;
+        (*verification_database)[i].src_sub_no = (uint32_t)src_sub_no;
+        (*verification_database)[i].technology = (SUBSCRIBER_TECHNOLOGY)technology;
+        (*verification_database)[i].paid = paid != 0;
+    }
+
+    // File shorter than its header claims: keep what was read, unless the
+    // rows must match, as a file still being written is short too
+    if (exact && (i < count || parse_database_number(p, end, &paid) != NULL))
+        problem = "ERROR: Database rows don't match the header count";
+    else if (i < count)
+        fprintf(stderr, "Warning: Database header says %llu entries, file has %zu\n",
+                (unsigned long long)count, i);
+
+    // Housekeeping:
+    munmap((void *)text, st.st_size);
+    if (problem)
     {
-        printf("Error: Invalid packet_type 0x%04X\n", packet->packet_type);
-        return false;
+        free(*verification_database);
+        *verification_database = NULL;
+        errno = EINVAL;
+        return problem;
     }
-    if (packet->segment_no >= PACKET_GROUP_SIZE) // [0 - 4]
+    *db_size = i;
+    return NULL;
+}
+
+size_t read_verification_database(verification_database_t **verification_database, char *filename)
+{
+    size_t db_size = 0;
+    const char *problem = parse_verification_database(verification_database, filename, false, &db_size);
+    if (problem)
+        error(problem);
+    return db_size;
+}
+
+bool try_read_verification_database(verification_database_t **verification_database, const char *filename,
+                                    size_t *db_size)
+{
+    const char *problem = parse_verification_database(verification_database, filename, true, db_size);
+    if (problem)
+        fprintf(stderr, "Warning: %s: %s (%s)\n", filename, problem, strerror(errno));
+    return problem == NULL;
+}
+
+PACKET_VALIDATION check_subscriber_packet(const subscriber_packet_t *packet, size_t packet_size)
+{
+    // One bit per bad field, bit (reason - 1), so the valid path is a single test
+    uint32_t bad =
+        (uint32_t)(packet_size != sizeof(subscriber_packet_t)) << (PACKET_BAD_LENGTH - 1) |
+        (uint32_t)(packet->start_packet != START_PACKET) << (PACKET_BAD_START - 1) |
+        (uint32_t)((uint16_t)(packet->packet_type - SUB_ACC_PER) > SUB_ACC_OK - SUB_ACC_PER) << (PACKET_BAD_TYPE - 1) |
+        (uint32_t)(packet->segment_no >= PACKET_GROUP_SIZE) << (PACKET_BAD_SEGMENT - 1) | // [0 - 4]
+        (uint32_t)(packet->length != SUBSCRIBER_PAYLOAD_SIZE) << (PACKET_BAD_PAYLOAD_LENGTH - 1) |
+        (uint32_t)((uint8_t)(packet->technology - SUB_2G) > SUB_5G - SUB_2G) << (PACKET_BAD_TECHNOLOGY - 1) |
+        (uint32_t)(packet->end_packet != END_PACKET) << (PACKET_BAD_END - 1);
+
+    if (__builtin_expect(bad == 0, 1))
+        return PACKET_VALID;
+    return (PACKET_VALIDATION)(__builtin_ctz(bad) + 1);
+}
+
+const char *packet_validation_name(PACKET_VALIDATION result)
+{
+    static const char *const names[PACKET_VALIDATION_COUNT] = {
+        "valid", "bad_length", "bad_start", "bad_type", "bad_segment",
+        "bad_payload_length", "bad_technology", "bad_end", "bad_version"};
+    return result < PACKET_VALIDATION_COUNT ? names[result] : "unknown";
+}
+
+void log_invalid_subscriber_packet(const subscriber_packet_t *packet, size_t packet_size, PACKET_VALIDATION result)
+{
+    switch (result)
     {
-        printf("Error: Invalid segment number %hu\n", packet->segment_no);
-        return false;
+    case PACKET_BAD_LENGTH:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid datagram size %llu, expected %llu\n",
+                  packet_size, sizeof(subscriber_packet_t));
+        break;
+    case PACKET_BAD_START:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid start packet 0x%04llX\n", packet->start_packet);
+        break;
+    case PACKET_BAD_TYPE:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid packet_type 0x%04llX\n", packet->packet_type);
+        break;
+    case PACKET_BAD_SEGMENT:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid segment number %llu\n", packet->segment_no);
+        break;
+    case PACKET_BAD_PAYLOAD_LENGTH:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid payload length %llu\n", packet->length);
+        break;
+    case PACKET_BAD_TECHNOLOGY:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid technology %llu\n", packet->technology);
+        break;
+    case PACKET_BAD_END:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid end packet 0x%04llX\n", packet->end_packet);
+        break;
+    default:
+        break;
     }
-    if (packet->technology < SUB_2G ||
-        packet->technology > SUB_5G)
+}
+
+bool is_valid_subscriber_packet(subscriber_packet_t *packet)
+{
+    PACKET_VALIDATION result = check_subscriber_packet(packet, sizeof(*packet));
+
+    if (result != PACKET_VALID)
+        log_invalid_subscriber_packet(packet, sizeof(*packet), result);
+    return result == PACKET_VALID;
+}
+
+PACKET_VALIDATION check_batch_frame(const batch_frame_t *frame, size_t frame_size, bool response)
+{
+    uint16_t end_packet;
+
+    if (frame_size < batch_frame_size(0) || frame_size > BATCH_MAX_FRAME_SIZE || frame->count > BATCH_MAX_RECORDS ||
+        frame_size != batch_frame_size(frame->count))
+        return PACKET_BAD_LENGTH;
+    if (frame->start_packet != BATCH_START_PACKET)
+        return PACKET_BAD_START;
+    if (frame->version != BATCH_PROTOCOL_VERSION)
+        return PACKET_BAD_VERSION;
+    if ((frame->flags != 0) != response)
+        return PACKET_BAD_TYPE;
+    memcpy(&end_packet, (const uint8_t *)frame + frame_size - sizeof(end_packet), sizeof(end_packet));
+    if (end_packet != END_PACKET)
+        return PACKET_BAD_END;
+    return PACKET_VALID;
+}
+
+void log_invalid_batch_frame(const batch_frame_t *frame, size_t frame_size, PACKET_VALIDATION result)
+{
+    switch (result)
     {
-        printf("Error: Invalid technology %hu\n", packet->technology);
-        return false;
+    case PACKET_BAD_LENGTH:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid batch frame size %llu for %llu records\n", frame_size, frame->count);
+        break;
+    case PACKET_BAD_VERSION:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Unsupported batch frame version %llu\n", frame->version);
+        break;
+    case PACKET_BAD_TYPE:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid batch frame flags 0x%02llX\n", frame->flags);
+        break;
+    case PACKET_BAD_END:
+        LOG_TEXT(LOG_LEVEL_WARN, "Error: Invalid batch frame end packet\n");
+        break;
+    default:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid batch frame start packet 0x%04llX\n", frame->start_packet);
     }
+}
+
+bool is_valid_batch_frame(const batch_frame_t *frame, size_t frame_size, bool response)
+{
+    PACKET_VALIDATION result = check_batch_frame(frame, frame_size, response);
+
+    if (result != PACKET_VALID)
+        log_invalid_batch_frame(frame, frame_size, result);
+    return result == PACKET_VALID;
+}
+
+void reset_batch_frame(batch_frame_t *frame)
+{
+    frame->start_packet = BATCH_START_PACKET;
+    frame->version = BATCH_PROTOCOL_VERSION;
+    frame->flags = DEFAULT_VALUE;
+    frame->count = DEFAULT_VALUE;
+    frame->max_records = DEFAULT_VALUE;
+}
+
+void add_batch_record(batch_frame_t *frame, const subscriber_packet_t *packet)
+{
+    batch_record_t *record = &frame->records[frame->count++];
+
+    record->src_sub_no = packet->src_sub_no;
+    record->client_id = packet->client_id;
+    record->segment_no = packet->segment_no;
+    record->technology = packet->technology;
+    record->status = (uint8_t)(packet->packet_type - SUB_ACC_PER);
+}
+
+size_t finish_batch_frame(batch_frame_t *frame)
+{
+    uint16_t end_packet = END_PACKET;
+    size_t frame_size = batch_frame_size(frame->count);
+
+    memcpy((uint8_t *)frame + frame_size - sizeof(end_packet), &end_packet, sizeof(end_packet));
+    return frame_size;
+}
+
+void batch_frame_packet(const batch_frame_t *frame, unsigned int record, subscriber_packet_t *packet)
+{
+    const batch_record_t *batch_record = &frame->records[record];
+
+    reset_subscriber_packet(packet);
+    update_subscriber_packet(packet, batch_record->client_id, (SUBSCRIBER_PACKET_TYPE)(SUB_ACC_PER + batch_record->status),
+                             batch_record->segment_no, batch_record->technology, batch_record->src_sub_no);
+}
+
+unsigned int batch_frame_responses(const batch_frame_t *datagram, ssize_t size,
+                                   subscriber_packet_t responses[BATCH_MAX_RECORDS])
+{
+    unsigned int count = 0;
+
+    if (size == sizeof(subscriber_packet_t))
+    {
+        memcpy(&responses[0], datagram, sizeof(subscriber_packet_t));
+        return 1;
+    }
+    if (size < 0 || !is_batch_frame(datagram, size) || check_batch_frame(datagram, size, true) != PACKET_VALID)
+        return 0;
+    // Records the server found invalid have status 0 and stay unanswered
+    for (unsigned int r = 0; r < datagram->count; r++)
+        if (datagram->records[r].status != 0)
+            batch_frame_packet(datagram, r, &responses[count++]);
+    return count;
+}
+
+PACKET_VALIDATION check_subscriber_packet_v2(const subscriber_packet_v2_t *packet, size_t packet_size)
+{
+    if (packet_size != sizeof(subscriber_packet_v2_t))
+        return PACKET_BAD_LENGTH;
+    if (packet->start_packet != START_PACKET_V2)
+        return PACKET_BAD_START;
+    if (packet->version != SUBSCRIBER_PROTOCOL_VERSION)
+        return PACKET_BAD_VERSION;
+    if ((uint16_t)(packet->packet_type - SUB_ACC_PER) > SUB_ACC_OK - SUB_ACC_PER)
+        return PACKET_BAD_TYPE;
+    if (packet->length != SUBSCRIBER_PAYLOAD_SIZE)
+        return PACKET_BAD_PAYLOAD_LENGTH;
+    if ((uint8_t)(packet->technology - SUB_2G) > SUB_5G - SUB_2G)
+        return PACKET_BAD_TECHNOLOGY;
     if (packet->end_packet != END_PACKET)
+        return PACKET_BAD_END;
+    return PACKET_VALID;
+}
+
+void log_invalid_subscriber_packet_v2(const subscriber_packet_v2_t *packet, size_t packet_size, PACKET_VALIDATION result)
+{
+    switch (result)
     {
-        printf("Error: Invalid end packet 0x%04X\n", packet->end_packet);
-        return false;
+    case PACKET_BAD_LENGTH:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid version 2 datagram size %llu, expected %llu\n",
+                  packet_size, sizeof(subscriber_packet_v2_t));
+        break;
+    case PACKET_BAD_VERSION:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Unsupported packet version %llu\n", packet->version);
+        break;
+    case PACKET_BAD_TYPE:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid packet_type 0x%04llX\n", packet->packet_type);
+        break;
+    case PACKET_BAD_PAYLOAD_LENGTH:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid payload length %llu\n", packet->length);
+        break;
+    case PACKET_BAD_TECHNOLOGY:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid technology %llu\n", packet->technology);
+        break;
+    case PACKET_BAD_END:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid end packet 0x%04llX\n", packet->end_packet);
+        break;
+    default:
+        LOG_EVENT(LOG_LEVEL_WARN, "Error: Invalid start packet 0x%04llX\n", packet->start_packet);
     }
-    return true;
+}
+
+bool is_valid_subscriber_packet_v2(const subscriber_packet_v2_t *packet)
+{
+    PACKET_VALIDATION result = check_subscriber_packet_v2(packet, sizeof(*packet));
+
+    if (result != PACKET_VALID)
+        log_invalid_subscriber_packet_v2(packet, sizeof(*packet), result);
+    return result == PACKET_VALID;
+}
+
+void subscriber_packet_from_v2(const subscriber_packet_v2_t *packet_v2, subscriber_packet_t *packet)
+{
+    reset_subscriber_packet(packet);
+    update_subscriber_packet(packet, (uint8_t)packet_v2->client_id, packet_v2->packet_type,
+                             (uint8_t)(packet_v2->sequence_no % PACKET_GROUP_SIZE), packet_v2->technology,
+                             packet_v2->src_sub_no);
 }
 
 void reset_subscriber_packet(subscriber_packet_t *packet)
@@ -97,12 +468,40 @@ void update_subscriber_packet(
     packet->src_sub_no = src_sub_no;
 }
 
-void print_verification_database(verification_database_t verification_database[], uint8_t db_size)
+void reset_subscriber_packet_v2(subscriber_packet_v2_t *packet)
+{
+    packet->start_packet = START_PACKET_V2;
+    packet->version = SUBSCRIBER_PROTOCOL_VERSION;
+    packet->packet_type = SUB_ACC_PER;
+    packet->client_id = DEFAULT_VALUE;
+    packet->sequence_no = DEFAULT_VALUE;
+    packet->length = SUBSCRIBER_PAYLOAD_SIZE;
+    packet->technology = DEFAULT_VALUE;
+    packet->src_sub_no = DEFAULT_VALUE;
+    packet->end_packet = END_PACKET;
+}
+
+void update_subscriber_packet_v2(subscriber_packet_v2_t *packet, uint32_t client_id, SUBSCRIBER_PACKET_TYPE packet_type,
+                                 uint32_t sequence_no, uint8_t technology, uint32_t src_sub_no)
+{
+    packet->client_id = client_id;
+    packet->packet_type = packet_type;
+    packet->sequence_no = sequence_no;
+    packet->technology = technology;
+    packet->src_sub_no = src_sub_no;
+}
+
+void print_verification_database(verification_database_t verification_database[], size_t db_size)
 {
     char phone[PHONE_NUMBER_SIZE + 1]; // +1 for '\0'
     printf("Verification Database:\nSubscriber Number\tTechnology\tPaid\n");
-    for (int i = 0; i < db_size; i++)
+    for (size_t i = 0; i < db_size; i++)
     {
+        if (i == PRINT_DATABASE_MAX_ROWS)
+        {
+            printf("... %zu more subscribers\n", db_size - i);
+            break;
+        }
         memset(phone, DEFAULT_VALUE, PHONE_NUMBER_SIZE + 1);
         sprintf(phone, "%u", verification_database[i].src_sub_no);
         printf(
@@ -110,6 +509,15 @@ void print_verification_database(verification_database_t verification_database[]
             verification_database[i].technology, verification_database[i].paid);
     }
 }
+
+void print_database_memory_usage(size_t db_size, size_t table_bytes, size_t index_bytes)
+{
+    size_t total = table_bytes + index_bytes;
+    printf("Verification Database: %zu subscribers, %zu bytes table + %zu bytes index = %.2f MiB (%.1f bytes/subscriber)\n",
+           db_size, table_bytes, index_bytes, total / (1024.0 * 1024.0),
+           db_size ? (double)total / db_size : 0.0);
+}
+
 void print_subscriber_packet(subscriber_packet_t *subscriber_packet)
 {
     char phone[PHONE_NUMBER_SIZE + 1]; // +1 for '\0'
@@ -124,3 +532,32 @@ void print_subscriber_packet(subscriber_packet_t *subscriber_packet)
         subscriber_packet->technology,
         phone, phone + 3, phone + 6);
 }
+
+void log_subscriber_packet(subscriber_packet_t *subscriber_packet)
+{
+    LOG_EVENT(LOG_LEVEL_DEBUG,
+              "\nSubscriber Packet:\nclient_id=\t%llu\npacket_type=\t0x%04llX\nsegment_no=\t%llu\ntechnology=\t%llu\nsrc_sub_no=\t%llu\n",
+              subscriber_packet->client_id,
+              (uint16_t)subscriber_packet->packet_type,
+              subscriber_packet->segment_no,
+              subscriber_packet->technology,
+              subscriber_packet->src_sub_no);
+}
+
+void log_subscriber_packet_v2(const subscriber_packet_v2_t *packet)
+{
+    LOG_EVENT(LOG_LEVEL_DEBUG,
+              "\nSubscriber Packet v2:\nclient_id=\t%llu\npacket_type=\t0x%04llX\nsequence_no=\t%llu\ntechnology=\t%llu\nsrc_sub_no=\t%llu\n",
+              packet->client_id,
+              (uint16_t)packet->packet_type,
+              packet->sequence_no,
+              packet->technology,
+              packet->src_sub_no);
+}
+
+uint64_t monotonic_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -14,11 +14,10 @@
 #ifndef CUSTOMPROTOCOL_H /* include guard */
 #define CUSTOMPROTOCOL_H
 
-// Debug flag
-// #define DEBUGGING 0
-#define PRINT_DATABASE 0
-
-// library includes
+// library includes, _GNU_SOURCE for recvmmsg()/sendmmsg()
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -29,7 +28,13 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "asyncLog.h"
 
 // Port and Hostname:
 #define PORT 8080
@@ -39,6 +44,11 @@
 #define PACKET_GROUP_SIZE 5
 #define ACK_TIMER_WAIT_TIME_MS 3000
 #define ACK_TIMER_RETRY_COUNT 3
+// Adaptive ACK timer: ACK_TIMER_WAIT_TIME_MS until the first RTT sample, then
+// SRTT + 4 * RTTVAR, at least ACK_TIMER_MIN_WAIT_TIME_US. Retries double it with
+// jitter, never past ACK_TIMER_WAIT_TIME_MS, so it is never slower than the fixed timer.
+#define ACK_TIMER_MIN_WAIT_TIME_US 20000
+#define ACK_TIMER_JITTER_PERCENT 10
 #define DEFAULT_VALUE 0
 
 // Custom Protocol Primitives
@@ -68,12 +78,32 @@ typedef enum
     SUB_ACC_OK
 } SUBSCRIBER_PACKET_TYPE;
 
+// Packet validation results, the reason a datagram is dropped. Bad fields are
+// reported in this order when several are wrong.
+typedef enum
+{
+    PACKET_VALID = 0,
+    PACKET_BAD_LENGTH,         // Datagram size is not sizeof(subscriber_packet_t)
+    PACKET_BAD_START,
+    PACKET_BAD_TYPE,
+    PACKET_BAD_SEGMENT,
+    PACKET_BAD_PAYLOAD_LENGTH, // length field is not SUBSCRIBER_PAYLOAD_SIZE
+    PACKET_BAD_TECHNOLOGY,
+    PACKET_BAD_END,
+    PACKET_BAD_VERSION,        // Batch frame of a protocol version this side does not speak
+    PACKET_VALIDATION_COUNT
+} PACKET_VALIDATION;
+
 #define SUB_ACC_PER_MSG "Subscriber Access Permission Request"
 #define SUB_NOT_PAID_MSG "Subscriber Not Paid"
 #define SUB_NOT_EXIST_MSG "Subscriber Not Exist"
 #define SUB_ACC_OK_MSG "Subscriber Access Granted"
 
-#define VERIFICATION_DATABASE_SIZE 100
+// Smallest possible text row: "d\nd\nd\n", used to bound the header's entry count
+#define MIN_DATABASE_ROW_SIZE 6
+
+// Rows printed by print_verification_database(), the rest are summarized
+#define PRINT_DATABASE_MAX_ROWS 100
 
 // Custom Protocol Verification Database struct:
 typedef struct
@@ -94,10 +124,74 @@ typedef struct
     uint8_t technology;
     uint32_t src_sub_no;
     uint16_t end_packet;
-} __attribute__((packed)) subscriber_packet_t; // Size 15
+} __attribute__((packed)) subscriber_packet_t; // Size 14, with -fshort-enums
+_Static_assert(sizeof(subscriber_packet_t) == 14, "version 1 packets are 14 bytes");
+
+// Batch frames, protocol extension version 1: several requests in one datagram,
+// answered by one response frame with the same records. Told apart from a
+// subscriber_packet_t by BATCH_START_PACKET, so servers serve both. A client
+// first sends a frame without records (a probe); a server that speaks batch
+// frames answers it with its version and maximum records per frame, an older
+// server drops it, and the client keeps to single packets. Frames of another
+// version are dropped as PACKET_BAD_VERSION.
+#define BATCH_START_PACKET 0xFFFE
+#define BATCH_PROTOCOL_VERSION 1
+#define BATCH_FLAG_RESPONSE 0x01
+#define BATCH_MAX_FRAME_SIZE 1472 // UDP payload of a 1500-byte Ethernet MTU
+#define BATCH_HEADER_SIZE 8
+#define BATCH_MAX_RECORDS ((BATCH_MAX_FRAME_SIZE - BATCH_HEADER_SIZE - sizeof(uint16_t)) / sizeof(batch_record_t))
+
+// One request of a batch frame, status 0 in requests. In responses status is
+// the subscriber status - SUB_ACC_PER, or 0 for a record that was invalid.
+typedef struct
+{
+    uint32_t src_sub_no;
+    uint8_t client_id;
+    uint8_t segment_no;
+    uint8_t technology;
+    uint8_t status;
+} __attribute__((packed)) batch_record_t;
+
+// Batch frame, the end marker (END_PACKET) follows the last record:
+typedef struct
+{
+    uint16_t start_packet; // BATCH_START_PACKET
+    uint8_t version;       // BATCH_PROTOCOL_VERSION
+    uint8_t flags;         // BATCH_FLAG_RESPONSE on responses
+    uint16_t count;        // Records, 0 in a probe
+    uint16_t max_records;  // Probe response: records per frame the server takes, otherwise 0
+    batch_record_t records[BATCH_MAX_RECORDS];
+    uint16_t end_packet;   // Only here in a full frame
+} __attribute__((packed)) batch_frame_t;
+_Static_assert(sizeof(batch_record_t) == 8, "batch records are 8 bytes");
+_Static_assert(offsetof(batch_frame_t, records) == BATCH_HEADER_SIZE, "batch header is BATCH_HEADER_SIZE bytes");
+_Static_assert(sizeof(batch_frame_t) <= BATCH_MAX_FRAME_SIZE, "a batch frame must fit in BATCH_MAX_FRAME_SIZE");
+
+// Protocol version 2: a 32-bit client ID and a 32-bit sequence number in place
+// of the 8-bit client_id and the segment number below PACKET_GROUP_SIZE, so
+// neither the number of clients nor their requests in flight is bounded by the
+// packet. Told apart from a subscriber_packet_t and a batch frame by
+// START_PACKET_V2, so servers serve all three. The response echoes the request
+// with packet_type set to the subscriber status.
+#define START_PACKET_V2 0xFFFD
+#define SUBSCRIBER_PROTOCOL_VERSION 2
+
+typedef struct
+{
+    uint16_t start_packet; // START_PACKET_V2
+    uint8_t version;       // SUBSCRIBER_PROTOCOL_VERSION
+    SUBSCRIBER_PACKET_TYPE packet_type;
+    uint32_t client_id;
+    uint32_t sequence_no;  // Chosen by the client, unique among its requests in flight
+    uint8_t length;
+    uint8_t technology;
+    uint32_t src_sub_no;
+    uint16_t end_packet;
+} __attribute__((packed)) subscriber_packet_v2_t; // Size 21
+_Static_assert(sizeof(subscriber_packet_v2_t) == 21, "version 2 packets are 21 bytes");
 
 /**
- * @brief Error function
+ * @brief Error function, flushes pending log records before exiting
  *
  * @param msg Error message
  */
@@ -111,20 +205,168 @@ void error(const char *msg);
  * @return SUBSCRIBER_PACKET_TYPE
  */
 SUBSCRIBER_PACKET_TYPE verify_subscriber(
-    verification_database_t verification_database[], uint8_t db_size, subscriber_packet_t *subscriber_packet);
+    verification_database_t verification_database[], size_t db_size, subscriber_packet_t *subscriber_packet);
+
+/**
+ * @brief Read in the verification database from file. The file is memory
+ *      mapped and parsed in place, the database is allocated on the heap and
+ *      sized from the entry count on the first line.
+ *
+ * @param verification_database Set to the allocated verification database, free() when done.
+ * @param filename string for the filename or path to the file.
+ * @return size_t database size.
+ */
+size_t read_verification_database(verification_database_t **verification_database, char *filename);
+
+/**
+ * @brief Like read_verification_database(), but for reloading a running
+ *      server: a missing or malformed file is reported on stderr instead of
+ *      exiting, and the rows must match the entry count, so a file still
+ *      being written is rejected rather than loaded short.
+ *
+ * @param verification_database set to the allocated database, free() when done
+ * @param filename text database
+ * @param db_size set to the database size
+ * @return true if read
+ */
+bool try_read_verification_database(verification_database_t **verification_database, const char *filename,
+                                    size_t *db_size);
+
+/**
+ * @brief Validate a received datagram without branching per field or logging.
+ *
+ * @param packet receive buffer, at least sizeof(subscriber_packet_t) bytes even
+ *      when the datagram was shorter
+ * @param packet_size datagram size as received (with MSG_TRUNC, so oversized
+ *      datagrams report their real size)
+ * @return PACKET_VALIDATION PACKET_VALID, or the first bad field
+ */
+PACKET_VALIDATION check_subscriber_packet(const subscriber_packet_t *packet, size_t packet_size);
 
-// Validating that packet is correct
+// Short name of a validation result, e.g. "bad_start", for counters:
+const char *packet_validation_name(PACKET_VALIDATION result);
+
+// Log why a packet failed check_subscriber_packet(), at warning level:
+void log_invalid_subscriber_packet(const subscriber_packet_t *packet, size_t packet_size, PACKET_VALIDATION result);
+
+// Validating that packet is correct, logging the reason if not
 bool is_valid_subscriber_packet(subscriber_packet_t *packet);
 
+// Frame size with count records:
+static inline size_t batch_frame_size(unsigned int count)
+{
+    return BATCH_HEADER_SIZE + count * sizeof(batch_record_t) + sizeof(uint16_t);
+}
+
+/**
+ * @brief Whether a datagram is a batch frame rather than a subscriber packet.
+ *
+ * @param datagram received datagram, at least sizeof(uint16_t) bytes of buffer
+ * @param datagram_size datagram size as received
+ * @return true if it starts with BATCH_START_PACKET
+ */
+static inline bool is_batch_frame(const void *datagram, size_t datagram_size)
+{
+    uint16_t start;
+
+    memcpy(&start, datagram, sizeof(start));
+    return datagram_size >= sizeof(start) && start == BATCH_START_PACKET;
+}
+
+/**
+ * @brief Validate a received batch frame's header, size and end marker. Its
+ *      records are checked one by one with check_subscriber_packet() on the
+ *      packets batch_frame_packet() makes of them.
+ *
+ * @param frame receive buffer of BATCH_MAX_FRAME_SIZE bytes
+ * @param frame_size datagram size as received
+ * @param response whether a response frame is expected
+ * @return PACKET_VALIDATION PACKET_VALID, or the first bad field
+ */
+PACKET_VALIDATION check_batch_frame(const batch_frame_t *frame, size_t frame_size, bool response);
+
+// Log why a frame failed check_batch_frame(), at warning level:
+void log_invalid_batch_frame(const batch_frame_t *frame, size_t frame_size, PACKET_VALIDATION result);
+
+// Validating that a batch frame is correct, logging the reason if not
+bool is_valid_batch_frame(const batch_frame_t *frame, size_t frame_size, bool response);
+
+// Empty frame, a probe until records are added:
+void reset_batch_frame(batch_frame_t *frame);
+
+// Append a request, or a response when the packet carries a status. The frame must have room.
+void add_batch_record(batch_frame_t *frame, const subscriber_packet_t *packet);
+
+// Write the end marker after the last record, returning the frame size to send:
+size_t finish_batch_frame(batch_frame_t *frame);
+
+// A record as a subscriber packet, packet_type SUB_ACC_PER + its status:
+void batch_frame_packet(const batch_frame_t *frame, unsigned int record, subscriber_packet_t *packet);
+
+// Responses in a received datagram: a subscriber packet, or the answered records
+// of a batch response frame. Returns how many, 0 for a datagram that is neither:
+unsigned int batch_frame_responses(const batch_frame_t *datagram, ssize_t size,
+                                   subscriber_packet_t responses[BATCH_MAX_RECORDS]);
+
+/**
+ * @brief Whether a datagram is a version 2 packet rather than a subscriber
+ *      packet or a batch frame.
+ *
+ * @param datagram received datagram, at least sizeof(uint16_t) bytes of buffer
+ * @param datagram_size datagram size as received
+ * @return true if it starts with START_PACKET_V2
+ */
+static inline bool is_subscriber_packet_v2(const void *datagram, size_t datagram_size)
+{
+    uint16_t start;
+
+    memcpy(&start, datagram, sizeof(start));
+    return datagram_size >= sizeof(start) && start == START_PACKET_V2;
+}
+
+/**
+ * @brief Validate a received version 2 packet.
+ *
+ * @param packet receive buffer, at least sizeof(subscriber_packet_v2_t) bytes
+ *      even when the datagram was shorter
+ * @param packet_size datagram size as received
+ * @return PACKET_VALIDATION PACKET_VALID, or the first bad field
+ */
+PACKET_VALIDATION check_subscriber_packet_v2(const subscriber_packet_v2_t *packet, size_t packet_size);
+
+// Log why a packet failed check_subscriber_packet_v2(), at warning level:
+void log_invalid_subscriber_packet_v2(const subscriber_packet_v2_t *packet, size_t packet_size, PACKET_VALIDATION result);
+
+// Validating that a version 2 packet is correct, logging the reason if not
+bool is_valid_subscriber_packet_v2(const subscriber_packet_v2_t *packet);
+
+// The subscriber packet a server validates and looks up for a version 2 request.
+// Its client_id and segment_no are only derived from the wider fields.
+void subscriber_packet_from_v2(const subscriber_packet_v2_t *packet_v2, subscriber_packet_t *packet);
+
 // Packet reset to default values. Clear payload array if it exists.
 void reset_subscriber_packet(subscriber_packet_t *packet);
 
 // Packet setters. Note: Should call reset() before setting values.
 void update_subscriber_packet(subscriber_packet_t *packet, uint8_t client_id, SUBSCRIBER_PACKET_TYPE packet_type, uint8_t segment_no, uint8_t technology, uint32_t src_sub_no);
 
+// Version 2 packet reset to default values, and its setters. Note: Should call reset() before setting values.
+void reset_subscriber_packet_v2(subscriber_packet_v2_t *packet);
+void update_subscriber_packet_v2(subscriber_packet_v2_t *packet, uint32_t client_id, SUBSCRIBER_PACKET_TYPE packet_type,
+                                 uint32_t sequence_no, uint8_t technology, uint32_t src_sub_no);
+
 // Print Verification Database:
-void print_verification_database(verification_database_t verification_database[], uint8_t db_size);
+void print_verification_database(verification_database_t verification_database[], size_t db_size);
+// Print database memory use, total and per subscriber:
+void print_database_memory_usage(size_t db_size, size_t table_bytes, size_t index_bytes);
 // Print Subscriber Packet:
 void print_subscriber_packet(subscriber_packet_t *subscriber_packet);
+// Log Subscriber Packet fields at debug level, without formatting on the calling thread:
+void log_subscriber_packet(subscriber_packet_t *subscriber_packet);
+// Log version 2 packet fields at debug level:
+void log_subscriber_packet_v2(const subscriber_packet_v2_t *packet);
+
+// Monotonic clock in nanoseconds, for timers and benchmarks:
+uint64_t monotonic_time_ns(void);
 
 #endif
\ No newline at end of file
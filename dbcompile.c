@@ -0,0 +1,65 @@
+/**
+ * @file dbcompile.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Offline compiler from the text verification database to the binary
+ *      subscriber image that myserver memory-maps.
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "customProtocol.h"
+#include "subscriberIndex.h"
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv input text database and output image, or -c and an image to check
+ * @return int 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    subscriber_index_t subscriber_index;
+
+    // Check an existing image's checksum:
+    if (argc == 3 && strcmp(argv[1], "-c") == 0)
+    {
+        subscriber_index_map(&subscriber_index, argv[2]);
+        bool ok = subscriber_index_verify_image(&subscriber_index);
+        printf("%s: %llu subscribers, %llu slots, checksum %s\n", argv[2],
+               (unsigned long long)subscriber_index.count,
+               (unsigned long long)subscriber_index.capacity, ok ? "OK" : "MISMATCH");
+        subscriber_index_free(&subscriber_index);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Checking if usage is correct
+    if (argc != 3)
+    {
+        printf("Usage: verification_database.txt output.img\n       -c image.img\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Compile the text database:
+    verification_database_t *verification_database = NULL;
+    uint64_t start = monotonic_time_ns();
+    size_t db_size = read_verification_database(&verification_database, argv[1]);
+    subscriber_index_build(&subscriber_index, verification_database, db_size);
+    subscriber_index_save(&subscriber_index, argv[2]);
+    uint64_t elapsed_ns = monotonic_time_ns() - start;
+
+    printf("Compiled %zu rows (%llu distinct subscribers) into %s: %zu bytes in %.1f ms\n",
+           db_size, (unsigned long long)subscriber_index.count, argv[2],
+           sizeof(subscriber_image_header_t) + subscriber_index_memory_bytes(&subscriber_index),
+           elapsed_ns / 1e6);
+
+    // Housekeeping:
+    subscriber_index_free(&subscriber_index);
+    free(verification_database);
+    return EXIT_SUCCESS;
+}
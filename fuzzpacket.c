@@ -0,0 +1,265 @@
+/**
+ * @file fuzzpacket.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Fuzz harness for the server's packet parser. Builds as a libFuzzer target
+ *      (make fuzz, -DLIBFUZZER), or as a standalone program that runs the given
+ *      inputs (for AFL: afl-fuzz -i dir -o dir ./fuzzpacket @@) or mutates
+ *      valid packets itself (-n iterations).
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "customProtocol.h"
+#include "benchData.h"
+#include "subscriberIndex.h"
+#include "packetBatch.h"
+
+// Largest input read by the standalone driver, bigger than any valid datagram
+#define FUZZ_MAX_INPUT 4096
+// Packets per batch when the input is also run as a receive batch
+#define FUZZ_MAX_BATCH 64
+
+/**
+ * @brief Field-by-field validation in the original if/else order, the oracle
+ *      for the branch-light check_subscriber_packet().
+ *
+ * @param packet receive buffer
+ * @param packet_size datagram size
+ * @return PACKET_VALIDATION expected result
+ */
+static PACKET_VALIDATION reference_check(const subscriber_packet_t *packet, size_t packet_size)
+{
+    if (packet_size != sizeof(subscriber_packet_t))
+        return PACKET_BAD_LENGTH;
+    if (packet->start_packet != START_PACKET)
+        return PACKET_BAD_START;
+    if (packet->packet_type < SUB_ACC_PER || packet->packet_type > SUB_ACC_OK)
+        return PACKET_BAD_TYPE;
+    if (packet->segment_no >= PACKET_GROUP_SIZE)
+        return PACKET_BAD_SEGMENT;
+    if (packet->length != SUBSCRIBER_PAYLOAD_SIZE)
+        return PACKET_BAD_PAYLOAD_LENGTH;
+    if (packet->technology < SUB_2G || packet->technology > SUB_5G)
+        return PACKET_BAD_TECHNOLOGY;
+    if (packet->end_packet != END_PACKET)
+        return PACKET_BAD_END;
+    return PACKET_VALID;
+}
+
+/**
+ * @brief Index over the sample database, built on first use.
+ *
+ * @return const subscriber_index_t* index
+ */
+static const subscriber_index_t *fuzz_index(void)
+{
+    static subscriber_index_t subscriber_index;
+    static bool built = false;
+    static verification_database_t verification_database[] = {
+        {4085546805U, SUB_4G, true},
+        {4086668821U, SUB_3G, false},
+        {4086808821U, SUB_2G, true},
+    };
+
+    if (!built)
+    {
+        subscriber_index_build(&subscriber_index, verification_database,
+                               sizeof(verification_database) / sizeof(verification_database[0]));
+        built = true;
+    }
+    return &subscriber_index;
+}
+
+/**
+ * @brief Run the input as a receive batch of back-to-back packets through every
+ *      batch validation implementation and the batch lookup, and compare them
+ *      with the one-packet functions. Packets whose client_id is below
+ *      sizeof(subscriber_packet_t) take it as their datagram size, so the
+ *      batch also has bad sizes.
+ *
+ * @param data packets
+ * @param size input size
+ */
+static void fuzz_batch(const uint8_t *data, size_t size)
+{
+    subscriber_packet_t *packets;
+    uint32_t packet_sizes[FUZZ_MAX_BATCH];
+    PACKET_VALIDATION results[FUZZ_MAX_BATCH];
+    SUBSCRIBER_PACKET_TYPE statuses[FUZZ_MAX_BATCH];
+    unsigned int n = size / sizeof(subscriber_packet_t);
+
+    if (n > FUZZ_MAX_BATCH)
+        n = FUZZ_MAX_BATCH;
+    // Exactly n packets, so sanitizers catch SIMD loads past the batch
+    if ((packets = malloc(n ? n * sizeof(subscriber_packet_t) : 1)) == NULL)
+        error("ERROR: Allocating fuzz batch");
+    memcpy(packets, data, n * sizeof(subscriber_packet_t));
+    for (unsigned int i = 0; i < n; i++)
+        packet_sizes[i] = packets[i].client_id < sizeof(subscriber_packet_t) ? packets[i].client_id : sizeof(subscriber_packet_t);
+
+    for (unsigned int impl = 0; impl < PACKET_BATCH_IMPL_COUNT; impl++)
+    {
+        if (!packet_batch_supported(impl))
+            continue;
+        unsigned int valid = check_subscriber_packets_with(impl, packets, packet_sizes, results, n), expected_valid = 0;
+        for (unsigned int i = 0; i < n; i++)
+        {
+            PACKET_VALIDATION expected = check_subscriber_packet(&packets[i], packet_sizes[i]);
+            expected_valid += expected == PACKET_VALID;
+            if (results[i] != expected)
+            {
+                fprintf(stderr, "ERROR: %s batch returned %s for packet %u, expected %s\n", packet_batch_impl_name(impl),
+                        packet_validation_name(results[i]), i, packet_validation_name(expected));
+                abort();
+            }
+        }
+        if (valid != expected_valid)
+        {
+            fprintf(stderr, "ERROR: %s batch counted %u valid, expected %u\n", packet_batch_impl_name(impl), valid, expected_valid);
+            abort();
+        }
+    }
+
+    subscriber_index_lookup_batch(fuzz_index(), packets, statuses, n);
+    for (unsigned int i = 0; i < n; i++)
+        if (results[i] == PACKET_VALID && statuses[i] != verify_subscriber_indexed(fuzz_index(), &packets[i]))
+        {
+            fprintf(stderr, "ERROR: Batch lookup disagrees for packet %u\n", i);
+            abort();
+        }
+    free(packets);
+}
+
+/**
+ * @brief Run one input through the server's request path: receive into a
+ *      packet-sized buffer, validate, look up, build the response. Then run
+ *      it as a receive batch.
+ *
+ * @param data datagram
+ * @param size datagram size
+ * @return int 0, aborts if the parser and the oracle disagree
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    subscriber_packet_t packet;
+    PACKET_VALIDATION result, expected;
+
+    // Like recvfrom() with MSG_TRUNC: the buffer holds at most one packet, the size is the datagram's
+    memset(&packet, DEFAULT_VALUE, sizeof(packet));
+    memcpy(&packet, data, size < sizeof(packet) ? size : sizeof(packet));
+
+    result = check_subscriber_packet(&packet, size);
+    expected = reference_check(&packet, size);
+    if (result != expected || result >= PACKET_VALIDATION_COUNT)
+    {
+        fprintf(stderr, "ERROR: check_subscriber_packet() returned %s, expected %s\n",
+                packet_validation_name(result), packet_validation_name(expected));
+        abort();
+    }
+    log_invalid_subscriber_packet(&packet, size, result);
+    fuzz_batch(data, size);
+    if (result != PACKET_VALID)
+        return 0;
+
+    // A valid request must give a valid response
+    packet.packet_type = verify_subscriber_indexed(fuzz_index(), &packet);
+    if (check_subscriber_packet(&packet, sizeof(packet)) != PACKET_VALID)
+    {
+        fprintf(stderr, "ERROR: Invalid response to a valid request\n");
+        abort();
+    }
+    return 0;
+}
+
+#ifndef LIBFUZZER
+/**
+ * @brief Run one file, or stdin when filename is NULL.
+ *
+ * @param filename input file
+ */
+static void run_file(const char *filename)
+{
+    static uint8_t data[FUZZ_MAX_INPUT];
+    FILE *fp = filename ? fopen(filename, "rb") : stdin;
+    size_t size;
+
+    if (fp == NULL)
+        error("ERROR: Opening fuzz input");
+    size = fread(data, 1, sizeof(data), fp);
+    if (filename)
+        fclose(fp);
+    LLVMFuzzerTestOneInput(data, size);
+}
+
+/**
+ * @brief Mutate valid packets: random sizes, and a few random bytes or
+ *      boundary values per packet.
+ *
+ * @param iterations inputs to run
+ */
+static void run_mutations(uint64_t iterations)
+{
+    uint8_t data[8 * sizeof(subscriber_packet_t)];
+    uint64_t results[PACKET_VALIDATION_COUNT] = {0};
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        subscriber_packet_t valid;
+        size_t size = sizeof(valid);
+        reset_subscriber_packet(&valid);
+        update_subscriber_packet(&valid, bench_random(), SUB_ACC_PER + bench_random() % 4, bench_random() % PACKET_GROUP_SIZE,
+                                 SUB_2G + bench_random() % 4, (uint32_t)bench_random());
+        // A run of valid packets, the first one is also the single-packet input
+        for (size_t offset = 0; offset + sizeof(valid) <= sizeof(data); offset += sizeof(valid))
+        {
+            valid.client_id = sizeof(valid) + bench_random() % (MAX_CLIENT_ID - sizeof(valid));
+            memcpy(data + offset, &valid, sizeof(valid));
+        }
+
+        unsigned int mutations = bench_random() % 8;
+        for (unsigned int m = 0; m < mutations; m++)
+        {
+            static const uint8_t boundaries[] = {0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x7F, 0x80, 0xF8, 0xFB, 0xFC, 0xFE, 0xFF};
+            uint8_t value = bench_random() & 1 ? (uint8_t)bench_random() : boundaries[bench_random() % sizeof(boundaries)];
+            data[bench_random() % sizeof(data)] = value;
+        }
+        if (bench_random() % 8 == 0)
+            size = bench_random() % (2 * sizeof(valid) + 1);
+        else if (bench_random() % 2 == 0)
+            size = sizeof(data); // Batch of 8 packets
+
+        LLVMFuzzerTestOneInput(data, size);
+        subscriber_packet_t packet;
+        memcpy(&packet, data, sizeof(packet));
+        results[check_subscriber_packet(&packet, size)]++;
+    }
+    printf("%llu inputs, no mismatches:", (unsigned long long)iterations);
+    for (unsigned int r = 0; r < PACKET_VALIDATION_COUNT; r++)
+        printf(" %s %llu", packet_validation_name(r), (unsigned long long)results[r]);
+    printf("\n");
+}
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv input files, "-n iterations" to mutate, nothing to read stdin
+ * @return int 0 if every input passed
+ */
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "-n") == 0)
+        run_mutations(strtoull(argv[2], NULL, 10));
+    else if (argc == 1)
+        run_file(NULL);
+    else
+        for (int i = 1; i < argc; i++)
+            run_file(argv[i]);
+    return EXIT_SUCCESS;
+}
+#endif
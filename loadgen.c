@@ -0,0 +1,472 @@
+/**
+ * @file loadgen.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Load generator: sends Access Permission requests at a fixed rate (open
+ *      loop) or with a fixed number in flight (closed loop), mixing subscribers
+ *      that are granted, not paid and not in the database, and reports
+ *      throughput, loss and latency percentiles.
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "customProtocol.h"
+#include "benchData.h"
+#include "subscriberIndex.h"
+#include "rttEstimator.h"
+#include <poll.h>
+
+// Each socket can have one request per (client_id, segment_no) in flight
+#define LOADGEN_KEYS ((MAX_CLIENT_ID + 1) * PACKET_GROUP_SIZE)
+#define LOADGEN_MAX_SOCKETS 64
+#define LOADGEN_DEFAULT_SECONDS 10
+#define LOADGEN_DEFAULT_CONCURRENCY 64
+#define LOADGEN_DEFAULT_TIMEOUT_MS 1000
+#define LOADGEN_EXPIRY_SCAN_NS 10000000ULL
+#define LOADGEN_RECV_BATCH 64
+
+// Request kinds, drawn by the configured mix:
+typedef enum
+{
+    LOADGEN_HIT,      // In the database and paid
+    LOADGEN_NOT_PAID, // In the database, not paid
+    LOADGEN_NOT_EXIST // Not in the database
+} LOADGEN_KIND;
+
+// One in-flight request:
+typedef struct
+{
+    uint64_t start_ns; // Send time, or scheduled send time in open loop
+    uint32_t src_sub_no;
+    uint8_t technology;
+    SUBSCRIBER_PACKET_TYPE expected;
+    bool in_flight;
+} loadgen_request_t;
+
+// One socket and its request table:
+typedef struct
+{
+    int sock;
+    loadgen_request_t requests[LOADGEN_KEYS];
+    uint16_t free_keys[LOADGEN_KEYS]; // Stack of keys not in flight
+    unsigned int free_count;
+} loadgen_socket_t;
+
+// Subscribers to draw requests from:
+typedef struct
+{
+    subscriber_slot_t *paid;
+    size_t paid_count;
+    subscriber_slot_t *not_paid;
+    size_t not_paid_count;
+} loadgen_population_t;
+
+// Run counters:
+typedef struct
+{
+    uint64_t sent;
+    uint64_t received;
+    uint64_t lost;      // No response within the timeout
+    uint64_t late;      // Response after the request was counted lost
+    uint64_t wrong;     // Response status differs from the database
+    uint64_t skipped;   // Open loop: no free key when a send was due
+    latency_histogram_t latency;
+} loadgen_stats_t;
+
+/**
+ * @brief Split the database's subscribers into paid and not-paid lists.
+ *
+ * @param index index over the database
+ * @param population lists to fill
+ */
+static void build_population(const subscriber_index_t *index, loadgen_population_t *population)
+{
+    population->paid = malloc((index->count + 1) * sizeof(subscriber_slot_t));
+    population->not_paid = malloc((index->count + 1) * sizeof(subscriber_slot_t));
+    population->paid_count = population->not_paid_count = 0;
+    if (population->paid == NULL || population->not_paid == NULL)
+        error("ERROR: Allocating population");
+    for (uint64_t i = 0; i < index->capacity; i++)
+    {
+        const subscriber_slot_t *slot = &index->slots[i];
+        if (slot->technology == 0)
+            continue;
+        if (slot->paid)
+            population->paid[population->paid_count++] = *slot;
+        else
+            population->not_paid[population->not_paid_count++] = *slot;
+    }
+}
+
+/**
+ * @brief Draw the next request's subscriber by the mix percentages. Falls
+ *      back to a non-existent subscriber when the database has none of a kind.
+ *
+ * @param index index, to make sure "not exist" subscribers really don't
+ * @param population paid and not-paid subscribers
+ * @param mix percentages of hits and not-paid, the rest don't exist
+ * @param request filled with the subscriber and the expected status
+ */
+static void draw_request(const subscriber_index_t *index, const loadgen_population_t *population,
+                         const unsigned int mix[2], loadgen_request_t *request)
+{
+    unsigned int roll = bench_random() % 100;
+    LOADGEN_KIND kind = roll < mix[0] ? LOADGEN_HIT : roll < mix[0] + mix[1] ? LOADGEN_NOT_PAID : LOADGEN_NOT_EXIST;
+
+    if (kind == LOADGEN_HIT && population->paid_count > 0)
+    {
+        const subscriber_slot_t *slot = &population->paid[bench_random() % population->paid_count];
+        request->src_sub_no = slot->src_sub_no;
+        request->technology = slot->technology;
+        request->expected = SUB_ACC_OK;
+        return;
+    }
+    if (kind == LOADGEN_NOT_PAID && population->not_paid_count > 0)
+    {
+        const subscriber_slot_t *slot = &population->not_paid[bench_random() % population->not_paid_count];
+        request->src_sub_no = slot->src_sub_no;
+        request->technology = slot->technology;
+        request->expected = SUB_NOT_PAID;
+        return;
+    }
+    do
+    {
+        request->src_sub_no = bench_random_subscriber();
+        request->technology = SUB_2G + bench_random() % 4;
+    } while (subscriber_index_lookup(index, request->src_sub_no, request->technology) != SUB_NOT_EXIST);
+    request->expected = SUB_NOT_EXIST;
+}
+
+/**
+ * @brief Send one request on a socket with a free key.
+ *
+ * @param lsock socket to send on
+ * @param server server address
+ * @param index index over the database
+ * @param population subscribers to draw from
+ * @param mix request mix
+ * @param start_ns latency start time
+ * @param stats run counters
+ * @return true if sent, false if the socket has no free key
+ */
+static bool send_request(loadgen_socket_t *lsock, const struct sockaddr_in *server, const subscriber_index_t *index,
+                         const loadgen_population_t *population, const unsigned int mix[2], uint64_t start_ns,
+                         loadgen_stats_t *stats)
+{
+    subscriber_packet_t packet;
+    unsigned int key;
+    loadgen_request_t *request;
+
+    if (lsock->free_count == 0)
+        return false;
+    key = lsock->free_keys[--lsock->free_count];
+    request = &lsock->requests[key];
+    draw_request(index, population, mix, request);
+    request->start_ns = start_ns;
+    request->in_flight = true;
+
+    reset_subscriber_packet(&packet);
+    update_subscriber_packet(&packet, key / PACKET_GROUP_SIZE, SUB_ACC_PER, key % PACKET_GROUP_SIZE,
+                             request->technology, request->src_sub_no);
+    if (sendto(lsock->sock, &packet, sizeof(packet), 0, (const struct sockaddr *)server, sizeof(*server)) < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+            error("ERROR: sendto");
+    }
+    stats->sent++;
+    return true;
+}
+
+/**
+ * @brief Read every queued response on a socket.
+ *
+ * @param lsock socket to read
+ * @param stats run counters
+ * @return unsigned int requests completed
+ */
+static unsigned int receive_responses(loadgen_socket_t *lsock, loadgen_stats_t *stats)
+{
+    subscriber_packet_t packets[LOADGEN_RECV_BATCH];
+    struct iovec iovecs[LOADGEN_RECV_BATCH];
+    struct mmsghdr msgs[LOADGEN_RECV_BATCH];
+    unsigned int completed = 0;
+    int n;
+
+    memset(msgs, DEFAULT_VALUE, sizeof(msgs));
+    for (int i = 0; i < LOADGEN_RECV_BATCH; i++)
+    {
+        iovecs[i].iov_base = &packets[i];
+        iovecs[i].iov_len = sizeof(packets[i]);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while ((n = recvmmsg(lsock->sock, msgs, LOADGEN_RECV_BATCH, MSG_DONTWAIT, NULL)) > 0)
+    {
+        uint64_t now = monotonic_time_ns();
+        for (int i = 0; i < n; i++)
+        {
+            subscriber_packet_t *response = &packets[i];
+            if (msgs[i].msg_len != sizeof(*response) || response->segment_no >= PACKET_GROUP_SIZE)
+                continue;
+            unsigned int key = response->client_id * PACKET_GROUP_SIZE + response->segment_no;
+            loadgen_request_t *request = &lsock->requests[key];
+            if (!request->in_flight || request->src_sub_no != response->src_sub_no ||
+                request->technology != response->technology)
+            {
+                stats->late++;
+                continue;
+            }
+            if (response->packet_type != request->expected)
+                stats->wrong++;
+            latency_histogram_record(&stats->latency, now - request->start_ns);
+            request->in_flight = false;
+            lsock->free_keys[lsock->free_count++] = key;
+            stats->received++;
+            completed++;
+        }
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        error("ERROR: recvmmsg");
+    return completed;
+}
+
+/**
+ * @brief Count requests outstanding for longer than the timeout as lost and
+ *      free their keys.
+ *
+ * @param lsock socket to scan
+ * @param now_ns current time
+ * @param timeout_ns loss timeout
+ * @param stats run counters
+ * @return unsigned int requests expired
+ */
+static unsigned int expire_requests(loadgen_socket_t *lsock, uint64_t now_ns, uint64_t timeout_ns, loadgen_stats_t *stats)
+{
+    unsigned int expired = 0;
+
+    for (unsigned int key = 0; key < LOADGEN_KEYS; key++)
+    {
+        loadgen_request_t *request = &lsock->requests[key];
+        if (request->in_flight && now_ns - request->start_ns > timeout_ns)
+        {
+            request->in_flight = false;
+            lsock->free_keys[lsock->free_count++] = key;
+            stats->lost++;
+            expired++;
+        }
+    }
+    return expired;
+}
+
+/**
+ * @brief Print usage and exit.
+ *
+ * @param program argv[0]
+ */
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s -d verification_database [-r rate | -c concurrency] [-t seconds]\n"
+            "       [-m hit%%:not_paid%%] [-s sockets] [-T timeout_ms] [-S seed] [host [port]]\n"
+            "  -r  open loop: send rate requests/s regardless of responses\n"
+            "  -c  closed loop: keep concurrency requests in flight (default %d)\n"
+            "  -m  request mix, the rest are subscribers not in the database (default 60:20)\n",
+            program, LOADGEN_DEFAULT_CONCURRENCY);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return int 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    char *database = NULL, *host = HOSTNAME;
+    int port = PORT, opt;
+    double rate = 0, seconds = LOADGEN_DEFAULT_SECONDS;
+    unsigned int concurrency = LOADGEN_DEFAULT_CONCURRENCY, socket_count = 1;
+    unsigned int mix[2] = {60, 20};
+    uint64_t timeout_ns = LOADGEN_DEFAULT_TIMEOUT_MS * 1000000ULL;
+
+    while ((opt = getopt(argc, argv, "d:r:c:t:m:s:T:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            database = optarg;
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'c':
+            concurrency = atoi(optarg);
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%u:%u", &mix[0], &mix[1]) != 2 || mix[0] + mix[1] > 100)
+                usage(argv[0]);
+            break;
+        case 's':
+            socket_count = atoi(optarg);
+            break;
+        case 'T':
+            timeout_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+            break;
+        case 'S':
+            bench_random_seed(strtoull(optarg, NULL, 10));
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (database == NULL || argc - optind > 2 || seconds <= 0 || rate < 0 ||
+        socket_count < 1 || socket_count > LOADGEN_MAX_SOCKETS ||
+        concurrency < 1 || concurrency > socket_count * LOADGEN_KEYS)
+        usage(argv[0]);
+    if (argc - optind >= 1)
+        host = argv[optind];
+    if (argc - optind == 2)
+        port = atoi(argv[optind + 1]);
+
+    // Subscribers to draw from, text database or compiled image:
+    subscriber_index_t subscriber_index;
+    verification_database_t *verification_database = NULL;
+    loadgen_population_t population;
+    if (is_subscriber_image(database))
+        subscriber_index_map(&subscriber_index, database);
+    else
+    {
+        size_t db_size = read_verification_database(&verification_database, database);
+        subscriber_index_build(&subscriber_index, verification_database, db_size);
+    }
+    build_population(&subscriber_index, &population);
+
+    // Server address:
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons(port)};
+    struct hostent *hp = gethostbyname(host);
+    if (hp == NULL)
+        error("ERROR: Unknown host");
+    memcpy(&server.sin_addr, hp->h_addr, hp->h_length);
+
+    // Sockets, each with every key free:
+    loadgen_socket_t *lsocks = calloc(socket_count, sizeof(loadgen_socket_t));
+    struct pollfd *pfds = calloc(socket_count, sizeof(struct pollfd));
+    loadgen_stats_t *stats = calloc(1, sizeof(loadgen_stats_t));
+    if (lsocks == NULL || pfds == NULL || stats == NULL)
+        error("ERROR: Allocating sockets");
+    for (unsigned int s = 0; s < socket_count; s++)
+    {
+        int buffer = 1 << 22;
+        if ((lsocks[s].sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+            error("ERROR: Opening socket");
+        setsockopt(lsocks[s].sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        setsockopt(lsocks[s].sock, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        for (unsigned int key = 0; key < LOADGEN_KEYS; key++)
+            lsocks[s].free_keys[lsocks[s].free_count++] = LOADGEN_KEYS - 1 - key;
+        pfds[s].fd = lsocks[s].sock;
+        pfds[s].events = POLLIN;
+    }
+    latency_histogram_init(&stats->latency);
+
+    printf("%s loop against %s:%d for %.1f s: ", rate > 0 ? "Open" : "Closed", host, port, seconds);
+    if (rate > 0)
+        printf("%.0f requests/s", rate);
+    else
+        printf("%u in flight", concurrency);
+    printf(", mix %u%% granted / %u%% not paid / %u%% not exist, %zu paid + %zu not paid subscribers\n",
+           mix[0], mix[1], 100 - mix[0] - mix[1], population.paid_count, population.not_paid_count);
+
+    uint64_t start = monotonic_time_ns(), now = start, end = start + (uint64_t)(seconds * 1e9);
+    uint64_t next_scan = start + LOADGEN_EXPIRY_SCAN_NS, scheduled = 0, in_flight = 0;
+    double interval_ns = rate > 0 ? 1e9 / rate : 0;
+    unsigned int next_socket = 0;
+
+    // Send until the end of the run, then wait out the stragglers up to the timeout:
+    while (now < end || (in_flight > 0 && now < end + timeout_ns))
+    {
+        if (now < end)
+        {
+            if (rate > 0)
+            {
+                // Open loop: every send that is due, latency counted from its scheduled time
+                while (scheduled < (uint64_t)((now - start) / interval_ns) + 1)
+                {
+                    uint64_t due = start + (uint64_t)(scheduled * interval_ns);
+                    scheduled++;
+                    if (send_request(&lsocks[next_socket], &server, &subscriber_index, &population, mix, due, stats))
+                        in_flight++;
+                    else
+                        stats->skipped++;
+                    next_socket = (next_socket + 1) % socket_count;
+                }
+            }
+            else
+            {
+                // Closed loop: top up to the concurrency
+                while (in_flight < concurrency)
+                {
+                    if (send_request(&lsocks[next_socket], &server, &subscriber_index, &population, mix,
+                                     monotonic_time_ns(), stats))
+                        in_flight++;
+                    next_socket = (next_socket + 1) % socket_count;
+                }
+            }
+        }
+
+        // Wait for responses, at most until the next open-loop send
+        int wait_ms = 1;
+        if (rate > 0 && now < end)
+        {
+            uint64_t due = start + (uint64_t)(scheduled * interval_ns), now_ns = monotonic_time_ns();
+            wait_ms = due > now_ns ? (int)((due - now_ns) / 1000000) : 0;
+        }
+        if (poll(pfds, socket_count, wait_ms) < 0 && errno != EINTR)
+            error("ERROR: poll");
+        for (unsigned int s = 0; s < socket_count; s++)
+            if (pfds[s].revents & POLLIN)
+                in_flight -= receive_responses(&lsocks[s], stats);
+
+        now = monotonic_time_ns();
+        if (now >= next_scan)
+        {
+            for (unsigned int s = 0; s < socket_count; s++)
+                in_flight -= expire_requests(&lsocks[s], now, timeout_ns, stats);
+            next_scan = now + LOADGEN_EXPIRY_SCAN_NS;
+        }
+    }
+    for (unsigned int s = 0; s < socket_count; s++)
+        in_flight -= expire_requests(&lsocks[s], UINT64_MAX, 0, stats);
+
+    // Report:
+    double elapsed = (double)(end - start) / 1e9;
+    printf("Sent %llu, received %llu (%.0f responses/s), lost %llu (%.3f%%), late %llu, wrong status %llu",
+           (unsigned long long)stats->sent, (unsigned long long)stats->received, stats->received / elapsed,
+           (unsigned long long)stats->lost, stats->sent ? 100.0 * stats->lost / stats->sent : 0.0,
+           (unsigned long long)stats->late, (unsigned long long)stats->wrong);
+    if (rate > 0)
+        printf(", skipped %llu (no free key)", (unsigned long long)stats->skipped);
+    printf("\n");
+    latency_histogram_print(&stats->latency, stdout, "Latency");
+
+    // Housekeeping:
+    for (unsigned int s = 0; s < socket_count; s++)
+        close(lsocks[s].sock);
+    free(population.paid);
+    free(population.not_paid);
+    free(stats);
+    free(pfds);
+    free(lsocks);
+    subscriber_index_free(&subscriber_index);
+    free(verification_database);
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,827 @@
  */
 
 #include "customProtocol.h"
+#include "clientWindow.h"
+#include "sequenceWindow.h"
+#include "rttEstimator.h"
+#include "requestReader.h"
+#include <poll.h>
+#include <sys/epoll.h>
+
+// Multi-client mode (-M): each socket carries up to MAX_CLIENT_ID + 1 logical
+// clients, told apart by client_id
+#define CLIENTS_PER_SOCKET (MAX_CLIENT_ID + 1)
+#define MAX_CLIENT_SOCKETS 64
+#define CLIENT_SOCKET_BUFFER (1 << 22)
+// Protocol version 2 (-V 2): neither limit comes from the packet any more
+#define MAX_WINDOW_SIZE_V2 (1 << 16)
+#define MAX_CLIENTS_V2 (1 << 20)
+// Batch frame negotiation (-K): probes sent, and how long to wait for each answer
+#define BATCH_PROBE_TRIES 3
+#define BATCH_PROBE_TIMEOUT_MS 200
+
+// New requests of a socket waiting to go out together in one batch frame:
+typedef struct
+{
+    batch_frame_t frame;
+    unsigned int max_records; // Records per frame, 0 to send single packets
+} request_batch_t;
+
+// One logical client of the multi-client mode:
+typedef struct
+{
+    rtt_estimator_t rtt;  // Its own ACK timer
+    unsigned int socket;  // Socket it sends from
+    uint32_t client_id;   // 8-bit with version 1
+    uint8_t next_segment; // Where the search for a free segment number starts, version 1 only
+} logical_client_t;
+
+// A socket of the multi-client mode and the requests its clients have in flight:
+typedef struct
+{
+    int sock;
+    client_window_t window; // Keyed by (client_id, segment_no), so per logical client
+    request_batch_t batch;
+} client_socket_t;
+
+// A socket of the version 2 clients and the requests they have in flight:
+typedef struct
+{
+    int sock;
+    sequence_window_t window; // Keyed by sequence number, shared by the socket's clients
+} client_socket_v2_t;
+
+// Response log formats, indexed by status - SUB_NOT_PAID. The status text is
+// part of the format because the logger only copies integer arguments.
+static const char *const response_log_formats[] = {
+    "Server responded with subscriber status: 0x%04llX\t" SUB_NOT_PAID_MSG "\n",
+    "Server responded with subscriber status: 0x%04llX\t" SUB_NOT_EXIST_MSG "\n",
+    "Server responded with subscriber status: 0x%04llX\t" SUB_ACC_OK_MSG "\n",
+};
+
+/**
+ * @brief Send a request packet to the server.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param subscriber_packet request to send
+ */
+static void send_request(int sock, const struct sockaddr_in *server, const subscriber_packet_t *subscriber_packet)
+{
+    if (sendto(sock, subscriber_packet, sizeof(*subscriber_packet), 0,
+               (const struct sockaddr *)server, sizeof(*server)) < 0)
+        error("Error: Sendto");
+}
+
+/**
+ * @brief Send a batch frame to the server.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param frame frame to send, finished
+ * @param frame_size frame size from finish_batch_frame()
+ */
+static void send_request_frame(int sock, const struct sockaddr_in *server, const batch_frame_t *frame, size_t frame_size)
+{
+    if (sendto(sock, frame, frame_size, 0, (const struct sockaddr *)server, sizeof(*server)) < 0)
+        error("Error: Sendto");
+}
+
+/**
+ * @brief Initialize an ACK timer: adaptive, or fixed at ACK_TIMER_WAIT_TIME_MS.
+ *
+ * @param rtt ACK timer to initialize
+ * @param adaptive_timer whether it follows the measured RTT
+ */
+static void init_ack_timer(rtt_estimator_t *rtt, bool adaptive_timer)
+{
+    if (adaptive_timer)
+        rtt_estimator_init(rtt, ACK_TIMER_WAIT_TIME_MS * 1000000ULL, ACK_TIMER_MIN_WAIT_TIME_US * 1000ULL,
+                           ACK_TIMER_WAIT_TIME_MS * 1000000ULL);
+    else
+        rtt_estimator_init(rtt, ACK_TIMER_WAIT_TIME_MS * 1000000ULL, ACK_TIMER_WAIT_TIME_MS * 1000000ULL,
+                           ACK_TIMER_WAIT_TIME_MS * 1000000ULL);
+}
+
+/**
+ * @brief Send the requests waiting in a batch frame, if any.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param batch socket's batch
+ */
+static void flush_request_batch(int sock, const struct sockaddr_in *server, request_batch_t *batch)
+{
+    size_t frame_size;
+
+    if (batch->frame.count == 0)
+        return;
+    frame_size = finish_batch_frame(&batch->frame);
+    send_request_frame(sock, server, &batch->frame, frame_size);
+    reset_batch_frame(&batch->frame);
+}
+
+/**
+ * @brief Log and send a new request. With batch frames the request joins the
+ *      socket's frame, which goes out when full or at flush_request_batch().
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param batch socket's batch
+ * @param subscriber_packet request to send
+ * @return uint64_t send time, taken just before the send
+ */
+static uint64_t send_new_request(int sock, const struct sockaddr_in *server, request_batch_t *batch,
+                                 subscriber_packet_t *subscriber_packet)
+{
+    uint64_t now;
+
+    LOG_TEXT(LOG_LEVEL_DEBUG, "\n");
+    LOG_EVENT(LOG_LEVEL_INFO, "Sending packet: %llu\n", subscriber_packet->segment_no);
+    if (!is_valid_subscriber_packet(subscriber_packet))
+        error("Error: Invalid subscriber packet\n");
+    LOG_TEXT(LOG_LEVEL_DEBUG, "subscriber packet formatted okay\n");
+    log_subscriber_packet(subscriber_packet);
+
+    now = monotonic_time_ns();
+    if (batch->max_records == 0)
+        send_request(sock, server, subscriber_packet);
+    else
+    {
+        add_batch_record(&batch->frame, subscriber_packet);
+        if (batch->frame.count == batch->max_records)
+            flush_request_batch(sock, server, batch);
+    }
+    return now;
+}
+
+/**
+ * @brief Ask the server whether it takes batch frames, with a probe frame.
+ *      A server without them drops the probe, so no answer means no.
+ *
+ * @param server server address
+ * @param records records per frame wanted
+ * @return unsigned int records per frame to send, at most what the server takes, 0 for single packets
+ */
+static unsigned int negotiate_batch(const struct sockaddr_in *server, unsigned int records)
+{
+    batch_frame_t probe, answer;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0), n;
+    size_t probe_size;
+
+    if (sock < 0)
+        error("Error: socket");
+    reset_batch_frame(&probe);
+    probe_size = finish_batch_frame(&probe);
+    for (int attempt = 0; attempt < BATCH_PROBE_TRIES; attempt++)
+    {
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        send_request_frame(sock, server, &probe, probe_size);
+        if (poll(&pfd, 1, BATCH_PROBE_TIMEOUT_MS) <= 0)
+            continue;
+        n = recv(sock, &answer, sizeof(answer), MSG_DONTWAIT);
+        if (n > 0 && is_batch_frame(&answer, n) && check_batch_frame(&answer, n, true) == PACKET_VALID &&
+            answer.count == 0 && answer.max_records > 0)
+        {
+            close(sock);
+            return records < answer.max_records ? records : answer.max_records;
+        }
+    }
+    close(sock);
+    return 0;
+}
+
+/**
+ * @brief Log a response that answered an in-flight request.
+ *
+ * @param subscriber_status status the server responded with
+ */
+static void log_response(SUBSCRIBER_PACKET_TYPE subscriber_status)
+{
+    if (subscriber_status >= SUB_NOT_PAID && subscriber_status <= SUB_ACC_OK)
+        LOG_EVENT(LOG_LEVEL_INFO, response_log_formats[subscriber_status - SUB_NOT_PAID], subscriber_status);
+    else
+        LOG_EVENT(LOG_LEVEL_WARN, "Server responded with unknown subscriber status: 0x%04llX\n", subscriber_status);
+    LOG_TEXT(LOG_LEVEL_INFO, "\n");
+}
+
+/**
+ * @brief Retransmit a request whose ACK timer expired, backing its timer off.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param request expired request, with retries left
+ * @param rtt ACK timer of the request's client
+ * @param now current time
+ */
+static void retry_request(int sock, const struct sockaddr_in *server, client_request_t *request, rtt_estimator_t *rtt,
+                          uint64_t now)
+{
+    request->attempts++;
+    LOG_TEXT(LOG_LEVEL_DEBUG, "\n");
+    LOG_EVENT(LOG_LEVEL_INFO, "Error:\tACK_TIMER timed out!\nRetrying attempt %llu\n", request->attempts);
+    send_request(sock, server, &request->packet);
+    request->sent_ns = now;
+    request->deadline_ns = now + rtt_estimator_timeout(rtt, request->attempts);
+}
+
+/**
+ * @brief Replay the input as one client on one socket, with up to
+ *      window_size requests in flight.
+ *
+ * @param reader input requests
+ * @param server server address
+ * @param window_size requests in flight, 1 - MAX_WINDOW_SIZE
+ * @param adaptive_timer whether the ACK timer follows the measured RTT
+ * @param batch_records records per batch frame, 0 to send single packets
+ * @param rtt_histogram RTT samples, from requests sent once
+ * @param answered set to the number of answered requests
+ * @param unanswered set to the number of requests given up
+ * @param rtt set to the final ACK timer
+ * @return uint64_t number of requests sent
+ */
+static uint64_t run_client(request_reader_t *reader, const struct sockaddr_in *server, unsigned int window_size,
+                           bool adaptive_timer, unsigned int batch_records, latency_histogram_t *rtt_histogram,
+                           uint64_t *answered, uint64_t *unanswered, rtt_estimator_t *rtt)
+{
+    int sock, n;
+    uint64_t request_no = 0, now;
+    subscriber_packet_t responses[BATCH_MAX_RECORDS];
+    unsigned int response_count;
+
+    // Create socket, the ACK timers are kept by the window:
+    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        error("Error: socket");
+
+    // Custom protocol's Subscriber Packets, and batch frames going out and coming in:
+    subscriber_packet_t subscriber_packet = {};
+    bool have_next = false, input_done = false;
+    REQUEST_READ read_result;
+    client_window_t *window = malloc(sizeof(client_window_t));
+    request_batch_t *batch = malloc(sizeof(request_batch_t));
+    batch_frame_t *datagram = malloc(sizeof(batch_frame_t));
+    client_request_t *request;
+    if (window == NULL || batch == NULL || datagram == NULL)
+        error("Error: Allocating window");
+    client_window_init(window, window_size);
+    reset_batch_frame(&batch->frame);
+    batch->max_records = batch_records;
+
+    // ACK timers: adaptive by default, -F keeps the fixed ACK_TIMER_WAIT_TIME_MS
+    init_ack_timer(rtt, adaptive_timer);
+
+    // Keep up to window_size requests in flight until every segment is answered or given up:
+    while (!input_done || have_next || window->in_flight_count > 0)
+    {
+        // Fill the window. A request whose (client_id, segment_no) is still in
+        // flight waits, so every response matches exactly one request.
+        while (client_window_has_room(window))
+        {
+            if (!have_next)
+            {
+                // Block on the parser only when nothing is in flight to wait for instead
+                read_result = request_reader_next(reader, &subscriber_packet, window->in_flight_count == 0);
+                if (read_result == REQUEST_READ_EMPTY)
+                    break;
+                if (read_result == REQUEST_READ_END)
+                {
+                    input_done = true;
+                    break;
+                }
+                have_next = true;
+                request_no++;
+            }
+            if (client_window_is_busy(window, &subscriber_packet))
+                break;
+
+            // Send message to server, timing from just before the send
+            now = send_new_request(sock, server, batch, &subscriber_packet);
+            client_window_add(window, &subscriber_packet, request_no, now, rtt_estimator_timeout(rtt, 0));
+            have_next = false;
+        }
+        flush_request_batch(sock, server, batch);
+        if (window->in_flight_count == 0)
+            continue;
+
+        // Wait for a response or the earliest ACK timer:
+        now = monotonic_time_ns();
+        uint64_t deadline = client_window_next_deadline(window);
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        int wait_ms = deadline > now ? (int)((deadline - now + 999999) / 1000000) : 0;
+        if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR)
+            error("Error: poll");
+
+        // Get responses from server:
+        while ((n = recv(sock, datagram, sizeof(*datagram), MSG_DONTWAIT)) >= 0)
+        {
+            response_count = batch_frame_responses(datagram, n, responses);
+            for (unsigned int r = 0; r < response_count; r++)
+            {
+                if ((request = client_window_match(window, &responses[r])) == NULL)
+                    continue; // Stale duplicate of an answered request, or not ours
+
+                // RTT sample, only from requests sent once (Karn's algorithm):
+                if (request->attempts == 0)
+                {
+                    uint64_t rtt_ns = monotonic_time_ns() - request->sent_ns;
+                    latency_histogram_record(rtt_histogram, rtt_ns);
+                    if (adaptive_timer)
+                        rtt_estimator_sample(rtt, rtt_ns);
+                }
+
+                // Print response from server:
+                log_response(responses[r].packet_type);
+                client_window_remove(window, request);
+                (*answered)++;
+            }
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            error("Error: Recvfrom");
+
+        // Retransmit only the requests whose ACK timer expired, up to 3 times, backing off each time:
+        now = monotonic_time_ns();
+        while ((request = client_window_next_expired(window, now)) != NULL)
+        {
+            if (request->attempts == ACK_TIMER_RETRY_COUNT)
+            {
+                LOG_TEXT(LOG_LEVEL_INFO, "Server does not respond\n");
+                LOG_TEXT(LOG_LEVEL_INFO, "\n");
+                client_window_remove(window, request);
+                (*unanswered)++;
+                continue;
+            }
+            retry_request(sock, server, request, rtt, now);
+        }
+    }
+    free(datagram);
+    free(batch);
+    free(window);
+    close(sock);
+    return request_no;
+}
+
+/**
+ * @brief Mean ACK timer of the clients that measured an RTT, or client 0's
+ *      initial one if none did.
+ *
+ * @param clients logical clients
+ * @param client_count number of clients
+ * @param mean_rtt set to the mean timer values
+ */
+static void mean_ack_timer(const logical_client_t *clients, unsigned int client_count, rtt_estimator_t *mean_rtt)
+{
+    uint64_t samples = 0;
+
+    memset(mean_rtt, DEFAULT_VALUE, sizeof(*mean_rtt));
+    for (unsigned int i = 0; i < client_count; i++)
+        if (clients[i].rtt.samples > 0)
+        {
+            mean_rtt->srtt_ns += clients[i].rtt.srtt_ns;
+            mean_rtt->rttvar_ns += clients[i].rtt.rttvar_ns;
+            mean_rtt->rto_ns += clients[i].rtt.rto_ns;
+            samples++;
+        }
+    if (samples > 0)
+    {
+        mean_rtt->srtt_ns /= samples;
+        mean_rtt->rttvar_ns /= samples;
+        mean_rtt->rto_ns /= samples;
+    }
+    else
+        *mean_rtt = clients[0].rtt;
+}
+
+/**
+ * @brief Multi-client mode: replay the input as client_count logical clients
+ *      spread over socket_count sockets, driven by one epoll loop. Client i
+ *      sends from socket i % socket_count with client_id i / socket_count,
+ *      keeps up to client_window requests in flight with segment numbers of
+ *      its own, and has its own ACK timer. Input requests go to the clients
+ *      in turn as their window slots free up; their client ID and segment
+ *      number are replaced by the client's.
+ *
+ * @param reader input requests
+ * @param server server address
+ * @param client_count logical clients, up to socket_count * CLIENTS_PER_SOCKET
+ * @param socket_count sockets, 1 - MAX_CLIENT_SOCKETS
+ * @param client_window requests in flight per client, 1 - PACKET_GROUP_SIZE
+ * @param adaptive_timer whether ACK timers follow the measured RTT
+ * @param batch_records records per batch frame, 0 to send single packets
+ * @param rtt_histogram RTT samples, from requests sent once
+ * @param answered set to the number of answered requests
+ * @param unanswered set to the number of requests given up
+ * @param mean_rtt set to the clients' mean ACK timer values
+ * @return uint64_t number of requests sent
+ */
+static uint64_t run_clients(request_reader_t *reader, const struct sockaddr_in *server, unsigned int client_count,
+                            unsigned int socket_count, unsigned int client_window, bool adaptive_timer,
+                            unsigned int batch_records, latency_histogram_t *rtt_histogram, uint64_t *answered,
+                            uint64_t *unanswered, rtt_estimator_t *mean_rtt)
+{
+    logical_client_t *clients = calloc(client_count, sizeof(logical_client_t));
+    client_socket_t *sockets = calloc(socket_count, sizeof(client_socket_t));
+    // Send opportunities: a client index per free window slot, handed out in order
+    unsigned int ready_capacity = client_count * client_window, ready_head = 0, ready_count = 0;
+    uint32_t *ready = malloc(ready_capacity * sizeof(uint32_t));
+    struct epoll_event events[MAX_CLIENT_SOCKETS];
+    uint64_t request_no = 0, in_flight = 0, now, timer_ns = UINT64_MAX;
+    subscriber_packet_t packet, responses[BATCH_MAX_RECORDS];
+    batch_frame_t *datagram = malloc(sizeof(batch_frame_t));
+    client_request_t *request;
+    REQUEST_READ read_result;
+    bool input_done = false;
+    int epfd = epoll_create1(0), n;
+
+    if (clients == NULL || sockets == NULL || ready == NULL || datagram == NULL)
+        error("Error: Allocating clients");
+    if (epfd < 0)
+        error("Error: epoll_create1");
+    for (unsigned int s = 0; s < socket_count; s++)
+    {
+        int buffer = CLIENT_SOCKET_BUFFER;
+        struct epoll_event event = {.events = EPOLLIN, .data.u32 = s};
+
+        if ((sockets[s].sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+            error("Error: socket");
+        setsockopt(sockets[s].sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        setsockopt(sockets[s].sock, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        client_window_init(&sockets[s].window, CLIENT_WINDOW_KEYS);
+        reset_batch_frame(&sockets[s].batch.frame);
+        sockets[s].batch.max_records = batch_records;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockets[s].sock, &event) < 0)
+            error("Error: epoll_ctl");
+    }
+    for (unsigned int i = 0; i < client_count; i++)
+    {
+        clients[i].socket = i % socket_count;
+        clients[i].client_id = i / socket_count;
+        init_ack_timer(&clients[i].rtt, adaptive_timer);
+    }
+    for (unsigned int slot = 0; slot < client_window; slot++)
+        for (unsigned int i = 0; i < client_count; i++)
+            ready[ready_count++] = i;
+
+    while (!input_done || in_flight > 0)
+    {
+        // Give input requests to the clients with a free window slot:
+        while (ready_count > 0)
+        {
+            // Block on the parser only when nothing is in flight to wait for instead
+            read_result = request_reader_next(reader, &packet, in_flight == 0);
+            if (read_result != REQUEST_READ_OK)
+            {
+                input_done = read_result == REQUEST_READ_END;
+                break;
+            }
+            logical_client_t *client = &clients[ready[ready_head]];
+            client_socket_t *csock = &sockets[client->socket];
+            ready_head = (ready_head + 1) % ready_capacity;
+            ready_count--;
+            request_no++;
+
+            // The client has fewer than client_window <= PACKET_GROUP_SIZE requests in flight, so a segment is free
+            packet.client_id = client->client_id;
+            packet.segment_no = client->next_segment;
+            while (client_window_is_busy(&csock->window, &packet))
+                packet.segment_no = (packet.segment_no + 1) % PACKET_GROUP_SIZE;
+            client->next_segment = (packet.segment_no + 1) % PACKET_GROUP_SIZE;
+
+            now = send_new_request(csock->sock, server, &csock->batch, &packet);
+            request = client_window_add(&csock->window, &packet, request_no, now, rtt_estimator_timeout(&client->rtt, 0));
+            if (request->deadline_ns < timer_ns)
+                timer_ns = request->deadline_ns;
+            in_flight++;
+        }
+        for (unsigned int s = 0; s < socket_count; s++)
+            flush_request_batch(sockets[s].sock, server, &sockets[s].batch);
+        if (in_flight == 0)
+            continue;
+
+        // Wait for responses on any socket, or the earliest ACK timer:
+        now = monotonic_time_ns();
+        uint64_t wait_ns = timer_ns > now ? timer_ns - now : 0;
+        int wait_ms = wait_ns < ACK_TIMER_WAIT_TIME_MS * 1000000ULL ? (int)((wait_ns + 999999) / 1000000)
+                                                                    : ACK_TIMER_WAIT_TIME_MS;
+        if ((n = epoll_wait(epfd, events, socket_count, wait_ms)) < 0 && errno != EINTR)
+            error("Error: epoll_wait");
+        for (int e = 0; e < n; e++)
+        {
+            unsigned int s = events[e].data.u32;
+            client_socket_t *csock = &sockets[s];
+            int size;
+
+            while ((size = recv(csock->sock, datagram, sizeof(*datagram), MSG_DONTWAIT)) >= 0)
+            {
+                unsigned int response_count = batch_frame_responses(datagram, size, responses);
+                for (unsigned int r = 0; r < response_count; r++)
+                {
+                    if ((request = client_window_match(&csock->window, &responses[r])) == NULL)
+                        continue; // Stale duplicate of an answered request, or not ours
+                    unsigned int c = responses[r].client_id * socket_count + s;
+
+                    // RTT sample, only from requests sent once (Karn's algorithm):
+                    if (request->attempts == 0)
+                    {
+                        uint64_t rtt_ns = monotonic_time_ns() - request->sent_ns;
+                        latency_histogram_record(rtt_histogram, rtt_ns);
+                        if (adaptive_timer)
+                            rtt_estimator_sample(&clients[c].rtt, rtt_ns);
+                    }
+                    log_response(responses[r].packet_type);
+                    client_window_remove(&csock->window, request);
+                    ready[(ready_head + ready_count++) % ready_capacity] = c;
+                    in_flight--;
+                    (*answered)++;
+                }
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                error("Error: Recvfrom");
+        }
+
+        // Scan the windows only once the earliest ACK timer may have expired:
+        now = monotonic_time_ns();
+        if (now < timer_ns)
+            continue;
+        timer_ns = UINT64_MAX;
+        for (unsigned int s = 0; s < socket_count; s++)
+        {
+            client_socket_t *csock = &sockets[s];
+            while ((request = client_window_next_expired(&csock->window, now)) != NULL)
+            {
+                unsigned int c = request->packet.client_id * socket_count + s;
+                if (request->attempts == ACK_TIMER_RETRY_COUNT)
+                {
+                    LOG_TEXT(LOG_LEVEL_INFO, "Server does not respond\n");
+                    LOG_TEXT(LOG_LEVEL_INFO, "\n");
+                    client_window_remove(&csock->window, request);
+                    ready[(ready_head + ready_count++) % ready_capacity] = c;
+                    in_flight--;
+                    (*unanswered)++;
+                    continue;
+                }
+                retry_request(csock->sock, server, request, &clients[c].rtt, now);
+            }
+            uint64_t deadline = client_window_next_deadline(&csock->window);
+            if (deadline < timer_ns)
+                timer_ns = deadline;
+        }
+    }
+
+    mean_ack_timer(clients, client_count, mean_rtt);
+
+    for (unsigned int s = 0; s < socket_count; s++)
+        close(sockets[s].sock);
+    close(epfd);
+    free(datagram);
+    free(ready);
+    free(sockets);
+    free(clients);
+    return request_no;
+}
+
+/**
+ * @brief Send a version 2 request packet to the server.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param packet request to send
+ */
+static void send_request_v2(int sock, const struct sockaddr_in *server, const subscriber_packet_v2_t *packet)
+{
+    if (sendto(sock, packet, sizeof(*packet), 0, (const struct sockaddr *)server, sizeof(*server)) < 0)
+        error("Error: Sendto");
+}
+
+/**
+ * @brief Log and send a new version 2 request, numbered by the window.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param request request from sequence_window_add()
+ */
+static void send_new_request_v2(int sock, const struct sockaddr_in *server, const sequence_request_t *request)
+{
+    LOG_TEXT(LOG_LEVEL_DEBUG, "\n");
+    LOG_EVENT(LOG_LEVEL_INFO, "Sending packet: %llu\n", request->packet.sequence_no);
+    if (!is_valid_subscriber_packet_v2(&request->packet))
+        error("Error: Invalid subscriber packet\n");
+    log_subscriber_packet_v2(&request->packet);
+    send_request_v2(sock, server, &request->packet);
+}
+
+/**
+ * @brief retry_request() for a version 2 request.
+ *
+ * @param sock client socket
+ * @param server server address
+ * @param window window holding the request
+ * @param request expired request, with retries left
+ * @param rtt ACK timer of the request's client
+ * @param now current time
+ */
+static void retry_request_v2(int sock, const struct sockaddr_in *server, sequence_window_t *window,
+                             sequence_request_t *request, rtt_estimator_t *rtt, uint64_t now)
+{
+    request->attempts++;
+    LOG_TEXT(LOG_LEVEL_DEBUG, "\n");
+    LOG_EVENT(LOG_LEVEL_INFO, "Error:\tACK_TIMER timed out!\nRetrying attempt %llu\n", request->attempts);
+    send_request_v2(sock, server, &request->packet);
+    sequence_window_rearm(window, request, now, rtt_estimator_timeout(rtt, request->attempts));
+}
+
+/**
+ * @brief First client ID of this run's version 2 clients, different from run
+ *      to run so concurrent clients of one server don't share IDs.
+ *
+ * @return uint32_t client ID of client 0, client i has this + i
+ */
+static uint32_t first_client_id_v2(void)
+{
+    uint64_t seed = monotonic_time_ns() ^ ((uint64_t)getpid() << 32);
+    return (uint32_t)((seed * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**
+ * @brief Protocol version 2: replay the input as client_count clients spread
+ *      over socket_count sockets, as run_clients() does, or as one client on
+ *      one socket. Each client has a 32-bit client ID of its own. Requests
+ *      are numbered per socket by its sequence window and matched to
+ *      responses by sequence number, so neither the clients per socket nor
+ *      the requests in flight are bounded by the packet.
+ *
+ * @param reader input requests
+ * @param server server address
+ * @param client_count clients, 1 - MAX_CLIENTS_V2
+ * @param socket_count sockets, 1 - MAX_CLIENT_SOCKETS
+ * @param client_window requests in flight per client, client_count * client_window <= MAX_SEQUENCE_WINDOW
+ * @param adaptive_timer whether ACK timers follow the measured RTT
+ * @param rtt_histogram RTT samples, from requests sent once
+ * @param answered set to the number of answered requests
+ * @param unanswered set to the number of requests given up
+ * @param mean_rtt set to the clients' mean ACK timer values
+ * @return uint64_t number of requests sent
+ */
+static uint64_t run_clients_v2(request_reader_t *reader, const struct sockaddr_in *server, unsigned int client_count,
+                               unsigned int socket_count, unsigned int client_window, bool adaptive_timer,
+                               latency_histogram_t *rtt_histogram, uint64_t *answered, uint64_t *unanswered,
+                               rtt_estimator_t *mean_rtt)
+{
+    logical_client_t *clients = calloc(client_count, sizeof(logical_client_t));
+    client_socket_v2_t *sockets = calloc(socket_count, sizeof(client_socket_v2_t));
+    // Send opportunities: a client index per free window slot, handed out in order
+    unsigned int ready_capacity = client_count * client_window, ready_head = 0, ready_count = 0;
+    uint32_t *ready = malloc(ready_capacity * sizeof(uint32_t));
+    uint32_t first_client_id = first_client_id_v2();
+    struct epoll_event events[MAX_CLIENT_SOCKETS];
+    uint64_t request_no = 0, in_flight = 0, now, timer_ns = UINT64_MAX;
+    subscriber_packet_t packet;
+    subscriber_packet_v2_t packet_v2, response;
+    sequence_request_t *request;
+    REQUEST_READ read_result;
+    bool input_done = false;
+    int epfd = epoll_create1(0), n;
+
+    if (clients == NULL || sockets == NULL || ready == NULL)
+        error("Error: Allocating clients");
+    if (epfd < 0)
+        error("Error: epoll_create1");
+    for (unsigned int s = 0; s < socket_count; s++)
+    {
+        int buffer = CLIENT_SOCKET_BUFFER;
+        struct epoll_event event = {.events = EPOLLIN, .data.u32 = s};
+        unsigned int socket_clients = client_count / socket_count + (s < client_count % socket_count);
+
+        if ((sockets[s].sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+            error("Error: socket");
+        setsockopt(sockets[s].sock, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        setsockopt(sockets[s].sock, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        sequence_window_init(&sockets[s].window, socket_clients * client_window, first_client_id + s);
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockets[s].sock, &event) < 0)
+            error("Error: epoll_ctl");
+    }
+    for (unsigned int i = 0; i < client_count; i++)
+    {
+        clients[i].socket = i % socket_count;
+        clients[i].client_id = first_client_id + i;
+        init_ack_timer(&clients[i].rtt, adaptive_timer);
+    }
+    for (unsigned int slot = 0; slot < client_window; slot++)
+        for (unsigned int i = 0; i < client_count; i++)
+            ready[ready_count++] = i;
+
+    while (!input_done || in_flight > 0)
+    {
+        // Give input requests to the clients with a free window slot. The
+        // window numbers them, so no request waits for a free key.
+        while (ready_count > 0)
+        {
+            // Block on the parser only when nothing is in flight to wait for instead
+            read_result = request_reader_next(reader, &packet, in_flight == 0);
+            if (read_result != REQUEST_READ_OK)
+            {
+                input_done = read_result == REQUEST_READ_END;
+                break;
+            }
+            uint32_t c = ready[ready_head];
+            logical_client_t *client = &clients[c];
+            client_socket_v2_t *csock = &sockets[client->socket];
+            ready_head = (ready_head + 1) % ready_capacity;
+            ready_count--;
+            request_no++;
+
+            reset_subscriber_packet_v2(&packet_v2);
+            update_subscriber_packet_v2(&packet_v2, client->client_id, SUB_ACC_PER, DEFAULT_VALUE, packet.technology,
+                                        packet.src_sub_no);
+            request = sequence_window_add(&csock->window, &packet_v2, request_no, c, monotonic_time_ns(),
+                                          rtt_estimator_timeout(&client->rtt, 0));
+            send_new_request_v2(csock->sock, server, request);
+            if (request->deadline_ns < timer_ns)
+                timer_ns = request->deadline_ns;
+            in_flight++;
+        }
+        if (in_flight == 0)
+            continue;
+
+        // Wait for responses on any socket, or the earliest ACK timer:
+        now = monotonic_time_ns();
+        uint64_t wait_ns = timer_ns > now ? timer_ns - now : 0;
+        int wait_ms = wait_ns < ACK_TIMER_WAIT_TIME_MS * 1000000ULL ? (int)((wait_ns + 999999) / 1000000)
+                                                                    : ACK_TIMER_WAIT_TIME_MS;
+        if ((n = epoll_wait(epfd, events, socket_count, wait_ms)) < 0 && errno != EINTR)
+            error("Error: epoll_wait");
+        for (int e = 0; e < n; e++)
+        {
+            client_socket_v2_t *csock = &sockets[events[e].data.u32];
+            int size;
+
+            // MSG_TRUNC returns the real size of oversized datagrams, which are not responses
+            while ((size = recv(csock->sock, &response, sizeof(response), MSG_DONTWAIT | MSG_TRUNC)) >= 0)
+            {
+                if (check_subscriber_packet_v2(&response, size) != PACKET_VALID ||
+                    (request = sequence_window_match(&csock->window, &response)) == NULL)
+                    continue; // Stale duplicate of an answered request, or not ours
+                uint32_t c = request->owner;
+
+                // RTT sample, only from requests sent once (Karn's algorithm):
+                if (request->attempts == 0)
+                {
+                    uint64_t rtt_ns = monotonic_time_ns() - request->sent_ns;
+                    latency_histogram_record(rtt_histogram, rtt_ns);
+                    if (adaptive_timer)
+                        rtt_estimator_sample(&clients[c].rtt, rtt_ns);
+                }
+                log_response(response.packet_type);
+                sequence_window_remove(&csock->window, request);
+                ready[(ready_head + ready_count++) % ready_capacity] = c;
+                in_flight--;
+                (*answered)++;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                error("Error: Recvfrom");
+        }
+
+        // Expire the windows' timers only once the earliest may be due:
+        now = monotonic_time_ns();
+        if (now < timer_ns)
+            continue;
+        timer_ns = UINT64_MAX;
+        for (unsigned int s = 0; s < socket_count; s++)
+        {
+            client_socket_v2_t *csock = &sockets[s];
+            while ((request = sequence_window_next_expired(&csock->window, now)) != NULL)
+            {
+                uint32_t c = request->owner;
+                if (request->attempts == ACK_TIMER_RETRY_COUNT)
+                {
+                    LOG_TEXT(LOG_LEVEL_INFO, "Server does not respond\n");
+                    LOG_TEXT(LOG_LEVEL_INFO, "\n");
+                    sequence_window_remove(&csock->window, request);
+                    ready[(ready_head + ready_count++) % ready_capacity] = c;
+                    in_flight--;
+                    (*unanswered)++;
+                    continue;
+                }
+                retry_request_v2(csock->sock, server, &csock->window, request, &clients[c].rtt, now);
+            }
+            uint64_t deadline = sequence_window_next_deadline(&csock->window);
+            if (deadline < timer_ns)
+                timer_ns = deadline;
+        }
+    }
+
+    mean_ack_timer(clients, client_count, mean_rtt);
+
+    for (unsigned int s = 0; s < socket_count; s++)
+    {
+        close(sockets[s].sock);
+        sequence_window_free(&sockets[s].window);
+    }
+    close(epfd);
+    free(ready);
+    free(sockets);
+    free(clients);
+    return request_no;
+}
 
 /**
  * @brief Main function (Driver code)
@@ -25,49 +846,79 @@
 int main(int argc, char *argv[])
 {
     // Local variables
-    int sock, n, port, ack_timer_reset_count, seg_count;
-    struct sockaddr_in server, recv_from;
-    unsigned int length = sizeof(struct sockaddr_in);
+    int port;
+    struct sockaddr_in server;
     struct hostent *hp;
-    bool response_received = false;
-    struct timeval tv;
-    uint8_t client_id, seg_no = 0, input_seg_no = 0, technology = 0;
-    uint32_t src_sub_no = 0;
+    uint64_t request_no = 0, answered = 0, unanswered = 0;
+    unsigned int window_size = DEFAULT_WINDOW_SIZE, client_count = 0, socket_count = 0, batch_records = 0;
+    unsigned int protocol_version = 1;
+    bool adaptive_timer = true;
+    LOG_LEVEL log_level = LOG_LEVEL_INFO;
+    int opt;
 
     // Default port number and hostname
     char *host = HOSTNAME;
     port = PORT;
 
     // Checking if usage is correct
-    if (argc != 2)
+    while ((opt = getopt(argc, argv, "v:W:FM:S:K:V:")) != -1)
     {
-        printf("Usage: input_file\n");
-        exit(EXIT_FAILURE);
+        if (opt == 'v' && log_parse_level(optarg, &log_level))
+            continue;
+        if (opt == 'F')
+        {
+            adaptive_timer = false;
+            continue;
+        }
+        if (opt == 'W' && (window_size = atoi(optarg)) >= 1 && window_size <= MAX_WINDOW_SIZE_V2)
+            continue;
+        if (opt == 'M' && (client_count = atoi(optarg)) >= 1 && client_count <= MAX_CLIENTS_V2)
+            continue;
+        if (opt == 'S' && (socket_count = atoi(optarg)) >= 1 && socket_count <= MAX_CLIENT_SOCKETS)
+            continue;
+        if (opt == 'K' && (batch_records = atoi(optarg)) >= 1 && batch_records <= BATCH_MAX_RECORDS)
+            continue;
+        if (opt == 'V' && ((protocol_version = atoi(optarg)) == 1 || protocol_version == SUBSCRIBER_PROTOCOL_VERSION))
+            continue;
+        argc = 0; // Usage error
+        break;
     }
-
-    // File IO variables
-    char *filename = argv[1];
-    FILE *fp;
-    char *line = NULL;
-    size_t len = 0;
-
-    // Reading input file:
-    fp = fopen(filename, "r");
-    if (fp == NULL)
+    // -M: -W is per client, and the sockets default to as few as hold 256 clients each
+    if (client_count > 0 && socket_count == 0)
+    {
+        socket_count = (client_count + CLIENTS_PER_SOCKET - 1) / CLIENTS_PER_SOCKET;
+        if (socket_count > MAX_CLIENT_SOCKETS)
+            socket_count = MAX_CLIENT_SOCKETS;
+    }
+    // Version 1 keys requests by (client_id, segment_no), version 2 by sequence number
+    bool version1_limits = client_count > 0 ? window_size <= PACKET_GROUP_SIZE &&
+                                                  client_count <= socket_count * CLIENTS_PER_SOCKET
+                                            : window_size <= MAX_WINDOW_SIZE;
+    bool version2_limits = (uint64_t)(client_count > 0 ? client_count : 1) * window_size <= MAX_SEQUENCE_WINDOW &&
+                           batch_records == 0;
+    if (argc - optind != 1 || !(protocol_version == 1 ? version1_limits : version2_limits) ||
+        (client_count == 0 && socket_count > 0))
     {
-        error("Error opening file");
+        printf("Usage: [-v off|error|warn|info|debug] [-V 1|2] [-W window] [-F]\n"
+               "       [-M clients [-S sockets 1-%d]] [-K records 1-%d] input_file|-\n"
+               "  -V  protocol version, 2 for 32-bit client IDs and sequence numbers\n"
+               "  -W  requests in flight, 1-%d, or with -V 2 1-%d\n"
+               "  -M  simulate many clients over a few sockets, -W is then per client:\n"
+               "      up to %d clients, 256 per socket, each 1-%d in flight, or with -V 2\n"
+               "      up to %d clients, %d requests in flight in all\n"
+               "  -K  send new requests in batch frames of up to this many, if the server takes them,\n"
+               "      version 1 only\n",
+               MAX_CLIENT_SOCKETS, (int)BATCH_MAX_RECORDS, MAX_WINDOW_SIZE, MAX_WINDOW_SIZE_V2,
+               MAX_CLIENT_SOCKETS * CLIENTS_PER_SOCKET, PACKET_GROUP_SIZE, MAX_CLIENTS_V2, MAX_SEQUENCE_WINDOW);
+        exit(EXIT_FAILURE);
     }
-    // Read the number of segments to send:
-    getline(&line, &len, fp);
-    seg_count = atoi(line);
-    memset(line, 0, len);
+    log_init(stdout, log_level);
 
-    // Create socket with ACK Timer:
-    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-        error("Error: socket");
-    tv.tv_sec = ACK_TIMER_WAIT_TIME_MS / 1000;
-    tv.tv_usec = (ACK_TIMER_WAIT_TIME_MS % 1000) * 1000;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
+    // Reading input file, parsed ahead of the sender on a thread of its own:
+    request_reader_t *reader = malloc(sizeof(request_reader_t));
+    if (reader == NULL)
+        error("Error: Allocating request reader");
+    request_reader_open(reader, argv[optind]);
 
     // Filling server information
     server.sin_family = AF_INET;
@@ -79,95 +930,51 @@ int main(int argc, char *argv[])
         hp->h_length);
     server.sin_port = htons(port);
 
-    // Custom protocol's Subscriber Packets:
-    subscriber_packet_t subscriber_packet = {};
-    uint8_t subscriber_packet_size = sizeof(subscriber_packet);
-    SUBSCRIBER_PACKET_TYPE subscriber_status = DEFAULT_VALUE;
+    // Batch frames only if the server answers the probe, otherwise single packets:
+    if (batch_records > 0 && (batch_records = negotiate_batch(&server, batch_records)) == 0)
+        fprintf(stderr, "Server does not take batch frames, sending single packets\n");
 
-    // Loop through all the segments:
-    for (seg_no = 0; seg_no < seg_count; seg_no++)
-    {
-        // Read Client ID:
-        getline(&line, &len, fp);
-        client_id = atoi(line);
-        memset(line, 0, len);
-        // Read Input Segment Number:
-        getline(&line, &len, fp);
-        input_seg_no = atoi(line) % PACKET_GROUP_SIZE;
-        memset(line, 0, len);
-        // Read subscriber technology:
-        getline(&line, &len, fp);
-        technology = atoi(line);
-        memset(line, 0, len);
-        // Read source subscriber number (phone number):
-        getline(&line, &len, fp);
-        src_sub_no = (uint32_t)atoi(line);
-        memset(line, 0, len);
-
-        response_received = false;
-        // Retry up to 3 times, first time (0th) is the original packet
-        for (ack_timer_reset_count = 0; ack_timer_reset_count <= ACK_TIMER_RETRY_COUNT && !response_received; ack_timer_reset_count++)
-        {
-#ifdef DEBUGGING
-            printf("\n");
-#endif
-            if (ack_timer_reset_count == 0)
-            {
-                printf("Sending packet: %d\n", input_seg_no);
-                reset_subscriber_packet(&subscriber_packet);
-                update_subscriber_packet(&subscriber_packet, client_id, SUB_ACC_PER, input_seg_no, technology, src_sub_no);
-                if (!is_valid_subscriber_packet(&subscriber_packet))
-                    error("Error: Invalid subscriber packet\n");
-#ifdef DEBUGGING
-                else
-                    printf("subscriber packet formatted okay\n");
-                print_subscriber_packet(&subscriber_packet);
-#endif
-            }
-            else
-            {
-                printf("Error:\tACK_TIMER timed out!\nRetrying attempt %d\n", ack_timer_reset_count);
-            }
+    latency_histogram_t *rtt_histogram = malloc(sizeof(latency_histogram_t));
+    rtt_estimator_t rtt;
+    uint64_t start_ns = monotonic_time_ns();
+    if (rtt_histogram == NULL)
+        error("Error: Allocating window");
+    latency_histogram_init(rtt_histogram);
 
-            // Send message to server
-            n = sendto(sock, (const subscriber_packet_t *)&subscriber_packet,
-                       subscriber_packet_size, 0, (const struct sockaddr *)&server, length);
-            if (n < 0)
-                error("Error: Sendto");
+    if (protocol_version == SUBSCRIBER_PROTOCOL_VERSION)
+        request_no = run_clients_v2(reader, &server, client_count > 0 ? client_count : 1,
+                                    client_count > 0 ? socket_count : 1, window_size, adaptive_timer, rtt_histogram,
+                                    &answered, &unanswered, &rtt);
+    else if (client_count > 0)
+        request_no = run_clients(reader, &server, client_count, socket_count, window_size, adaptive_timer,
+                                 batch_records, rtt_histogram, &answered, &unanswered, &rtt);
+    else
+        request_no = run_client(reader, &server, window_size, adaptive_timer, batch_records, rtt_histogram,
+                                &answered, &unanswered, &rtt);
 
-            // Get response from server:
-            reset_subscriber_packet(&subscriber_packet);
-            n = recvfrom(sock, &subscriber_packet, subscriber_packet_size, 0, (struct sockaddr *)&recv_from, &length);
-            if (n == -1 && errno == EAGAIN)
-            {
-                if (ack_timer_reset_count == ACK_TIMER_RETRY_COUNT)
-                {
-                    printf("Server does not respond\n");
-                }
-                response_received = false;
-                continue;
-            }
-            else if (n < 0)
-                error("Error: Recvfrom");
-            response_received = true;
-            subscriber_status = subscriber_packet.packet_type;
-
-            // Print response from server:
-            printf("Server responded with subscriber status: 0x%04X\t", subscriber_status);
-            if (subscriber_status == SUB_NOT_PAID)
-                printf("%s\n", SUB_NOT_PAID_MSG);
-            else if (subscriber_status == SUB_NOT_EXIST)
-                printf("%s\n", SUB_NOT_EXIST_MSG);
-            else if (subscriber_status == SUB_ACC_OK)
-                printf("%s\n", SUB_ACC_OK_MSG);
-        }
-        printf("\n");
-    }
+    // Run summary on stderr, so stdout keeps the per-request transcript:
+    double elapsed = (monotonic_time_ns() - start_ns) / 1e9;
+    fprintf(stderr, "%llu requests, %llu answered, %llu unanswered in %.3f s (%.0f requests/s, ",
+            (unsigned long long)request_no, (unsigned long long)answered, (unsigned long long)unanswered,
+            elapsed, elapsed > 0 ? answered / elapsed : 0.0);
+    if (client_count > 0)
+        fprintf(stderr, "%u clients on %u socket%s, window %u each)\n", client_count, socket_count,
+                socket_count == 1 ? "" : "s", window_size);
+    else
+        fprintf(stderr, "window %u)\n", window_size);
+    if (batch_records > 0)
+        fprintf(stderr, "Batch frames of up to %u records\n", batch_records);
+    if (protocol_version == SUBSCRIBER_PROTOCOL_VERSION)
+        fprintf(stderr, "Protocol version 2, requests matched by sequence number\n");
+    latency_histogram_print(rtt_histogram, stderr, "RTT");
+    fprintf(stderr, "ACK timer%s: srtt %.1f us, rttvar %.1f us, timeout %.1f us (%s)\n",
+            client_count > 0 ? "s, mean over clients" : "", rtt.srtt_ns / 1e3, rtt.rttvar_ns / 1e3, rtt.rto_ns / 1e3,
+            adaptive_timer ? "adaptive" : "fixed");
 
     // Housekeeping:
-    fclose(fp);
-    if (line)
-        free(line);
-    close(sock);
+    free(rtt_histogram);
+    request_reader_close(reader);
+    free(reader);
+    log_shutdown();
     return EXIT_SUCCESS;
 }
@@ -14,181 +14,1511 @@
  */
 
 #include "customProtocol.h"
+#include "subscriberIndex.h"
+#include "subscriberStore.h"
+#include "packetBatch.h"
+#include "responseCache.h"
+#include "replayWindow.h"
+#include <pthread.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <linux/filter.h>
+
+// Receive batching: packets drained per recvmmsg() and answered per sendmmsg()
+#define DEFAULT_BATCH_SIZE 1
+#define MAX_BATCH_SIZE 1024
+// Bytes of a batch frame past the subscriber packet it is received into first
+#define BATCH_FRAME_TAIL_SIZE (BATCH_MAX_FRAME_SIZE - sizeof(subscriber_packet_t))
+#define THROUGHPUT_REPORT_INTERVAL_NS 5000000000ULL
+
+// Worker threads, each with its own SO_REUSEPORT socket per listener
+#define DEFAULT_WORKER_COUNT 1
+#define MAX_WORKER_COUNT 256
+
+// Event loop: listeners per server, events per epoll_wait(), and receive
+// calls per ready socket before moving on so one busy port can't starve others
+#define MAX_LISTENERS 16
+#define EPOLL_MAX_EVENTS 64
+#define DRAIN_BUDGET 64
+
+// Database thread: how often it checks for reload requests and due delta
+// log compactions, and how long a watched file must be quiet before it is reloaded
+#define RELOAD_POLL_MS 100
+#define RELOAD_SETTLE_NS 50000000ULL
+
+// Control socket (Unix datagram) messages
+#define CONTROL_MESSAGE_SIZE 256
+#define CONTROL_RESPONSE_SIZE 8192
+
+// Response log formats, indexed by status - SUB_NOT_PAID. The status text is
+// part of the format because the logger only copies integer arguments.
+static const char *const response_log_formats[] = {
+    "Responding with Subscriber status: 0x%04llX\t" SUB_NOT_PAID_MSG "\n",
+    "Responding with Subscriber status: 0x%04llX\t" SUB_NOT_EXIST_MSG "\n",
+    "Responding with Subscriber status: 0x%04llX\t" SUB_ACC_OK_MSG "\n",
+};
+
+// Set by SIGINT/SIGTERM, worker 0 then stops and flushes the log
+static volatile sig_atomic_t server_stopping = 0;
+// Set by SIGHUP, cleared by the database thread
+static volatile sig_atomic_t reload_requested = 0;
+
+// Per-worker counters, reported every THROUGHPUT_REPORT_INTERVAL_NS:
+typedef struct
+{
+    uint64_t packets;        // Since the last report
+    uint64_t batches;        // Receive calls since the last report
+    uint64_t total_packets;  // Since startup, read by the control socket
+    uint64_t window_start_ns;
+    uint64_t dropped[PACKET_VALIDATION_COUNT]; // Invalid packets by reason, since startup
+    uint64_t batch_frames;                     // Valid batch frames and the records they carried, since startup
+    uint64_t batch_records;
+    uint64_t v2_packets;                       // Valid version 2 requests, since startup
+    subscriber_filter_stats_t filter;          // Negative-lookup filter outcomes, since startup
+} server_stats_t;
+
+struct server;
+
+// Server worker: one thread and epoll set, one socket per listener, sharing the published database
+typedef struct
+{
+    unsigned int id;
+    unsigned int node; // NUMA node the worker is pinned to and reads the replica of, 0 without -N
+    int epoll_fd;
+    int socks[MAX_LISTENERS];
+    unsigned int sock_count;
+    unsigned int batch_size;
+    subscriber_store_t *store;                  // Reader id is the worker id
+    const subscriber_database_t *database; // Current generation, refreshed after every epoll_wait()
+    struct server *server;
+
+    // Receive batch, allocated once per worker. msgs[i] receives into packets[i],
+    // and the rest of a batch frame into frame_tails[i].
+    subscriber_packet_t *packets;
+    uint8_t *frame_tails; // BATCH_FRAME_TAIL_SIZE bytes per packet
+    struct sockaddr_in *clients;
+    struct iovec *iovecs; // Two per packet
+    struct mmsghdr *msgs;
+    struct mmsghdr *replies; // Headers of the answered requests, for sendmmsg()
+    uint32_t *packet_sizes;
+    PACKET_VALIDATION *validations;
+    SUBSCRIBER_PACKET_TYPE *statuses;
+    // Valid requests the response cache missed, looked up together:
+    subscriber_packet_t *lookups;
+    unsigned int *lookup_positions; // Index of each in packets
+    SUBSCRIBER_PACKET_TYPE *lookup_statuses;
+    // Valid requests as the replay window sees them, and which it answered:
+    replay_request_t *replay_requests;
+    bool *replayed;
+    // Version 2 requests of the batch, reassembled from packets[i] and its frame
+    // tail into packets_v2[i] and answered from there:
+    subscriber_packet_v2_t *packets_v2;
+    struct iovec *reply_iovecs;       // One per packet, over packets_v2[i]
+    unsigned int *v2_positions;       // Indexes in packets of this batch's version 2 requests
+    // Batch frame being answered, and its records as packets:
+    batch_frame_t frame;
+    subscriber_packet_t frame_packets[BATCH_MAX_RECORDS];
+    PACKET_VALIDATION frame_validations[BATCH_MAX_RECORDS];
+    SUBSCRIBER_PACKET_TYPE frame_statuses[BATCH_MAX_RECORDS];
+
+    response_cache_t cache; // Entries NULL without -C
+    replay_window_t replay; // Sets NULL without -D
+    server_stats_t stats;
+    pthread_t thread;
+} server_worker_t;
+
+// Server: the listening addresses and the workers serving them
+typedef struct server
+{
+    struct sockaddr_in listeners[MAX_LISTENERS];
+    unsigned int listener_count;
+    server_worker_t *workers;
+    unsigned int worker_count;
+    subscriber_store_t store;
+    const char *filename;   // Verification database, reloaded from the same path
+    bool watch;             // Reload when the file changes (-R)
+    int watch_fd;           // inotify descriptor with -R, otherwise -1
+    const char *watch_name; // Database file's name in the watched directory
+    uint64_t changed_ns;    // When the watched file last changed, 0 once reloaded
+    int control_sock;       // Served by the database thread, -1 without -c
+    numa_topology_t numa;   // Nodes workers are spread over with -N
+    bool numa_aware;        // -N: replicas per node, pinned workers, packets steered by CPU
+} server_t;
 
 /**
- * @brief Read in the verification database from file.
+ * @brief Count received packets and periodically print packets/sec.
  *
- * @param verification_database Pointer to the verification database.
- * @param filename string for the filename or path to the file.
- * @return uint8_t database size.
+ * @param worker worker whose counters to update
+ * @param packets packets received by the last receive call
  */
-uint8_t read_verification_database(verification_database_t verification_database[], char *filename)
+static void report_throughput(server_worker_t *worker, unsigned int packets)
 {
-    // Read in Verification Database from file's Variables:
-    // char *filename = "verification_database.txt";
-    FILE *fp;
-    char *line = NULL;
-    size_t len = 0;
-    uint8_t db_size = 0;
-
-    // Open file:
-    fp = fopen(filename, "r");
-    if (fp == NULL)
-    {
-        error("Error opening file");
-    }
+    server_stats_t *stats = &worker->stats;
+    uint64_t now = monotonic_time_ns();
 
-    // Read the nuumber of database entries:
-    getline(&line, &len, fp);
-    db_size = atoi(line);
-    memset(line, 0, len);
+    stats->packets += packets;
+    __atomic_store_n(&stats->total_packets, stats->total_packets + packets, __ATOMIC_RELAXED);
+    stats->batches++;
+    if (now - stats->window_start_ns < THROUGHPUT_REPORT_INTERVAL_NS)
+        return;
+    LOG_EVENT(LOG_LEVEL_INFO, "Worker %llu throughput: %llu packets/s (%llu.%llu packets per receive, %llu total)\n",
+              worker->id, stats->packets * 1000000000ULL / (now - stats->window_start_ns),
+              stats->packets / stats->batches, stats->packets * 10 / stats->batches % 10, stats->total_packets);
+    stats->packets = 0;
+    stats->batches = 0;
+    stats->window_start_ns = now;
+}
 
-    // Check against maximum database size:
-    if (db_size > VERIFICATION_DATABASE_SIZE)
-        error("ERROR: Database size exceeds maximum size\n");
+/**
+ * @brief Publish a worker's filter counters for the control socket.
+ *
+ * @param worker worker whose counters to update
+ * @param filter updated copy of worker->stats.filter
+ */
+static void record_filter_stats(server_worker_t *worker, const subscriber_filter_stats_t *filter)
+{
+    __atomic_store_n(&worker->stats.filter.checks, filter->checks, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->stats.filter.negatives, filter->negatives, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->stats.filter.false_positives, filter->false_positives, __ATOMIC_RELAXED);
+}
 
-    // Read in verification database entries:
-    for (int i = 0; i < db_size; i++)
+/**
+ * @brief Turn a validated and looked-up Access Permission request into the
+ *      response in place. Invalid requests are counted by reason and dropped.
+ *
+ * @param worker worker that received the request
+ * @param subscriber_packet received request, overwritten with the response
+ * @param packet_size datagram size as received
+ * @param validation result of check_subscriber_packet() on the request
+ * @param subscriber_status lookup result, ignored for invalid requests
+ * @return true to send the response, false to drop the request
+ */
+static bool respond_subscriber_packet(server_worker_t *worker, subscriber_packet_t *subscriber_packet, size_t packet_size,
+                                      PACKET_VALIDATION validation, SUBSCRIBER_PACKET_TYPE subscriber_status)
+{
+    LOG_TEXT(LOG_LEVEL_INFO, "\nReceived subscriber packet!\n");
+    if (validation != PACKET_VALID)
     {
-        // Read subscriber number (phone number):
-        getline(&line, &len, fp);
-        verification_database[i].src_sub_no = (uint32_t)atoi(line);
-        memset(line, 0, len);
+        uint64_t *dropped = &worker->stats.dropped[validation];
+        __atomic_store_n(dropped, *dropped + 1, __ATOMIC_RELAXED);
+        log_invalid_subscriber_packet(subscriber_packet, packet_size, validation);
+        return false;
+    }
+    LOG_TEXT(LOG_LEVEL_DEBUG, "Valid subscriber packet!\n");
+    log_subscriber_packet(subscriber_packet);
+    LOG_EVENT(LOG_LEVEL_INFO, response_log_formats[subscriber_status - SUB_NOT_PAID], subscriber_status);
 
-        // Read subscriber technology (2G - 5G):
-        getline(&line, &len, fp);
-        verification_database[i].technology = (SUBSCRIBER_TECHNOLOGY)atoi(line);
-        memset(line, 0, len);
+    // Set responding subscriber packet's status, the rest of the validated request is echoed:
+    subscriber_packet->packet_type = subscriber_status;
+    LOG_TEXT(LOG_LEVEL_DEBUG, "Valid response subscriber packet!\n");
+    log_subscriber_packet(subscriber_packet);
+    return true;
+}
 
-        // Read subscriber Paid status:
-        getline(&line, &len, fp);
-        verification_database[i].paid = (bool)atoi(line);
-        memset(line, 0, len);
+/**
+ * @brief respond_subscriber_packet() for a version 2 request.
+ *
+ * @param worker worker that received the request
+ * @param packet_v2 received request, overwritten with the response
+ * @param packet_size datagram size as received
+ * @param validation result of check_subscriber_packet_v2() on the request
+ * @param subscriber_status lookup result, ignored for invalid requests
+ * @return true to send the response, false to drop the request
+ */
+static bool respond_subscriber_packet_v2(server_worker_t *worker, subscriber_packet_v2_t *packet_v2, size_t packet_size,
+                                         PACKET_VALIDATION validation, SUBSCRIBER_PACKET_TYPE subscriber_status)
+{
+    LOG_TEXT(LOG_LEVEL_INFO, "\nReceived version 2 subscriber packet!\n");
+    if (validation != PACKET_VALID)
+    {
+        uint64_t *dropped = &worker->stats.dropped[validation];
+        __atomic_store_n(dropped, *dropped + 1, __ATOMIC_RELAXED);
+        log_invalid_subscriber_packet_v2(packet_v2, packet_size, validation);
+        return false;
     }
+    __atomic_store_n(&worker->stats.v2_packets, worker->stats.v2_packets + 1, __ATOMIC_RELAXED);
+    log_subscriber_packet_v2(packet_v2);
+    LOG_EVENT(LOG_LEVEL_INFO, response_log_formats[subscriber_status - SUB_NOT_PAID], subscriber_status);
+    packet_v2->packet_type = subscriber_status;
+    return true;
+}
 
-    // Housekeeping:
-    fclose(fp);
-    if (line)
-        free(line);
+/**
+ * @brief Validate one Access Permission request, verify the subscriber, and
+ *      turn the request into the response in place.
+ *
+ * @param worker worker that received the request
+ * @param subscriber_packet received request, overwritten with the response
+ * @param packet_size datagram size as received
+ * @param client sender's address, for the replay window
+ * @return true to send the response, false to drop the request
+ */
+static bool handle_subscriber_packet(server_worker_t *worker, subscriber_packet_t *subscriber_packet, size_t packet_size,
+                                     const struct sockaddr_in *client)
+{
+    PACKET_VALIDATION validation = check_subscriber_packet(subscriber_packet, packet_size);
+    SUBSCRIBER_PACKET_TYPE subscriber_status = SUB_NOT_EXIST;
+    replay_request_t request;
 
-    return db_size;
+    // Verify subscriber by checking database, definite misses answered by the
+    // filter, retransmissions by the replay window, repeated requests by the
+    // response cache:
+    if (validation == PACKET_VALID)
+    {
+        const subscriber_database_t *database = worker->database;
+        subscriber_filter_stats_t filter = worker->stats.filter;
+        if (worker->replay.sets)
+        {
+            replay_request_v1(&request, client, subscriber_packet);
+            replay_window_sync(&worker->replay, database->generation, subscriber_store_version(worker->store));
+            if (replay_window_find(&worker->replay, &request, &subscriber_status))
+                return respond_subscriber_packet(worker, subscriber_packet, packet_size, validation, subscriber_status);
+        }
+        if (worker->cache.entries)
+            response_cache_sync(&worker->cache, database->generation, subscriber_store_version(worker->store));
+        if (!worker->cache.entries || !response_cache_find(&worker->cache, subscriber_packet, &subscriber_status))
+        {
+            if (database->packed.entries)
+                subscriber_status = subscriber_filter_lookup_table(&database->filter, &database->packed, &database->index,
+                                                                   subscriber_packet->src_sub_no,
+                                                                   subscriber_packet->technology, &filter);
+            else
+                subscriber_status = subscriber_filter_lookup(&database->filter, &database->index,
+                                                             subscriber_packet->src_sub_no, subscriber_packet->technology,
+                                                             &filter);
+            record_filter_stats(worker, &filter);
+            if (worker->cache.entries)
+                response_cache_insert(&worker->cache, subscriber_packet, subscriber_status);
+        }
+        if (worker->replay.sets)
+            replay_window_insert(&worker->replay, &request, subscriber_status);
+    }
+    return respond_subscriber_packet(worker, subscriber_packet, packet_size, validation, subscriber_status);
 }
 
 /**
- * @brief Main function (Driver code)
+ * @brief Look up a validated batch in the current generation, prefetched.
+ *      With the replay window, retransmitted requests are answered from it,
+ *      and every other valid request's response is remembered there. With
+ *      the response cache, only the valid requests it misses are looked up,
+ *      and their responses are cached.
  *
- * @param argc number of arguments
- * @param argv arguments
- * @return int 0 if successful
+ * @param worker worker looking up
+ * @param packets requests, a receive batch or a batch frame's records
+ * @param validations check_subscriber_packet() result of each request
+ * @param results set to each valid request's status
+ * @param requests each valid request as the replay window sees it, NULL to bypass the window
+ * @param n number of requests
  */
-int main(int argc, char *argv[])
+static void lookup_subscriber_packets(server_worker_t *worker, const subscriber_packet_t *packets,
+                                      const PACKET_VALIDATION *validations, SUBSCRIBER_PACKET_TYPE *results,
+                                      const replay_request_t *requests, unsigned int n)
 {
-    // Define variables
-    int sock, length, n, port;
-    socklen_t clientlen;
-    struct sockaddr_in server, client;
-    char *filename;
+    const subscriber_database_t *database = worker->database;
+    subscriber_filter_stats_t filter = worker->stats.filter;
+    SUBSCRIBER_PACKET_TYPE *statuses = results;
+    unsigned int count = n, misses = 0;
 
-    // Checking if port number is provided
-    if (argc == 1)
+    if (worker->replay.sets == NULL)
+        requests = NULL;
+    if (requests)
     {
-        port = PORT;
-        filename = "./input_files/verification_database.txt"; // Specificed by instruction
+        replay_window_sync(&worker->replay, database->generation, subscriber_store_version(worker->store));
+        for (unsigned int i = 0; i < n; i++)
+            if (validations[i] == PACKET_VALID)
+                replay_window_prefetch(&worker->replay, &requests[i]);
+        for (unsigned int i = 0; i < n; i++)
+            if (validations[i] == PACKET_VALID)
+                replay_window_prefetch_ring(&worker->replay, &requests[i]);
+        for (unsigned int i = 0; i < n; i++)
+            worker->replayed[i] =
+                validations[i] == PACKET_VALID && replay_window_find(&worker->replay, &requests[i], &results[i]);
     }
-    else if (argc == 2)
-        port = atoi(argv[1]);
-    else if (argc == 3)
+    if (worker->cache.entries || requests)
     {
-        port = atoi(argv[1]);
-        filename = argv[2];
+        if (worker->cache.entries)
+            response_cache_sync(&worker->cache, database->generation, subscriber_store_version(worker->store));
+        for (unsigned int i = 0; i < n; i++)
+            if (validations[i] == PACKET_VALID && !(requests && worker->replayed[i]) &&
+                !(worker->cache.entries && response_cache_find(&worker->cache, &packets[i], &statuses[i])))
+            {
+                worker->lookups[misses] = packets[i];
+                worker->lookup_positions[misses++] = i;
+            }
+        packets = worker->lookups;
+        statuses = worker->lookup_statuses;
+        n = misses;
     }
+    if (database->packed.entries)
+        subscriber_table_lookup_batch(&database->filter, &database->packed, &database->index, packets, statuses, n,
+                                      &filter);
     else
+        subscriber_filter_lookup_batch(&database->filter, &database->index, packets, statuses, n, &filter);
+    record_filter_stats(worker, &filter);
+    for (unsigned int m = 0; m < misses; m++)
     {
-        fprintf(stderr, "ERROR: no port & verification_database-filename provided\n");
-        exit(EXIT_FAILURE);
+        results[worker->lookup_positions[m]] = statuses[m];
+        if (worker->cache.entries)
+            response_cache_insert(&worker->cache, &packets[m], statuses[m]);
     }
+    // Cache hits are remembered too, so their retransmissions skip the cache
+    if (requests)
+        for (unsigned int i = 0; i < count; i++)
+            if (validations[i] == PACKET_VALID && !worker->replayed[i])
+                replay_window_insert(&worker->replay, &requests[i], results[i]);
+}
 
-    // Creating socket file descriptor
-    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-        error("ERROR: Opening socket");
+/**
+ * @brief Validate one version 2 request, verify the subscriber as the
+ *      subscriber packet it stands for, and turn the request into the
+ *      response in place.
+ *
+ * @param worker worker that received the request
+ * @param packet_v2 received request, overwritten with the response
+ * @param packet_size datagram size as received
+ * @param client sender's address, for the replay window
+ * @return true to send the response, false to drop the request
+ */
+static bool handle_subscriber_packet_v2(server_worker_t *worker, subscriber_packet_v2_t *packet_v2, size_t packet_size,
+                                        const struct sockaddr_in *client)
+{
+    PACKET_VALIDATION validation = check_subscriber_packet_v2(packet_v2, packet_size);
+    SUBSCRIBER_PACKET_TYPE subscriber_status = SUB_NOT_EXIST;
+    subscriber_packet_t packet;
+    replay_request_t request;
 
-    // Filling server information
-    length = sizeof(server);
-    bzero(&server, length); // memset(&servaddr, 0, length);
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(port);
+    if (validation == PACKET_VALID)
+    {
+        subscriber_packet_from_v2(packet_v2, &packet);
+        replay_request_v2(&request, client, packet_v2);
+        lookup_subscriber_packets(worker, &packet, &validation, &subscriber_status, &request, 1);
+    }
+    return respond_subscriber_packet_v2(worker, packet_v2, packet_size, validation, subscriber_status);
+}
 
-    // Bind the socket with the server address
-    if (bind(sock, (struct sockaddr *)&server, length) < 0)
-        error("ERROR: binding");
+/**
+ * @brief Answer the batch frame in worker->frame in place: validate it, then
+ *      validate, look up and answer each of its records as a request. A probe
+ *      (no records) is answered with the records per frame this server takes.
+ *      Invalid records are counted and logged like invalid packets, and get
+ *      status 0 in the response.
+ *
+ * @param worker worker that received the frame
+ * @param frame_size datagram size as received
+ * @param client sender's address, for the replay window
+ * @return size_t size of the response frame, 0 to drop the frame
+ */
+static size_t handle_batch_frame(server_worker_t *worker, size_t frame_size, const struct sockaddr_in *client)
+{
+    batch_frame_t *frame = &worker->frame;
+    PACKET_VALIDATION validation = check_batch_frame(frame, frame_size, false);
+    unsigned int count = frame->count;
 
-    // Initializing client
-    clientlen = sizeof(client);
-    bzero(&client, clientlen);
+    LOG_EVENT(LOG_LEVEL_INFO, "\nReceived batch frame of %llu records!\n", count);
+    if (validation != PACKET_VALID)
+    {
+        uint64_t *dropped = &worker->stats.dropped[validation];
+        __atomic_store_n(dropped, *dropped + 1, __ATOMIC_RELAXED);
+        log_invalid_batch_frame(frame, frame_size, validation);
+        return 0;
+    }
+    __atomic_store_n(&worker->stats.batch_frames, worker->stats.batch_frames + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->stats.batch_records, worker->stats.batch_records + count, __ATOMIC_RELAXED);
 
-    // Initializing verification database
-    verification_database_t verification_database[VERIFICATION_DATABASE_SIZE] = {};
-    uint8_t db_size = read_verification_database(verification_database, filename);
+    for (unsigned int r = 0; r < count; r++)
+    {
+        batch_frame_packet(frame, r, &worker->frame_packets[r]);
+        worker->frame_validations[r] = check_subscriber_packet(&worker->frame_packets[r], sizeof(subscriber_packet_t));
+        replay_request_v1(&worker->replay_requests[r], client, &worker->frame_packets[r]);
+    }
+    lookup_subscriber_packets(worker, worker->frame_packets, worker->frame_validations, worker->frame_statuses,
+                              worker->replay_requests, count);
+    for (unsigned int r = 0; r < count; r++)
+        frame->records[r].status =
+            respond_subscriber_packet(worker, &worker->frame_packets[r], sizeof(subscriber_packet_t),
+                                      worker->frame_validations[r], worker->frame_statuses[r])
+                ? (uint8_t)(worker->frame_statuses[r] - SUB_ACC_PER)
+                : DEFAULT_VALUE;
 
-#ifdef PRINT_DATABASE
-    // Print out Verification Database:
-    print_verification_database(verification_database, db_size);
-#endif
+    frame->flags = BATCH_FLAG_RESPONSE;
+    frame->max_records = count == 0 ? BATCH_MAX_RECORDS : DEFAULT_VALUE;
+    return finish_batch_frame(frame);
+}
+
+/**
+ * @brief Send the response frame in worker->frame.
+ *
+ * @param worker worker that answered the frame
+ * @param sock server socket
+ * @param client client address
+ * @param clientlen client address size
+ * @param frame_size response size
+ */
+static void send_batch_frame(server_worker_t *worker, int sock, const struct sockaddr *client, socklen_t clientlen,
+                             size_t frame_size)
+{
+    // Dropped if the send buffer is full, like single responses
+    if (sendto(sock, &worker->frame, frame_size, 0, client, clientlen) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        error("ERROR: sendto");
+}
 
-    // Custom protocol's Subscriber Packets:
+/**
+ * @brief Serve the requests queued on a ready socket, one per
+ *      recvfrom()/sendto() pair, until it would block or the budget is spent.
+ *      A batch frame or a version 2 packet is one request here too.
+ *
+ * @param worker worker serving the socket
+ * @param sock non-blocking server socket
+ */
+static void drain_single(server_worker_t *worker, int sock)
+{
     subscriber_packet_t subscriber_packet = {};
     uint8_t subscriber_packet_size = sizeof(subscriber_packet);
-    SUBSCRIBER_PACKET_TYPE subscriber_status = DEFAULT_VALUE;
+    batch_frame_t *frame = &worker->frame;
+    struct sockaddr_in client;
+    socklen_t clientlen;
+    size_t frame_size;
+    int n;
 
-    // Server runs forever, I guess
-    while (1)
+    for (int budget = DRAIN_BUDGET; budget > 0; budget--)
     {
-        // Receive Access Permission request Subscriber Packet:
-        memset(&subscriber_packet, DEFAULT_VALUE, subscriber_packet_size);
-        n = recvfrom(sock, &subscriber_packet, subscriber_packet_size,
-                     0, (struct sockaddr *)&client, &clientlen);
+        // Receive Access Permission request Subscriber Packet or batch frame, MSG_TRUNC returns the real size of oversized ones:
+        memset(frame, DEFAULT_VALUE, subscriber_packet_size);
+        clientlen = sizeof(client);
+        n = recvfrom(sock, frame, BATCH_MAX_FRAME_SIZE,
+                     MSG_TRUNC, (struct sockaddr *)&client, &clientlen);
         if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR)
+                continue;
             error("ERROR: recvfrom");
-        printf("\nReceived subscriber packet!\n");
-        if (!is_valid_subscriber_packet(&subscriber_packet))
-            error("ERROR: Invalid subscriber packet!\n");
-#ifdef DEBUGGING
-        else
-            printf("Valid subscriber packet!\n");
-        print_subscriber_packet(&subscriber_packet);
-#endif
-
-        // Verify subscriber by checking database:
-        subscriber_status = verify_subscriber(
-            verification_database, db_size, &subscriber_packet);
-        printf("Responding with Subscriber status: 0x%04X\t", subscriber_status);
-        if (subscriber_status == SUB_NOT_PAID)
-            printf("%s\n", SUB_NOT_PAID_MSG);
-        else if (subscriber_status == SUB_NOT_EXIST)
-            printf("%s\n", SUB_NOT_EXIST_MSG);
-        else if (subscriber_status == SUB_ACC_OK)
-            printf("%s\n", SUB_ACC_OK_MSG);
-
-        // Set responding subscriber packet's status:
-        subscriber_packet.packet_type = subscriber_status;
-
-        // Checking responding subscriber response integrity:
-        if (!is_valid_subscriber_packet(&subscriber_packet))
-            error("ERROR: Invalid response subscriber packet!\n");
-#ifdef DEBUGGING
-        else
-            printf("Valid response subscriber packet!\n");
-        print_subscriber_packet(&subscriber_packet);
-#endif
+        }
+        report_throughput(worker, 1);
 
-        // Sending Subscriber status response back to Client
+        if (n != subscriber_packet_size && is_batch_frame(frame, n))
+        {
+            if ((frame_size = handle_batch_frame(worker, n, &client)) > 0)
+                send_batch_frame(worker, sock, (const struct sockaddr *)&client, clientlen, frame_size);
+            continue;
+        }
+        if (is_subscriber_packet_v2(frame, n))
+        {
+            // The frame buffer holds the whole version 2 packet, answered from there
+            subscriber_packet_v2_t *packet_v2 = (subscriber_packet_v2_t *)frame;
+            if (handle_subscriber_packet_v2(worker, packet_v2, n, &client) &&
+                sendto(sock, packet_v2, sizeof(*packet_v2), 0, (const struct sockaddr *)&client, clientlen) < 0 &&
+                errno != EAGAIN && errno != EWOULDBLOCK)
+                error("ERROR: sendto");
+            continue;
+        }
+        memcpy(&subscriber_packet, frame, subscriber_packet_size);
+        if (!handle_subscriber_packet(worker, &subscriber_packet, n, &client))
+            continue;
+
+        // Sending Subscriber status response back to Client, dropped if the send buffer is full
         n = sendto(sock, &subscriber_packet, subscriber_packet_size,
                    0, (const struct sockaddr *)&client, clientlen);
-        if (n < 0)
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
             error("ERROR: sendto");
     }
+}
+
+/**
+ * @brief Take in a version 2 request of the receive batch: reassemble it into
+ *      packets_v2[i], validate it, and put the subscriber packet it stands for
+ *      in packets[i], so it is looked up with the rest of the batch. The
+ *      replay window sees it by its own client ID and sequence number.
+ *
+ * @param worker worker that received the batch
+ * @param i index of the request in the batch
+ * @param position how many version 2 requests come before it in the batch
+ */
+static void receive_packet_v2(server_worker_t *worker, unsigned int i, unsigned int position)
+{
+    subscriber_packet_v2_t *packet_v2 = &worker->packets_v2[i];
+
+    memcpy(packet_v2, &worker->packets[i], sizeof(subscriber_packet_t));
+    memcpy((uint8_t *)packet_v2 + sizeof(subscriber_packet_t), worker->frame_tails + (size_t)i * BATCH_FRAME_TAIL_SIZE,
+           sizeof(subscriber_packet_v2_t) - sizeof(subscriber_packet_t));
+    worker->validations[i] = check_subscriber_packet_v2(packet_v2, worker->packet_sizes[i]);
+    if (worker->validations[i] == PACKET_VALID)
+    {
+        subscriber_packet_from_v2(packet_v2, &worker->packets[i]);
+        replay_request_v2(&worker->replay_requests[i], &worker->clients[i], packet_v2);
+    }
+    worker->v2_positions[position] = i;
+}
+
+/**
+ * @brief Serve the requests queued on a ready socket in batches: drain up to
+ *      batch_size datagrams with one recvmmsg(), validate them together (SIMD)
+ *      and look them up together (prefetched), and reply with one sendmmsg().
+ *      Each response reuses its request's buffer and client address. Batch
+ *      frames in the batch are answered with a sendto() each. Version 2
+ *      requests are looked up and answered with the rest. Stops when the
+ *      socket would block or the budget is spent.
+ *
+ * @param worker worker serving the socket, batch_size is the maximum datagrams per system call
+ * @param sock non-blocking server socket
+ */
+static void drain_batched(server_worker_t *worker, int sock)
+{
+    unsigned int batch_size = worker->batch_size;
+    struct mmsghdr *msgs = worker->msgs;
+    unsigned int v2_count, v2_next;
+    int n, sent, responses;
+
+    for (int budget = DRAIN_BUDGET; budget > 0; budget--)
+    {
+        for (unsigned int i = 0; i < batch_size; i++)
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+
+        n = recvmmsg(sock, msgs, batch_size, MSG_TRUNC, NULL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR)
+                continue;
+            error("ERROR: recvmmsg");
+        }
+        report_throughput(worker, n);
+
+        // Validate and look up the whole batch, then answer in place
+        for (int i = 0; i < n; i++)
+            worker->packet_sizes[i] = msgs[i].msg_len;
+        check_subscriber_packets(worker->packets, worker->packet_sizes, worker->validations, n);
+        v2_count = 0;
+        for (int i = 0; i < n; i++)
+            if (is_subscriber_packet_v2(&worker->packets[i], worker->packet_sizes[i]))
+                receive_packet_v2(worker, i, v2_count++);
+            else if (worker->replay.sets)
+                replay_request_v1(&worker->replay_requests[i], &worker->clients[i], &worker->packets[i]);
+        lookup_subscriber_packets(worker, worker->packets, worker->validations, worker->statuses,
+                                  worker->replay_requests, n);
+        responses = 0;
+        v2_next = 0;
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t packet_size = worker->packet_sizes[i];
+
+            // Version 2 requests are answered from their own buffer
+            if (v2_next < v2_count && worker->v2_positions[v2_next] == (unsigned int)i)
+            {
+                v2_next++;
+                if (respond_subscriber_packet_v2(worker, &worker->packets_v2[i], packet_size, worker->validations[i],
+                                                 worker->statuses[i]))
+                {
+                    worker->replies[responses] = msgs[i];
+                    worker->replies[responses].msg_hdr.msg_iov = &worker->reply_iovecs[i];
+                    worker->replies[responses++].msg_hdr.msg_iovlen = 1;
+                }
+                continue;
+            }
+
+            // Batch frames are answered on their own, the rest of the batch with sendmmsg()
+            if (packet_size != sizeof(subscriber_packet_t) && is_batch_frame(&worker->packets[i], packet_size))
+            {
+                size_t frame_size = packet_size < BATCH_MAX_FRAME_SIZE ? packet_size : BATCH_MAX_FRAME_SIZE;
+                memcpy(&worker->frame, &worker->packets[i], sizeof(subscriber_packet_t));
+                if (frame_size > sizeof(subscriber_packet_t)) // A probe fits in the packet buffer
+                    memcpy((uint8_t *)&worker->frame + sizeof(subscriber_packet_t),
+                           worker->frame_tails + (size_t)i * BATCH_FRAME_TAIL_SIZE, frame_size - sizeof(subscriber_packet_t));
+                if ((frame_size = handle_batch_frame(worker, packet_size, &worker->clients[i])) > 0)
+                    send_batch_frame(worker, sock, msgs[i].msg_hdr.msg_name, msgs[i].msg_hdr.msg_namelen, frame_size);
+                continue;
+            }
+            if (respond_subscriber_packet(worker, &worker->packets[i], packet_size, worker->validations[i],
+                                          worker->statuses[i]))
+            {
+                // The response is the request's buffer only, without the frame tail
+                worker->replies[responses] = msgs[i];
+                worker->replies[responses++].msg_hdr.msg_iovlen = 1;
+            }
+        }
+
+        // Sending Subscriber status responses back to Clients, the rest are dropped if the send buffer is full
+        for (sent = 0; sent < responses;)
+        {
+            int r = sendmmsg(sock, worker->replies + sent, responses - sent, 0);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                error("ERROR: sendmmsg");
+            }
+            sent += r;
+        }
+
+        // A short batch means the queue is empty
+        if ((unsigned int)n < batch_size)
+            return;
+    }
+}
+
+/**
+ * @brief Worker thread entry point: wait on the worker's sockets with epoll
+ *      and serve whichever are ready, until the server is stopped.
+ *
+ * @param arg server_worker_t to run
+ * @return void* NULL
+ */
+static void *run_worker(void *arg)
+{
+    server_worker_t *worker = arg;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int n;
+
+    worker->stats.window_start_ns = monotonic_time_ns();
+    while (!server_stopping)
+    {
+        // Offline while blocked so a reload never waits for an idle worker.
+        // Back online, serve this round from the current generation.
+        subscriber_store_offline(worker->store, worker->id);
+        n = epoll_wait(worker->epoll_fd, events, EPOLL_MAX_EVENTS, -1);
+        subscriber_store_online(worker->store, worker->id);
+        worker->database = subscriber_store_read_node(worker->store, worker->node);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error("ERROR: epoll_wait");
+        }
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (worker->batch_size > 1)
+                drain_batched(worker, fd);
+            else
+                drain_single(worker, fd);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief SIGINT/SIGTERM handler.
+ *
+ * @param signo signal number
+ */
+static void stop_server(int signo)
+{
+    (void)signo;
+    server_stopping = 1;
+}
+
+/**
+ * @brief SIGHUP handler, asks the database thread to reload the database.
+ *
+ * @param signo signal number
+ */
+static void request_reload(int signo)
+{
+    (void)signo;
+    reload_requested = 1;
+}
+
+/**
+ * @brief Load the database file again, replay the delta log onto it, and
+ *      publish it. Workers keep serving the old generation until they next
+ *      return from epoll_wait(); it is freed once all of them have. A file
+ *      that can't be loaded, or holds no subscribers, is not published.
+ *
+ * @param server server whose database to replace
+ * @return true if reloaded
+ */
+static bool reload_database(server_t *server)
+{
+    const subscriber_database_t *database = subscriber_store_reload(&server->store);
+
+    if (database == NULL)
+    {
+        LOG_EVENT(LOG_LEVEL_WARN, "Reload failed, still serving generation %llu\n",
+                  subscriber_store_read(&server->store)->generation);
+        return false;
+    }
+    LOG_EVENT(LOG_LEVEL_INFO, "Reloaded %llu subscribers (generation %llu) in %llu.%03llu ms\n", database->db_size,
+              database->generation, database->load_ns / 1000000, database->load_ns / 1000 % 1000);
+    return true;
+}
+
+/**
+ * @brief Read the pending inotify events of a database watch.
+ *
+ * @param fd inotify descriptor, -1 without a watch
+ * @param name database file's name within the watched directory
+ * @param own_temp_name temporary file the server itself renamed over the
+ *      database file, whose rename is not a change, or NULL
+ * @return true if the database file changed
+ */
+static bool read_watch_events(int fd, const char *name, const char *own_temp_name)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    uint32_t own_cookie = 0;
+    bool changed = false;
+    ssize_t n;
+
+    if (fd < 0)
+        return false;
+    while ((n = read(fd, events, sizeof(events))) > 0)
+        for (char *p = events; p < events + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len == 0)
+                continue;
+            // A rename is reported as IN_MOVED_FROM then IN_MOVED_TO, sharing a cookie
+            if (event->mask & IN_MOVED_FROM)
+            {
+                if (own_temp_name && strcmp(event->name, own_temp_name) == 0)
+                    own_cookie = event->cookie;
+            }
+            else if (strcmp(event->name, name) == 0 && !(own_cookie && event->cookie == own_cookie))
+                changed = true;
+        }
+    return changed;
+}
+
+/**
+ * @brief Whether a reload is due or waiting for the watched file to settle.
+ *
+ * @param server server whose database to check
+ * @return true if a reload is pending
+ */
+static bool reload_pending(const server_t *server)
+{
+    return reload_requested || server->changed_ns != 0;
+}
+
+/**
+ * @brief Compact the delta log into the database file. A pending reload goes
+ *      first, as compacting would replace a file changed by someone else;
+ *      until the changed file has settled and been reloaded, nothing is
+ *      compacted.
+ *
+ * @param server server whose database to compact
+ * @return true if compacted
+ */
+static bool compact_database(server_t *server)
+{
+    uint64_t records = server->store.log_records, start;
+    char own_temp_name[NAME_MAX + 1];
+
+    if (read_watch_events(server->watch_fd, server->watch_name, NULL))
+        server->changed_ns = monotonic_time_ns();
+    if (server->changed_ns)
+    {
+        LOG_TEXT(LOG_LEVEL_WARN, "Database file changed, compacting after it is reloaded\n");
+        return false;
+    }
+    if (reload_requested)
+    {
+        reload_requested = 0;
+        if (!reload_database(server))
+            return false;
+    }
+
+    start = monotonic_time_ns();
+    if (!subscriber_store_compact(&server->store))
+    {
+        LOG_EVENT(LOG_LEVEL_WARN, "Compacting %llu delta records failed, the log is kept\n", records);
+        return false;
+    }
+    LOG_EVENT(LOG_LEVEL_INFO, "Compacted %llu delta records into %llu subscribers (generation %llu) in %llu ms\n", records,
+              subscriber_store_read(&server->store)->db_size, subscriber_store_read(&server->store)->generation,
+              (monotonic_time_ns() - start) / 1000000);
+    // Our own rename of the database file is not a change, anything else still is
+    snprintf(own_temp_name, sizeof(own_temp_name), "%s.tmp", server->watch_name ? server->watch_name : "");
+    if (read_watch_events(server->watch_fd, server->watch_name, own_temp_name))
+        server->changed_ns = monotonic_time_ns();
+    return true;
+}
+
+/**
+ * @brief Answer one command on the control socket. Commands:
+ *      stats           per-worker and total packet counters, batch frames and
+ *                      their records, version 2 requests, dropped packets by reason, the
+ *                      database generation being served, with
+ *                      -N each node's replica and how much of it is local,
+ *                      with -C the response cache's hits and misses, and
+ *                      with -D the duplicates the replay window answered
+ *      level <name>    set the log level: off, error, warn, info or debug
+ *      reload          reload the verification database
+ *      insert <src_sub_no> <technology> <paid>
+ *                      add a subscriber, or replace an existing one
+ *      paid <src_sub_no> <technology> <paid>
+ *                      set an existing subscriber's paid status (0 or 1)
+ *      delete <src_sub_no> <technology>
+ *                      remove a subscriber
+ *      compact         write the delta log into the database file now
+ *      Runs on the database thread, so updates never stall the workers.
+ *
+ * @param server server owning the control socket
+ */
+static void handle_control(server_t *server)
+{
+    char message[CONTROL_MESSAGE_SIZE], response[CONTROL_RESPONSE_SIZE];
+    struct sockaddr_un peer;
+    socklen_t peerlen = sizeof(peer);
+    size_t used = 0;
+    ssize_t n;
+
+    n = recvfrom(server->control_sock, message, sizeof(message) - 1, 0, (struct sockaddr *)&peer, &peerlen);
+    if (n < 0)
+        return;
+    message[n] = '\0';
+    message[strcspn(message, "\r\n")] = '\0';
+
+    subscriber_delta_t delta;
+    if (strcmp(message, "stats") == 0)
+    {
+        uint64_t total = 0;
+        for (unsigned int i = 0; i < server->worker_count && used < sizeof(response); i++)
+        {
+            uint64_t packets = __atomic_load_n(&server->workers[i].stats.total_packets, __ATOMIC_RELAXED);
+            total += packets;
+            used += snprintf(response + used, sizeof(response) - used, "worker %u packets %llu\n",
+                             i, (unsigned long long)packets);
+        }
+        if (used < sizeof(response))
+            used += snprintf(response + used, sizeof(response) - used, "total packets %llu\n",
+                             (unsigned long long)total);
+        uint64_t frames = 0, records = 0, v2_packets = 0;
+        for (unsigned int i = 0; i < server->worker_count; i++)
+        {
+            frames += __atomic_load_n(&server->workers[i].stats.batch_frames, __ATOMIC_RELAXED);
+            records += __atomic_load_n(&server->workers[i].stats.batch_records, __ATOMIC_RELAXED);
+            v2_packets += __atomic_load_n(&server->workers[i].stats.v2_packets, __ATOMIC_RELAXED);
+        }
+        if (used < sizeof(response))
+            used += snprintf(response + used, sizeof(response) - used, "batch frames %llu records %llu\n",
+                             (unsigned long long)frames, (unsigned long long)records);
+        if (used < sizeof(response))
+            used += snprintf(response + used, sizeof(response) - used, "version 2 packets %llu\n",
+                             (unsigned long long)v2_packets);
+        for (unsigned int reason = PACKET_VALID + 1; reason < PACKET_VALIDATION_COUNT && used < sizeof(response); reason++)
+        {
+            uint64_t dropped = 0;
+            for (unsigned int i = 0; i < server->worker_count; i++)
+                dropped += __atomic_load_n(&server->workers[i].stats.dropped[reason], __ATOMIC_RELAXED);
+            used += snprintf(response + used, sizeof(response) - used, "dropped %s %llu\n",
+                             packet_validation_name(reason), (unsigned long long)dropped);
+        }
+        const subscriber_database_t *database = subscriber_store_read(&server->store);
+        if (used < sizeof(response))
+            used += snprintf(response + used, sizeof(response) - used,
+                             "database generation %llu subscribers %zu delta_records %llu\n",
+                             (unsigned long long)database->generation, database->db_size,
+                             (unsigned long long)server->store.log_records);
+        if (database->packed.entries && used < sizeof(response))
+            used += snprintf(response + used, sizeof(response) - used,
+                             "packed bytes %zu entry_bits %u overlay_bytes %zu overlay_subscribers %llu\n",
+                             subscriber_table_memory_bytes(&database->packed), database->packed.entry_bits,
+                             subscriber_index_memory_bytes(&database->index), (unsigned long long)database->index.count);
+        for (unsigned int node = 0; server->numa_aware && node < server->numa.node_count && used < sizeof(response); node++)
+        {
+            const subscriber_database_t *replica = subscriber_store_read_node(&server->store, node);
+            unsigned int workers = 0;
+            for (unsigned int i = 0; i < server->worker_count; i++)
+                workers += server->workers[i].node == node;
+            // Placement of the largest lookup structure, which most lookups miss in
+            used += snprintf(response + used, sizeof(response) - used,
+                             "numa node %u kernel_node %d workers %u replica_bytes %zu local_pages_percent %d\n", node,
+                             server->numa.ids[node], workers, subscriber_database_lookup_bytes(replica),
+                             replica->packed.entries
+                                 ? numa_topology_local_percent(&server->numa, node, replica->packed.entries,
+                                                               subscriber_table_memory_bytes(&replica->packed))
+                                 : numa_topology_local_percent(&server->numa, node, replica->index.slots,
+                                                               subscriber_index_memory_bytes(&replica->index)));
+        }
+        if (server->workers[0].cache.entries && used < sizeof(response))
+        {
+            response_cache_stats_t cache = {0};
+            for (unsigned int i = 0; i < server->worker_count; i++)
+            {
+                cache.hits += __atomic_load_n(&server->workers[i].cache.stats.hits, __ATOMIC_RELAXED);
+                cache.misses += __atomic_load_n(&server->workers[i].cache.stats.misses, __ATOMIC_RELAXED);
+                cache.invalidations += __atomic_load_n(&server->workers[i].cache.stats.invalidations, __ATOMIC_RELAXED);
+            }
+            used += snprintf(response + used, sizeof(response) - used,
+                             "response_cache entries %llu hits %llu misses %llu invalidations %llu hit_rate %.4f\n",
+                             (unsigned long long)(server->workers[0].cache.set_count * RESPONSE_CACHE_WAYS),
+                             (unsigned long long)cache.hits, (unsigned long long)cache.misses,
+                             (unsigned long long)cache.invalidations,
+                             cache.hits + cache.misses ? (double)cache.hits / (cache.hits + cache.misses) : 0.0);
+        }
+        if (server->workers[0].replay.sets && used < sizeof(response))
+        {
+            replay_window_stats_t replay = {0};
+            for (unsigned int i = 0; i < server->worker_count; i++)
+            {
+                replay.hits += __atomic_load_n(&server->workers[i].replay.stats.hits, __ATOMIC_RELAXED);
+                replay.misses += __atomic_load_n(&server->workers[i].replay.stats.misses, __ATOMIC_RELAXED);
+                replay.evictions += __atomic_load_n(&server->workers[i].replay.stats.evictions, __ATOMIC_RELAXED);
+            }
+            used += snprintf(response + used, sizeof(response) - used,
+                             "replay_window clients %llu duplicates %llu misses %llu evictions %llu\n",
+                             (unsigned long long)(server->workers[0].replay.set_count * REPLAY_WINDOW_WAYS),
+                             (unsigned long long)replay.hits, (unsigned long long)replay.misses,
+                             (unsigned long long)replay.evictions);
+        }
+        if (server->store.filter && used < sizeof(response))
+        {
+            subscriber_filter_stats_t filter = {0};
+            for (unsigned int i = 0; i < server->worker_count; i++)
+            {
+                filter.checks += __atomic_load_n(&server->workers[i].stats.filter.checks, __ATOMIC_RELAXED);
+                filter.negatives += __atomic_load_n(&server->workers[i].stats.filter.negatives, __ATOMIC_RELAXED);
+                filter.false_positives += __atomic_load_n(&server->workers[i].stats.filter.false_positives, __ATOMIC_RELAXED);
+            }
+            used += snprintf(response + used, sizeof(response) - used,
+                             "filter bytes %llu checks %llu negatives %llu passed %llu false_positives %llu "
+                             "false_positive_rate %.4f\n",
+                             (unsigned long long)(database->filter.block_count * sizeof(subscriber_filter_block_t)),
+                             (unsigned long long)filter.checks, (unsigned long long)filter.negatives,
+                             (unsigned long long)(filter.checks - filter.negatives), (unsigned long long)filter.false_positives,
+                             subscriber_filter_false_positive_rate(&filter));
+        }
+    }
+    else if (strcmp(message, "reload") == 0 || strcmp(message, "compact") == 0)
+    {
+        bool done = message[0] == 'r' ? reload_database(server) : compact_database(server);
+        const subscriber_database_t *database = subscriber_store_read(&server->store);
+        used = snprintf(response, sizeof(response), "%s generation %llu subscribers %zu\n",
+                        done ? "ok" : "ERROR: failed, serving", (unsigned long long)database->generation, database->db_size);
+    }
+    else if (parse_subscriber_delta(message, &delta))
+    {
+        const char *problem = subscriber_store_apply(&server->store, &delta);
+        const subscriber_database_t *database = subscriber_store_read(&server->store);
+        if (problem)
+            used = snprintf(response, sizeof(response), "ERROR: %s\n", problem);
+        else
+            used = snprintf(response, sizeof(response), "ok generation %llu subscribers %zu\n",
+                            (unsigned long long)database->generation, database->db_size);
+        LOG_EVENT(LOG_LEVEL_DEBUG, "Delta %llu %llu %llu %llu: %llu\n", delta.op, delta.src_sub_no, delta.technology,
+                  delta.paid, problem == NULL);
+    }
+    else if (strncmp(message, "level ", 6) == 0)
+    {
+        LOG_LEVEL level;
+        if (log_parse_level(message + 6, &level))
+        {
+            log_set_level(level);
+            used = snprintf(response, sizeof(response), "level %s\n", log_level_name(level));
+        }
+        else
+            used = snprintf(response, sizeof(response), "ERROR: unknown level '%s'\n", message + 6);
+    }
+    else
+        used = snprintf(response, sizeof(response), "ERROR: unknown command '%s'\n", message);
+
+    // Unbound peers can't be answered, which is fine for fire-and-forget commands
+    if (used > sizeof(response))
+        used = sizeof(response);
+    sendto(server->control_sock, response, used, 0, (struct sockaddr *)&peer, peerlen);
+}
+
+/**
+ * @brief Open an inotify watch on the database file's directory, which also
+ *      sees the file being replaced by a rename.
+ *
+ * @param filename database file
+ * @param name set to the file's name within the directory
+ * @return int inotify descriptor
+ */
+static int watch_database(const char *filename, const char **name)
+{
+    const char *slash = strrchr(filename, '/');
+    char directory[PATH_MAX] = ".";
+    int fd;
+
+    *name = filename;
+    if (slash)
+    {
+        size_t length = slash == filename ? 1 : (size_t)(slash - filename);
+        if (length >= sizeof(directory))
+            error("ERROR: Database path too long");
+        memcpy(directory, filename, length);
+        directory[length] = '\0';
+        *name = slash + 1;
+    }
+    if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        error("ERROR: inotify_init1");
+    if (inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM) < 0)
+        error("ERROR: Watching database directory");
+    return fd;
+}
+
+/**
+ * @brief Database thread entry point: serves the control socket, and builds
+ *      and publishes new database generations on SIGHUP, and with -R once the
+ *      watched file has been quiet for RELOAD_SETTLE_NS. Compacts the delta
+ *      log when it is due. Blocking work here never stalls the workers.
+ *
+ * @param arg server_t whose database to maintain
+ * @return void* NULL
+ */
+static void *run_database_thread(void *arg)
+{
+    server_t *server = arg;
+    struct pollfd fds[2] = {{.fd = -1, .events = POLLIN}, {.fd = server->control_sock, .events = POLLIN}};
+
+    if (server->watch)
+        fds[0].fd = server->watch_fd = watch_database(server->filename, &server->watch_name);
+    while (!server_stopping)
+    {
+        if (poll(fds, 2, RELOAD_POLL_MS) > 0)
+        {
+            if (read_watch_events(server->watch_fd, server->watch_name, NULL))
+                server->changed_ns = monotonic_time_ns();
+            if (fds[1].revents & POLLIN)
+                handle_control(server);
+        }
+        if (server->changed_ns && monotonic_time_ns() - server->changed_ns >= RELOAD_SETTLE_NS)
+        {
+            server->changed_ns = 0;
+            reload_requested = 1;
+        }
+        if (reload_requested)
+        {
+            reload_requested = 0;
+            reload_database(server);
+        }
+        if (!reload_pending(server) && subscriber_store_compact_due(&server->store, monotonic_time_ns()))
+            compact_database(server);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Register a file descriptor with a worker's epoll set.
+ *
+ * @param worker worker to wake when fd is readable
+ * @param fd socket to watch
+ */
+static void watch_socket(server_worker_t *worker, int fd)
+{
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        error("ERROR: epoll_ctl");
+}
+
+/**
+ * @brief Create a non-blocking UDP socket bound to a listening address.
+ *
+ * @param listener address and port to bind
+ * @param reuse_port set SO_REUSEPORT so several workers can bind the port and
+ *      the kernel spreads flows across them
+ * @return int bound socket
+ */
+static int open_server_socket(const struct sockaddr_in *listener, bool reuse_port)
+{
+    int sock, on = 1;
+
+    // Creating socket file descriptor
+    if ((sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+        error("ERROR: Opening socket");
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+        error("ERROR: SO_REUSEPORT");
+
+    // Bind the socket with the server address
+    if (bind(sock, (const struct sockaddr *)listener, sizeof(*listener)) < 0)
+        error("ERROR: binding");
+    return sock;
+}
+
+/**
+ * @brief Steer each listener's packets to a worker on the NUMA node of the CPU
+ *      that received them. A classic BPF reuseport program maps the receiving
+ *      CPU to a socket of the port's group, whose index is the worker id since
+ *      workers bind in order. A node's CPUs are dealt round robin to its workers.
+ *
+ * @param server server with -N and more than one worker, sockets bound
+ */
+static void steer_by_cpu(server_t *server)
+{
+    struct sock_filter code[2 * CPU_SETSIZE + 3];
+    unsigned int length = 0, dealt[NUMA_MAX_NODES] = {0}, node_count = server->numa.node_count;
+    struct sock_fprog program = {.filter = code};
+
+    code[length++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        int node = numa_topology_node_of_cpu(&server->numa, cpu);
+        if (node < 0)
+            continue;
+
+        // Worker w runs on node w % node_count
+        unsigned int on_node = (server->worker_count + node_count - 1 - node) / node_count;
+        if (on_node == 0)
+            continue;
+        code[length++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu, 0, 1);
+        code[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, node + dealt[node]++ % on_node * node_count);
+    }
+    // CPUs outside the affinity, or on a node without a worker: by CPU number
+    code[length++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, server->worker_count);
+    code[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+    program.len = length;
+    for (unsigned int l = 0; l < server->listener_count; l++)
+        if (setsockopt(server->workers[0].socks[l], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+            error("ERROR: SO_ATTACH_REUSEPORT_CBPF");
+}
+
+/**
+ * @brief Create the Unix datagram control socket, replacing a stale one.
+ *
+ * @param path filesystem path to bind
+ * @return int bound socket
+ */
+static int open_control_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int sock;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "ERROR: Control socket path too long\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+    if ((sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+        error("ERROR: Opening control socket");
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        error("ERROR: binding control socket");
+    return sock;
+}
+
+/**
+ * @brief Parse a listening address, "port" or "address:port".
+ *
+ * @param spec listener argument
+ * @param listener filled with the address, INADDR_ANY if none is given
+ */
+static void parse_listener(const char *spec, struct sockaddr_in *listener)
+{
+    const char *colon = strrchr(spec, ':');
+    char address[INET_ADDRSTRLEN];
 
-    close(sock);
+    bzero(listener, sizeof(*listener)); // memset(&servaddr, 0, length);
+    listener->sin_family = AF_INET;
+    listener->sin_addr.s_addr = INADDR_ANY;
+    if (colon)
+    {
+        if ((size_t)(colon - spec) >= sizeof(address))
+            error("ERROR: Invalid listen address");
+        memcpy(address, spec, colon - spec);
+        address[colon - spec] = '\0';
+        if (inet_pton(AF_INET, address, &listener->sin_addr) != 1)
+        {
+            fprintf(stderr, "ERROR: Invalid listen address '%s'\n", address);
+            exit(EXIT_FAILURE);
+        }
+        spec = colon + 1;
+    }
+    listener->sin_port = htons(atoi(spec));
+}
+
+/**
+ * @brief Print usage and exit.
+ *
+ * @param program argv[0]
+ */
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-b batch_size] [-w workers] [-l [address:]port]... [-c control_socket]\n"
+            "       [-v off|error|warn|info|debug] [-C cache_entries] [-D replay_clients] [-R] [-B] [-P] [-N]\n"
+            "       [port [verification_database]]\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Main function (Driver code)
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return int 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    // Define variables
+    int port = PORT, opt;
+    unsigned int batch_size = DEFAULT_BATCH_SIZE, cache_entries = 0, replay_clients = 0;
+    server_t server = {.worker_count = DEFAULT_WORKER_COUNT, .control_sock = -1, .watch_fd = -1};
+    char *filename = "./input_files/verification_database.txt"; // Specificed by instruction
+    char *control_path = NULL;
+    bool filter = false, packed = false;
+    LOG_LEVEL log_level = LOG_LEVEL_INFO;
+    struct sigaction stop_action = {.sa_handler = stop_server};
+    struct sigaction reload_action = {.sa_handler = request_reload};
+    sigset_t stop_signals, saved_signals;
+    pthread_t database_thread;
+
+    // Options, then optional port number and verification database filename
+    while ((opt = getopt(argc, argv, "b:w:l:c:v:C:D:RBPN")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            batch_size = atoi(optarg);
+            if (batch_size < 1 || batch_size > MAX_BATCH_SIZE)
+            {
+                fprintf(stderr, "ERROR: batch_size must be 1 - %d\n", MAX_BATCH_SIZE);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            server.worker_count = atoi(optarg);
+            if (server.worker_count < 1 || server.worker_count > MAX_WORKER_COUNT)
+            {
+                fprintf(stderr, "ERROR: workers must be 1 - %d\n", MAX_WORKER_COUNT);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            if (server.listener_count == MAX_LISTENERS)
+            {
+                fprintf(stderr, "ERROR: At most %d listeners\n", MAX_LISTENERS);
+                exit(EXIT_FAILURE);
+            }
+            parse_listener(optarg, &server.listeners[server.listener_count++]);
+            break;
+        case 'c':
+            control_path = optarg;
+            break;
+        case 'v':
+            if (!log_parse_level(optarg, &log_level))
+                usage(argv[0]);
+            break;
+        case 'C':
+            cache_entries = atoi(optarg);
+            if (cache_entries < RESPONSE_CACHE_MIN_ENTRIES || cache_entries > RESPONSE_CACHE_MAX_ENTRIES)
+            {
+                fprintf(stderr, "ERROR: cache entries must be %d - %u\n", RESPONSE_CACHE_MIN_ENTRIES,
+                        RESPONSE_CACHE_MAX_ENTRIES);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            replay_clients = atoi(optarg);
+            if (replay_clients < REPLAY_WINDOW_MIN_CLIENTS || replay_clients > REPLAY_WINDOW_MAX_CLIENTS)
+            {
+                fprintf(stderr, "ERROR: replay window clients must be %d - %u\n", REPLAY_WINDOW_MIN_CLIENTS,
+                        REPLAY_WINDOW_MAX_CLIENTS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'R':
+            server.watch = true;
+            break;
+        case 'B':
+            filter = true;
+            break;
+        case 'P':
+            packed = true;
+            break;
+        case 'N':
+            server.numa_aware = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind > 2)
+        usage(argv[0]);
+    if (argc - optind >= 1)
+        port = atoi(argv[optind]);
+    if (argc - optind == 2)
+        filename = argv[optind + 1];
+
+    // Request logging goes through the ring buffer, drained on its own thread
+    log_init(stdout, log_level);
+
+    // Listen on the port argument unless listeners are given
+    if (server.listener_count == 0)
+    {
+        char spec[16];
+        snprintf(spec, sizeof(spec), "%d", port);
+        parse_listener(spec, &server.listeners[server.listener_count++]);
+    }
+
+    // With -N the database is loaded on node 0, where this thread serves as
+    // worker 0, and worker w runs on node w % node_count
+    if (server.numa_aware)
+    {
+        numa_topology_read(&server.numa);
+        numa_topology_pin(&server.numa, 0);
+    }
+
+    // Each worker gets an epoll set with one socket per listener, all
+    // workers' sockets for a listener share its port:
+    server.workers = calloc(server.worker_count, sizeof(server_worker_t));
+    if (server.workers == NULL)
+        error("ERROR: Allocating workers");
+    for (unsigned int w = 0; w < server.worker_count; w++)
+    {
+        server_worker_t *worker = &server.workers[w];
+        worker->id = w;
+        worker->node = server.numa_aware ? w % server.numa.node_count : 0;
+        worker->server = &server;
+        worker->batch_size = batch_size;
+        if ((worker->epoll_fd = epoll_create1(0)) < 0)
+            error("ERROR: epoll_create1");
+        for (unsigned int l = 0; l < server.listener_count; l++)
+        {
+            worker->socks[l] = open_server_socket(&server.listeners[l], server.worker_count > 1);
+            watch_socket(worker, worker->socks[l]);
+        }
+        worker->sock_count = server.listener_count;
+
+        // Lookup scratch also serves a batch frame's records
+        unsigned int lookup_size = batch_size > BATCH_MAX_RECORDS ? batch_size : BATCH_MAX_RECORDS;
+        worker->packets = calloc(batch_size, sizeof(subscriber_packet_t));
+        worker->frame_tails = calloc(batch_size, BATCH_FRAME_TAIL_SIZE);
+        worker->clients = calloc(batch_size, sizeof(struct sockaddr_in));
+        worker->iovecs = calloc(batch_size * 2, sizeof(struct iovec));
+        worker->msgs = calloc(batch_size, sizeof(struct mmsghdr));
+        worker->replies = calloc(batch_size, sizeof(struct mmsghdr));
+        worker->packet_sizes = calloc(batch_size, sizeof(uint32_t));
+        worker->validations = calloc(batch_size, sizeof(PACKET_VALIDATION));
+        worker->statuses = calloc(batch_size, sizeof(SUBSCRIBER_PACKET_TYPE));
+        worker->lookups = calloc(lookup_size, sizeof(subscriber_packet_t));
+        worker->lookup_positions = calloc(lookup_size, sizeof(unsigned int));
+        worker->lookup_statuses = calloc(lookup_size, sizeof(SUBSCRIBER_PACKET_TYPE));
+        worker->packets_v2 = calloc(batch_size, sizeof(subscriber_packet_v2_t));
+        worker->reply_iovecs = calloc(batch_size, sizeof(struct iovec));
+        worker->v2_positions = calloc(batch_size, sizeof(unsigned int));
+        worker->replay_requests = calloc(lookup_size, sizeof(replay_request_t));
+        worker->replayed = calloc(lookup_size, sizeof(bool));
+        if (worker->replay_requests == NULL || worker->replayed == NULL ||
+            worker->packets_v2 == NULL || worker->reply_iovecs == NULL || worker->v2_positions == NULL ||
+            worker->packets == NULL || worker->frame_tails == NULL || worker->clients == NULL || worker->iovecs == NULL || worker->msgs == NULL ||
+            worker->replies == NULL || worker->packet_sizes == NULL || worker->validations == NULL || worker->statuses == NULL ||
+            worker->lookups == NULL || worker->lookup_positions == NULL || worker->lookup_statuses == NULL)
+            error("ERROR: Allocating receive batch");
+        if (cache_entries)
+            response_cache_init(&worker->cache, cache_entries);
+        if (replay_clients)
+            replay_window_init(&worker->replay, replay_clients);
+        for (unsigned int i = 0; i < batch_size; i++)
+        {
+            worker->iovecs[2 * i].iov_base = &worker->packets[i];
+            worker->iovecs[2 * i].iov_len = sizeof(subscriber_packet_t);
+            worker->iovecs[2 * i + 1].iov_base = worker->frame_tails + (size_t)i * BATCH_FRAME_TAIL_SIZE;
+            worker->iovecs[2 * i + 1].iov_len = BATCH_FRAME_TAIL_SIZE;
+            worker->msgs[i].msg_hdr.msg_iov = &worker->iovecs[2 * i];
+            worker->msgs[i].msg_hdr.msg_iovlen = 2;
+            worker->msgs[i].msg_hdr.msg_name = &worker->clients[i];
+            worker->reply_iovecs[i].iov_base = &worker->packets_v2[i];
+            worker->reply_iovecs[i].iov_len = sizeof(subscriber_packet_v2_t);
+        }
+    }
+
+    if (server.numa_aware && server.worker_count > 1)
+        steer_by_cpu(&server);
+
+    // The database thread serves the control socket:
+    if (control_path)
+        server.control_sock = open_control_socket(control_path);
+
+    // Initializing verification database and its hash index, so lookups don't
+    // scan every entry. A compiled subscriber image is mapped and served as is,
+    // unless the database is packed. Workers read it through the store, which
+    // swaps in reloaded generations.
+    subscriber_database_t *database = subscriber_database_load(filename, false, packed);
+    if (is_subscriber_image(filename))
+        printf("%s subscriber image with %zu subscribers in %.3f ms\n", packed ? "Packed" : "Mapped", database->db_size,
+               database->load_ns / 1e6);
+    else
+    {
+        printf("Loaded %zu subscribers in %.1f ms (%.0f rows/s)\n", database->db_size, database->load_ns / 1e6,
+               database->load_ns ? database->db_size * 1e9 / database->load_ns : 0.0);
+
+        // Print out Verification Database:
+        if (log_enabled(LOG_LEVEL_DEBUG) && database->table)
+            print_verification_database(database->table, database->db_size);
+    }
+    if (packed)
+    {
+        print_database_memory_usage(database->db_size, subscriber_table_memory_bytes(&database->packed),
+                                    subscriber_index_memory_bytes(&database->index));
+        printf("Packed subscriber table: %u-bit entries in %llu buckets, %.2f bytes/subscriber without the overlay index\n",
+               database->packed.entry_bits, (unsigned long long)database->packed.bucket_count,
+               database->db_size ? (double)subscriber_table_memory_bytes(&database->packed) / database->db_size : 0.0);
+    }
+    else
+        print_database_memory_usage(database->db_size,
+                                    database->table ? database->db_size * sizeof(verification_database_t) : 0,
+                                    subscriber_index_memory_bytes(&database->index));
+    server.filename = filename;
+    subscriber_store_init(&server.store, database, server.worker_count, filter, server.numa_aware ? &server.numa : NULL);
+    if (server.numa_aware)
+        printf("NUMA: %u node%s, workers pinned round robin, %zu bytes of lookup structures on each node\n",
+               server.numa.node_count, server.numa.node_count == 1 ? "" : "s", subscriber_database_lookup_bytes(database));
+    if (filter)
+        printf("Negative-lookup filter: %llu bytes (%d bits per subscriber)\n",
+               (unsigned long long)(database->filter.block_count * sizeof(subscriber_filter_block_t)),
+               SUBSCRIBER_FILTER_BITS_PER_KEY);
+    uint64_t delta_records = subscriber_store_open_log(&server.store, filename);
+    if (delta_records)
+        printf("Replayed %llu delta records from %s, %zu subscribers\n", (unsigned long long)delta_records,
+               server.store.log_path, subscriber_store_read(&server.store)->db_size);
+
+    // Worker 0 runs on the main thread and takes the stop and reload signals,
+    // the rest and the database thread get their own threads with those signals blocked:
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGHUP);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    sigaction(SIGHUP, &reload_action, NULL);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &saved_signals);
+    for (unsigned int w = 0; w < server.worker_count; w++)
+        server.workers[w].store = &server.store;
+    for (unsigned int w = 1; w < server.worker_count; w++)
+        if (server.numa_aware)
+            numa_topology_start(&server.numa, server.workers[w].node, &server.workers[w].thread, run_worker,
+                                &server.workers[w]);
+        else if (pthread_create(&server.workers[w].thread, NULL, run_worker, &server.workers[w]) != 0)
+            error("ERROR: Starting worker thread");
+    if (pthread_create(&database_thread, NULL, run_database_thread, &server) != 0)
+        error("ERROR: Starting database thread");
+    pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+    if (cache_entries)
+        printf("Response cache: %llu entries per worker\n",
+               (unsigned long long)(server.workers[0].cache.set_count * RESPONSE_CACHE_WAYS));
+    if (replay_clients)
+        printf("Replay window: %llu clients of %d responses per worker, %.1f MiB each\n",
+               (unsigned long long)(server.workers[0].replay.set_count * REPLAY_WINDOW_WAYS), REPLAY_WINDOW_SIZE,
+               replay_window_memory_bytes(&server.workers[0].replay) / 1048576.0);
+    if (server.worker_count > 1 || server.listener_count > 1)
+        printf("Serving %u listeners with %u workers\n", server.listener_count, server.worker_count);
+    fflush(stdout);
+    run_worker(&server.workers[0]);
+
+    // Stopped: report the totals and flush the log. The other workers may be
+    // mid-request, so their sockets, buffers and the database are left to exit().
+    for (unsigned int w = 0; w < server.worker_count; w++)
+    {
+        uint64_t dropped = 0;
+        for (unsigned int reason = PACKET_VALID + 1; reason < PACKET_VALIDATION_COUNT; reason++)
+            dropped += __atomic_load_n(&server.workers[w].stats.dropped[reason], __ATOMIC_RELAXED);
+        LOG_EVENT(LOG_LEVEL_INFO, "Worker %llu received %llu packets, dropped %llu invalid\n", w,
+                  __atomic_load_n(&server.workers[w].stats.total_packets, __ATOMIC_RELAXED), dropped);
+    }
+    log_shutdown();
+    if (control_path)
+        unlink(control_path);
     return EXIT_SUCCESS;
 }
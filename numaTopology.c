@@ -0,0 +1,153 @@
+/**
+ * @file numaTopology.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement reading the NUMA topology and pinning threads to nodes
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "numaTopology.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief Parse a sysfs CPU list, e.g. "0-3,8-11".
+ *
+ * @param list CPU list
+ * @param cpus set to the listed CPUs
+ */
+static void parse_cpu_list(const char *list, cpu_set_t *cpus)
+{
+    char *end;
+
+    CPU_ZERO(cpus);
+    while (*list >= '0' && *list <= '9')
+    {
+        long first = strtol(list, &end, 10), last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+        list = *end == ',' ? end + 1 : end;
+    }
+}
+
+void numa_topology_read(numa_topology_t *topology)
+{
+    cpu_set_t allowed, cpus;
+    int ids[NUMA_MAX_NODES * 4], found = 0;
+    struct dirent *entry;
+    DIR *dir;
+
+    memset(topology, DEFAULT_VALUE, sizeof(*topology));
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        error("ERROR: sched_getaffinity");
+
+    // Node directories in kernel node order
+    if ((dir = opendir(NUMA_SYSFS_NODES)) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL && found < (int)(sizeof(ids) / sizeof(ids[0])))
+        {
+            int id, i;
+            if (sscanf(entry->d_name, "node%d", &id) != 1)
+                continue;
+            for (i = found++; i > 0 && ids[i - 1] > id; i--)
+                ids[i] = ids[i - 1];
+            ids[i] = id;
+        }
+        closedir(dir);
+    }
+    for (int n = 0; n < found; n++)
+    {
+        char path[PATH_MAX], list[4096] = "";
+        FILE *fp;
+
+        snprintf(path, sizeof(path), NUMA_SYSFS_NODES "/node%d/cpulist", ids[n]);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        if (fgets(list, sizeof(list), fp) == NULL)
+            list[0] = '\0';
+        fclose(fp);
+        parse_cpu_list(list, &cpus);
+        CPU_AND(&cpus, &cpus, &allowed);
+        if (CPU_COUNT(&cpus) == 0)
+            continue;
+        if (topology->node_count == NUMA_MAX_NODES)
+        {
+            CPU_OR(&topology->cpus[NUMA_MAX_NODES - 1], &topology->cpus[NUMA_MAX_NODES - 1], &cpus);
+            continue;
+        }
+        topology->ids[topology->node_count] = ids[n];
+        topology->cpus[topology->node_count++] = cpus;
+    }
+
+    // No NUMA information: one node
+    if (topology->node_count == 0)
+    {
+        topology->node_count = 1;
+        topology->ids[0] = 0;
+        topology->cpus[0] = allowed;
+    }
+}
+
+int numa_topology_node_of_cpu(const numa_topology_t *topology, int cpu)
+{
+    for (unsigned int node = 0; node < topology->node_count; node++)
+        if (CPU_ISSET(cpu, &topology->cpus[node]))
+            return node;
+    return -1;
+}
+
+void numa_topology_pin(const numa_topology_t *topology, unsigned int node)
+{
+    int status = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &topology->cpus[node]);
+
+    if (status != 0)
+    {
+        errno = status;
+        error("ERROR: Pinning thread to NUMA node");
+    }
+}
+
+void numa_topology_start(const numa_topology_t *topology, unsigned int node, pthread_t *thread, void *(*run)(void *),
+                         void *arg)
+{
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    if (pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &topology->cpus[node]) != 0 ||
+        pthread_create(thread, &attr, run, arg) != 0)
+        error("ERROR: Starting thread on NUMA node");
+    pthread_attr_destroy(&attr);
+}
+
+int numa_topology_local_percent(const numa_topology_t *topology, unsigned int node, const void *memory, size_t bytes)
+{
+    void *pages[NUMA_PLACEMENT_SAMPLES];
+    int status[NUMA_PLACEMENT_SAMPLES];
+    uintptr_t page_size = sysconf(_SC_PAGESIZE), first = (uintptr_t)memory & ~(page_size - 1);
+    uint64_t page_count = ((uintptr_t)memory + bytes - first + page_size - 1) / page_size;
+    unsigned long samples = page_count < NUMA_PLACEMENT_SAMPLES ? page_count : NUMA_PLACEMENT_SAMPLES;
+    unsigned long local = 0, placed = 0;
+
+    if (samples == 0)
+        return -1;
+    for (unsigned long i = 0; i < samples; i++)
+        pages[i] = (void *)(first + page_count * i / samples * page_size);
+    // With no target nodes move_pages() only reports each page's node
+    if (syscall(SYS_move_pages, 0, samples, pages, NULL, status, 0) < 0)
+        return -1;
+    for (unsigned long i = 0; i < samples; i++)
+        if (status[i] >= 0)
+        {
+            placed++;
+            local += status[i] == topology->ids[node];
+        }
+    return placed ? (int)(local * 100 / placed) : -1;
+}
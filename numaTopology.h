@@ -0,0 +1,88 @@
+/**
+ * @file numaTopology.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the NUMA node topology read from sysfs, for pinning
+ *      threads to nodes and checking where memory was placed. Memory is placed
+ *      by first touch from a pinned thread, so libnuma is not needed.
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NUMATOPOLOGY_H /* include guard */
+#define NUMATOPOLOGY_H
+
+#include "customProtocol.h"
+#include <pthread.h>
+#include <sched.h>
+
+// Nodes with CPUs this process may use, more are folded into the last one
+#define NUMA_MAX_NODES 16
+#define NUMA_SYSFS_NODES "/sys/devices/system/node"
+// Pages of a buffer sampled by numa_topology_local_percent()
+#define NUMA_PLACEMENT_SAMPLES 1024
+
+// NUMA nodes, numbered 0 - node_count-1 in kernel node order. Without NUMA
+// (no sysfs node directory) there is one node with every allowed CPU.
+typedef struct
+{
+    unsigned int node_count;
+    int ids[NUMA_MAX_NODES];        // Kernel node number of each node
+    cpu_set_t cpus[NUMA_MAX_NODES]; // CPUs of each node this process may run on
+} numa_topology_t;
+
+/**
+ * @brief Read the nodes and their CPUs, limited to the process's CPU affinity.
+ *      Memory-only nodes and nodes without allowed CPUs are left out.
+ *
+ * @param topology topology to fill
+ */
+void numa_topology_read(numa_topology_t *topology);
+
+/**
+ * @brief Node of a CPU.
+ *
+ * @param topology topology from numa_topology_read()
+ * @param cpu CPU number
+ * @return int node, -1 if the CPU is not allowed
+ */
+int numa_topology_node_of_cpu(const numa_topology_t *topology, int cpu);
+
+/**
+ * @brief Pin the calling thread to a node's CPUs. Memory it touches first
+ *      is then allocated on that node.
+ *
+ * @param topology topology from numa_topology_read()
+ * @param node node to run on
+ */
+void numa_topology_pin(const numa_topology_t *topology, unsigned int node);
+
+/**
+ * @brief Start a thread pinned to a node's CPUs from its first instruction.
+ *
+ * @param topology topology from numa_topology_read()
+ * @param node node to run on
+ * @param thread set to the started thread
+ * @param run thread entry point
+ * @param arg argument of run
+ */
+void numa_topology_start(const numa_topology_t *topology, unsigned int node, pthread_t *thread, void *(*run)(void *),
+                         void *arg);
+
+/**
+ * @brief Share of a buffer's pages that are on a node, from up to
+ *      NUMA_PLACEMENT_SAMPLES pages spread over it (move_pages() query).
+ *
+ * @param topology topology from numa_topology_read()
+ * @param node node the buffer should be on
+ * @param memory buffer, touched already
+ * @param bytes buffer size
+ * @return int percent of the sampled pages on the node, -1 if the kernel can't tell
+ */
+int numa_topology_local_percent(const numa_topology_t *topology, unsigned int node, const void *memory, size_t bytes);
+
+#endif
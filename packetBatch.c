@@ -0,0 +1,362 @@
+/**
+ * @file packetBatch.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement batch validation and prefetched batch lookup of received
+ *      packets, optionally through the negative-lookup filter
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "packetBatch.h"
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKET_BATCH_X86 1
+#endif
+
+// Every checked field is a range of allowed values per byte (little-endian),
+// so a packet is valid iff each of its bytes lies in [lo, hi]. One unsigned
+// byte-range compare then checks all fields of a packet at once.
+#define PACKET_BYTES_MASK ((1U << sizeof(subscriber_packet_t)) - 1)
+// Packets per result bitmask
+#define PACKET_CHUNK 64
+_Static_assert(sizeof(subscriber_packet_t) <= 16, "a packet must fit in one SSE register");
+_Static_assert((SUB_ACC_PER >> 8) == (SUB_ACC_OK >> 8), "packet types must share their high byte");
+
+/**
+ * @brief Restrict a byte to [lo_value, hi_value].
+ *
+ * @param lo lowest allowed value per byte
+ * @param hi highest allowed value per byte
+ * @param offset byte to restrict
+ * @param lo_value lowest allowed value
+ * @param hi_value highest allowed value
+ */
+static void set_byte_range(uint8_t lo[], uint8_t hi[], size_t offset, uint8_t lo_value, uint8_t hi_value)
+{
+    lo[offset] = lo_value;
+    hi[offset] = hi_value;
+}
+
+/**
+ * @brief Allowed range of each byte of two packets back to back. Bytes that
+ *      are not checked (client_id, src_sub_no, and past the second packet)
+ *      allow 0x00 - 0xFF.
+ *
+ * @param lo lowest allowed value per byte
+ * @param hi highest allowed value per byte
+ */
+static void packet_byte_ranges(uint8_t lo[32], uint8_t hi[32])
+{
+    memset(lo, 0x00, 32);
+    memset(hi, 0xFF, 32);
+    for (size_t base = 0; base < 2 * sizeof(subscriber_packet_t); base += sizeof(subscriber_packet_t))
+    {
+        size_t start = base + offsetof(subscriber_packet_t, start_packet);
+        size_t type = base + offsetof(subscriber_packet_t, packet_type);
+        size_t end = base + offsetof(subscriber_packet_t, end_packet);
+
+        set_byte_range(lo, hi, start, START_PACKET & 0xFF, START_PACKET & 0xFF);
+        set_byte_range(lo, hi, start + 1, START_PACKET >> 8, START_PACKET >> 8);
+        set_byte_range(lo, hi, type, SUB_ACC_PER & 0xFF, SUB_ACC_OK & 0xFF);
+        set_byte_range(lo, hi, type + 1, SUB_ACC_PER >> 8, SUB_ACC_PER >> 8);
+        set_byte_range(lo, hi, base + offsetof(subscriber_packet_t, segment_no), 0, PACKET_GROUP_SIZE - 1);
+        set_byte_range(lo, hi, base + offsetof(subscriber_packet_t, length), SUBSCRIBER_PAYLOAD_SIZE, SUBSCRIBER_PAYLOAD_SIZE);
+        set_byte_range(lo, hi, base + offsetof(subscriber_packet_t, technology), SUB_2G, SUB_5G);
+        set_byte_range(lo, hi, end, END_PACKET & 0xFF, END_PACKET & 0xFF);
+        set_byte_range(lo, hi, end + 1, END_PACKET >> 8, END_PACKET >> 8);
+    }
+}
+
+// One check_subscriber_packet() per packet
+static unsigned int check_packets_scalar(const subscriber_packet_t packets[], const uint32_t packet_sizes[],
+                                         PACKET_VALIDATION results[], unsigned int n)
+{
+    unsigned int valid = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        results[i] = check_subscriber_packet(&packets[i], packet_sizes[i]);
+        valid += results[i] == PACKET_VALID;
+    }
+    return valid;
+}
+
+/**
+ * @brief Write the results of a chunk of up to PACKET_CHUNK packets from the
+ *      mask of valid packets. Failures are rare, so only they take the scalar
+ *      check, for their reason.
+ *
+ * @param packets batch
+ * @param packet_sizes datagram sizes
+ * @param results batch results
+ * @param first first packet of the chunk
+ * @param count packets in the chunk
+ * @param valid bit j set if packet first + j has the right size and every byte in range
+ * @return unsigned int valid packets in the chunk
+ */
+static unsigned int finish_chunk(const subscriber_packet_t packets[], const uint32_t packet_sizes[],
+                                 PACKET_VALIDATION results[], unsigned int first, unsigned int count, uint64_t valid)
+{
+    uint64_t chunk_mask = count == PACKET_CHUNK ? ~0ULL : (1ULL << count) - 1;
+    uint64_t bad = ~valid & chunk_mask;
+
+    memset(&results[first], PACKET_VALID, count * sizeof(PACKET_VALIDATION));
+    for (uint64_t rest = bad; rest != 0; rest &= rest - 1)
+    {
+        unsigned int i = first + __builtin_ctzll(rest);
+        results[i] = check_subscriber_packet(&packets[i], packet_sizes[i]);
+    }
+    return count - __builtin_popcountll(bad);
+}
+
+#ifdef PACKET_BATCH_X86
+/**
+ * @brief Whether one packet is valid, with one 16-byte load. The load reads
+ *      2 bytes past the packet, so it can't be used on the last packet of a batch.
+ *
+ * @param bytes start of the packet
+ * @param packet_size datagram size
+ * @param lo lowest allowed value per byte
+ * @param hi highest allowed value per byte
+ * @return uint64_t 1 if valid
+ */
+static inline uint64_t packet_valid_sse2(const uint8_t *bytes, uint32_t packet_size, __m128i lo, __m128i hi)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)bytes);
+    __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(_mm_max_epu8(v, lo), hi), v);
+    return ((_mm_movemask_epi8(in_range) & PACKET_BYTES_MASK) == PACKET_BYTES_MASK) &
+           (packet_size == sizeof(subscriber_packet_t));
+}
+
+// One packet per 16-byte load
+static unsigned int check_packets_sse2(const subscriber_packet_t packets[], const uint32_t packet_sizes[],
+                                       PACKET_VALIDATION results[], unsigned int n)
+{
+    uint8_t lo_bytes[32], hi_bytes[32];
+    const uint8_t *bytes = (const uint8_t *)packets;
+    unsigned int valid = 0;
+
+    packet_byte_ranges(lo_bytes, hi_bytes);
+    const __m128i lo = _mm_loadu_si128((const __m128i *)lo_bytes);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)hi_bytes);
+    for (unsigned int first = 0; first < n; first += PACKET_CHUNK)
+    {
+        unsigned int count = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK, j = 0;
+        uint64_t chunk_valid = 0;
+
+        for (; j < count && first + j + 1 < n; j++)
+            chunk_valid |= packet_valid_sse2(bytes + (first + j) * sizeof(subscriber_packet_t),
+                                             packet_sizes[first + j], lo, hi) << j;
+        for (; j < count; j++)
+            chunk_valid |= (uint64_t)(check_subscriber_packet(&packets[first + j], packet_sizes[first + j]) == PACKET_VALID) << j;
+        valid += finish_chunk(packets, packet_sizes, results, first, count, chunk_valid);
+    }
+    return valid;
+}
+
+// Two packets per 32-byte load, which reads 4 bytes of a third packet, so
+// the last two packets use 16-byte loads and scalar.
+__attribute__((target("avx2"))) static unsigned int check_packets_avx2(
+    const subscriber_packet_t packets[], const uint32_t packet_sizes[], PACKET_VALIDATION results[], unsigned int n)
+{
+    uint8_t lo_bytes[32], hi_bytes[32];
+    const uint8_t *bytes = (const uint8_t *)packets;
+    unsigned int valid = 0;
+
+    packet_byte_ranges(lo_bytes, hi_bytes);
+    const __m256i lo = _mm256_loadu_si256((const __m256i *)lo_bytes);
+    const __m256i hi = _mm256_loadu_si256((const __m256i *)hi_bytes);
+    for (unsigned int first = 0; first < n; first += PACKET_CHUNK)
+    {
+        unsigned int count = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK, j = 0;
+        uint64_t chunk_valid = 0;
+
+        for (; j + 1 < count && first + j + 2 < n; j += 2)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + (first + j) * sizeof(subscriber_packet_t)));
+            __m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_max_epu8(v, lo), hi), v);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(in_range);
+            uint64_t pair = ((mask & PACKET_BYTES_MASK) == PACKET_BYTES_MASK) &
+                            (packet_sizes[first + j] == sizeof(subscriber_packet_t));
+            pair |= (uint64_t)(((mask >> sizeof(subscriber_packet_t) & PACKET_BYTES_MASK) == PACKET_BYTES_MASK) &
+                               (packet_sizes[first + j + 1] == sizeof(subscriber_packet_t))) << 1;
+            chunk_valid |= pair << j;
+        }
+        for (; j < count && first + j + 1 < n; j++)
+            chunk_valid |= packet_valid_sse2(bytes + (first + j) * sizeof(subscriber_packet_t), packet_sizes[first + j],
+                                             _mm256_castsi256_si128(lo), _mm256_castsi256_si128(hi)) << j;
+        for (; j < count; j++)
+            chunk_valid |= (uint64_t)(check_subscriber_packet(&packets[first + j], packet_sizes[first + j]) == PACKET_VALID) << j;
+        valid += finish_chunk(packets, packet_sizes, results, first, count, chunk_valid);
+    }
+    return valid;
+}
+#endif
+
+bool packet_batch_supported(PACKET_BATCH_IMPL impl)
+{
+    switch (impl)
+    {
+    case PACKET_BATCH_SCALAR:
+        return true;
+#ifdef PACKET_BATCH_X86
+    case PACKET_BATCH_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case PACKET_BATCH_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *packet_batch_impl_name(PACKET_BATCH_IMPL impl)
+{
+    static const char *const names[PACKET_BATCH_IMPL_COUNT] = {"scalar", "sse2", "avx2"};
+    return impl < PACKET_BATCH_IMPL_COUNT ? names[impl] : "unknown";
+}
+
+unsigned int check_subscriber_packets_with(
+    PACKET_BATCH_IMPL impl, const subscriber_packet_t packets[], const uint32_t packet_sizes[],
+    PACKET_VALIDATION results[], unsigned int n)
+{
+    if (!packet_batch_supported(impl))
+        impl = PACKET_BATCH_SCALAR;
+    switch (impl)
+    {
+#ifdef PACKET_BATCH_X86
+    case PACKET_BATCH_SSE2:
+        return check_packets_sse2(packets, packet_sizes, results, n);
+    case PACKET_BATCH_AVX2:
+        return check_packets_avx2(packets, packet_sizes, results, n);
+#endif
+    default:
+        return check_packets_scalar(packets, packet_sizes, results, n);
+    }
+}
+
+unsigned int check_subscriber_packets(
+    const subscriber_packet_t packets[], const uint32_t packet_sizes[], PACKET_VALIDATION results[], unsigned int n)
+{
+    PACKET_BATCH_IMPL impl = PACKET_BATCH_SCALAR;
+
+    if (packet_batch_supported(PACKET_BATCH_AVX2))
+        impl = PACKET_BATCH_AVX2;
+    else if (packet_batch_supported(PACKET_BATCH_SSE2))
+        impl = PACKET_BATCH_SSE2;
+    return check_subscriber_packets_with(impl, packets, packet_sizes, results, n);
+}
+
+/**
+ * @brief Prefetch the slot a lookup starts probing at.
+ *
+ * @param index subscriber index
+ * @param packet packet to be looked up
+ */
+static inline void prefetch_home_slot(const subscriber_index_t *index, const subscriber_packet_t *packet)
+{
+    uint64_t home = subscriber_key_hash(packet->src_sub_no, packet->technology) >> index->shift;
+    __builtin_prefetch(&index->slots[home], 0, 1);
+}
+
+void subscriber_index_lookup_batch(
+    const subscriber_index_t *index, const subscriber_packet_t packets[], SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n)
+{
+    for (unsigned int i = 0; i < n && i < PACKET_BATCH_PREFETCH_DISTANCE; i++)
+        prefetch_home_slot(index, &packets[i]);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        if (i + PACKET_BATCH_PREFETCH_DISTANCE < n)
+            prefetch_home_slot(index, &packets[i + PACKET_BATCH_PREFETCH_DISTANCE]);
+        statuses[i] = subscriber_index_lookup(index, packets[i].src_sub_no, packets[i].technology);
+    }
+}
+
+/**
+ * @brief Prefetch the filter block a key's bits are in.
+ *
+ * @param filter negative-lookup filter
+ * @param packet packet to be filtered
+ */
+static inline void prefetch_filter_block(const subscriber_filter_t *filter, const subscriber_packet_t *packet)
+{
+    __builtin_prefetch(subscriber_filter_block(filter, subscriber_filter_hash(packet->src_sub_no, packet->technology)), 0, 1);
+}
+
+void subscriber_filter_lookup_batch(
+    const subscriber_filter_t *filter, const subscriber_index_t *index, const subscriber_packet_t packets[],
+    SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n, subscriber_filter_stats_t *stats)
+{
+    unsigned int candidates[PACKET_CHUNK];
+
+    if (filter->blocks == NULL)
+    {
+        subscriber_index_lookup_batch(index, packets, statuses, n);
+        return;
+    }
+    for (unsigned int first = 0; first < n; first += PACKET_CHUNK)
+    {
+        unsigned int count = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK, found = 0;
+
+        // Filter every key, blocks prefetched ahead
+        for (unsigned int j = 0; j < count && j < PACKET_BATCH_PREFETCH_DISTANCE; j++)
+            prefetch_filter_block(filter, &packets[first + j]);
+        for (unsigned int j = 0; j < count; j++)
+        {
+            const subscriber_packet_t *packet = &packets[first + j];
+            if (j + PACKET_BATCH_PREFETCH_DISTANCE < count)
+                prefetch_filter_block(filter, &packets[first + j + PACKET_BATCH_PREFETCH_DISTANCE]);
+            candidates[found] = first + j;
+            statuses[first + j] = SUB_NOT_EXIST;
+            found += subscriber_filter_may_contain(filter, packet->src_sub_no, packet->technology);
+        }
+
+        // Look up the keys that passed, home slots prefetched ahead
+        for (unsigned int c = 0; c < found && c < PACKET_BATCH_PREFETCH_DISTANCE; c++)
+            prefetch_home_slot(index, &packets[candidates[c]]);
+        for (unsigned int c = 0; c < found; c++)
+        {
+            const subscriber_packet_t *packet = &packets[candidates[c]];
+            if (c + PACKET_BATCH_PREFETCH_DISTANCE < found)
+                prefetch_home_slot(index, &packets[candidates[c + PACKET_BATCH_PREFETCH_DISTANCE]]);
+            statuses[candidates[c]] = subscriber_index_lookup(index, packet->src_sub_no, packet->technology);
+            stats->false_positives += statuses[candidates[c]] == SUB_NOT_EXIST;
+        }
+        stats->checks += count;
+        stats->negatives += count - found;
+    }
+}
+
+void subscriber_table_lookup_batch(
+    const subscriber_filter_t *filter, const subscriber_table_t *table, const subscriber_index_t *overlay,
+    const subscriber_packet_t packets[], SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n,
+    subscriber_filter_stats_t *stats)
+{
+    uint64_t buckets[PACKET_CHUNK];
+
+    // In stages over a chunk: the scans mispredict their exits, which would
+    // cut off cache misses still in flight if the stages were interleaved
+    for (unsigned int first = 0; first < n; first += PACKET_CHUNK)
+    {
+        unsigned int count = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK;
+        const subscriber_packet_t *chunk = &packets[first];
+
+        for (unsigned int j = 0; j < count; j++)
+        {
+            buckets[j] = subscriber_table_hash(chunk[j].src_sub_no, chunk[j].technology) >> table->remainder_bits;
+            __builtin_prefetch(&table->buckets[buckets[j]], 0, 1);
+        }
+        for (unsigned int j = 0; j < count; j++)
+            __builtin_prefetch(&table->entries[table->buckets[buckets[j]] * (uint64_t)table->entry_bits >> 6], 0, 1);
+        for (unsigned int j = 0; j < count; j++)
+            statuses[first + j] = subscriber_filter_lookup_table(filter, table, overlay, chunk[j].src_sub_no,
+                                                                 chunk[j].technology, stats);
+    }
+}
@@ -0,0 +1,126 @@
+/**
+ * @file packetBatch.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining batch validation (SSE2/AVX2 with a scalar fallback)
+ *      and prefetched batch lookup of received subscriber packets, optionally
+ *      through the negative-lookup filter
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef PACKETBATCH_H /* include guard */
+#define PACKETBATCH_H
+
+#include "customProtocol.h"
+#include "subscriberIndex.h"
+#include "subscriberFilter.h"
+
+// Lookups ahead of the current one whose home slot is prefetched
+#define PACKET_BATCH_PREFETCH_DISTANCE 8
+
+// Batch validation implementations:
+typedef enum
+{
+    PACKET_BATCH_SCALAR,
+    PACKET_BATCH_SSE2,
+    PACKET_BATCH_AVX2,
+    PACKET_BATCH_IMPL_COUNT
+} PACKET_BATCH_IMPL;
+
+/**
+ * @brief Validate a batch of received packets. Same results as
+ *      check_subscriber_packet() on each packet, using the best implementation
+ *      this CPU supports.
+ *
+ * @param packets contiguous receive buffers, one per datagram
+ * @param packet_sizes datagram sizes as received
+ * @param results set to each packet's PACKET_VALIDATION
+ * @param n number of packets
+ * @return unsigned int number of valid packets
+ */
+unsigned int check_subscriber_packets(
+    const subscriber_packet_t packets[], const uint32_t packet_sizes[], PACKET_VALIDATION results[], unsigned int n);
+
+/**
+ * @brief check_subscriber_packets() with a given implementation, for benchmarks
+ *      and tests. Falls back to scalar if the CPU lacks the instruction set.
+ *
+ * @param impl implementation to use
+ * @param packets contiguous receive buffers, one per datagram
+ * @param packet_sizes datagram sizes as received
+ * @param results set to each packet's PACKET_VALIDATION
+ * @param n number of packets
+ * @return unsigned int number of valid packets
+ */
+unsigned int check_subscriber_packets_with(
+    PACKET_BATCH_IMPL impl, const subscriber_packet_t packets[], const uint32_t packet_sizes[],
+    PACKET_VALIDATION results[], unsigned int n);
+
+/**
+ * @brief Whether this CPU and build support an implementation.
+ *
+ * @param impl implementation
+ * @return true if supported
+ */
+bool packet_batch_supported(PACKET_BATCH_IMPL impl);
+
+// Name of an implementation, e.g. "avx2":
+const char *packet_batch_impl_name(PACKET_BATCH_IMPL impl);
+
+/**
+ * @brief Look up a batch of packets in the index, prefetching the home slots
+ *      of the lookups PACKET_BATCH_PREFETCH_DISTANCE ahead so their cache
+ *      misses overlap. Invalid packets get a meaningless status, so results
+ *      for packets that failed validation must be ignored.
+ *
+ * @param index index built or mapped by subscriber_index_build()/_map()
+ * @param packets packets to look up
+ * @param statuses set to SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ * @param n number of packets
+ */
+void subscriber_index_lookup_batch(
+    const subscriber_index_t *index, const subscriber_packet_t packets[], SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n);
+
+/**
+ * @brief subscriber_index_lookup_batch() through the negative-lookup filter:
+ *      the batch's keys are tested against the filter first, then only the
+ *      ones that pass are looked up in the index, prefetched. Invalid packets
+ *      get a meaningless status and are counted in stats.
+ *
+ * @param filter filter over the index, blocks NULL to always use the index
+ * @param index index the filter was built from
+ * @param packets packets to look up
+ * @param statuses set to SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ * @param n number of packets
+ * @param stats filter counters to update
+ */
+void subscriber_filter_lookup_batch(
+    const subscriber_filter_t *filter, const subscriber_index_t *index, const subscriber_packet_t packets[],
+    SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n, subscriber_filter_stats_t *stats);
+
+/**
+ * @brief Look up a batch of packets in a packed table and its overlay index,
+ *      through the negative-lookup filter if it has blocks. Per chunk, the
+ *      bucket directory positions are prefetched, then the entries they lead
+ *      to, then the lookups run, so their cache misses overlap. Invalid
+ *      packets get a meaningless status.
+ *
+ * @param filter filter over the table and overlay, blocks NULL to skip it
+ * @param table packed subscriber table
+ * @param overlay heap index of changed subscribers
+ * @param packets packets to look up
+ * @param statuses set to SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ * @param n number of packets
+ * @param stats filter counters to update
+ */
+void subscriber_table_lookup_batch(
+    const subscriber_filter_t *filter, const subscriber_table_t *table, const subscriber_index_t *overlay,
+    const subscriber_packet_t packets[], SUBSCRIBER_PACKET_TYPE statuses[], unsigned int n,
+    subscriber_filter_stats_t *stats);
+
+#endif
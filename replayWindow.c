@@ -0,0 +1,120 @@
+/**
+ * @file replayWindow.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the server worker's replay window
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "replayWindow.h"
+
+_Static_assert(SUB_5G << REPLAY_TECHNOLOGY_SHIFT <= UINT8_MAX, "technology must fit a ring response byte");
+_Static_assert(SUB_ACC_OK - SUB_NOT_PAID <= REPLAY_STATUS_MASK, "status must fit a ring response byte");
+
+void replay_window_init(replay_window_t *window, unsigned int clients)
+{
+    uint32_t bits = 0;
+
+    memset(window, DEFAULT_VALUE, sizeof(*window));
+    if (clients < REPLAY_WINDOW_MIN_CLIENTS)
+        clients = REPLAY_WINDOW_MIN_CLIENTS;
+    window->set_count = 1;
+    while (window->set_count * REPLAY_WINDOW_WAYS < clients)
+    {
+        window->set_count <<= 1;
+        bits++;
+    }
+    window->set_shift = 64 - bits;
+    window->sets = aligned_alloc(sizeof(replay_set_t), window->set_count * sizeof(replay_set_t));
+    window->rings = aligned_alloc(sizeof(replay_ring_t), window->set_count * REPLAY_WINDOW_WAYS * sizeof(replay_ring_t));
+    window->hands = calloc(window->set_count, sizeof(uint8_t));
+    if (window->sets == NULL || window->rings == NULL || window->hands == NULL)
+        error("ERROR: Allocating replay window");
+    memset(window->sets, DEFAULT_VALUE, window->set_count * sizeof(replay_set_t));
+}
+
+void replay_window_free(replay_window_t *window)
+{
+    free(window->sets);
+    free(window->rings);
+    free(window->hands);
+    window->sets = NULL;
+    window->rings = NULL;
+    window->hands = NULL;
+}
+
+size_t replay_window_memory_bytes(const replay_window_t *window)
+{
+    return window->set_count * (sizeof(replay_set_t) + REPLAY_WINDOW_WAYS * sizeof(replay_ring_t) + sizeof(uint8_t));
+}
+
+/**
+ * @brief Way of a request's client, taken from another client if need be.
+ *
+ * @param window window from replay_window_init()
+ * @param set the request's set
+ * @param request validated request
+ * @return int the client's way, of the current epoch, its ring empty if it was not in the window
+ */
+static int replay_window_client(replay_window_t *window, replay_set_t *set, const replay_request_t *request)
+{
+    uint8_t *hand = &window->hands[set - window->sets];
+    int way = replay_set_find(set, request);
+
+    if (way < 0)
+    {
+        for (int w = 0; w < REPLAY_WINDOW_WAYS && way < 0; w++)
+            if (set->version[w] == 0)
+                way = w;
+        while (way < 0)
+        {
+            if (set->state[*hand] & REPLAY_CLIENT_REFERENCED)
+                set->state[*hand] &= ~REPLAY_CLIENT_REFERENCED;
+            else
+            {
+                way = *hand;
+                __atomic_store_n(&window->stats.evictions, window->stats.evictions + 1, __ATOMIC_RELAXED);
+            }
+            *hand = (*hand + 1) % REPLAY_WINDOW_WAYS;
+        }
+        set->address[way] = request->address;
+        set->client_id[way] = request->client_id;
+        set->port[way] = request->port;
+        set->version[way] = request->version;
+        set->state[way] = DEFAULT_VALUE;
+        set->epoch[way] = window->epoch - 1; // Emptied below
+    }
+
+    // Responses from an older database are not replayed
+    if (set->epoch[way] != window->epoch)
+    {
+        memset(&window->rings[(set - window->sets) * REPLAY_WINDOW_WAYS + way], DEFAULT_VALUE, sizeof(replay_ring_t));
+        set->epoch[way] = window->epoch;
+    }
+    return way;
+}
+
+void replay_window_insert(replay_window_t *window, const replay_request_t *request, SUBSCRIBER_PACKET_TYPE status)
+{
+    replay_set_t *set = replay_window_set(window, request);
+    int way = replay_window_client(window, set, request);
+    replay_ring_t *ring = &window->rings[(set - window->sets) * REPLAY_WINDOW_WAYS + way];
+    int entry = -1;
+
+    for (int e = 0; e < REPLAY_WINDOW_SIZE && entry < 0; e++)
+        if (ring->response[e] != 0 && ring->sequence_no[e] == request->sequence_no)
+            entry = e;
+    if (entry < 0)
+    {
+        entry = ring->head;
+        ring->head = (uint8_t)((ring->head + 1) % REPLAY_WINDOW_SIZE);
+    }
+    ring->sequence_no[entry] = request->sequence_no;
+    ring->src_sub_no[entry] = request->src_sub_no;
+    ring->response[entry] = (uint8_t)(request->technology << REPLAY_TECHNOLOGY_SHIFT | (status - SUB_NOT_PAID));
+}
@@ -0,0 +1,280 @@
+/**
+ * @file replayWindow.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the server worker's replay window, which remembers
+ *      each client's last responses so a retransmitted request is answered
+ *      again without a database lookup
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef REPLAYWINDOW_H /* include guard */
+#define REPLAYWINDOW_H
+
+#include "customProtocol.h"
+
+// Clients per set, and responses kept per client: each fills a cache line
+#define REPLAY_WINDOW_WAYS 4
+#define REPLAY_WINDOW_SIZE 7
+#define REPLAY_WINDOW_MIN_CLIENTS 64
+#define REPLAY_WINDOW_MAX_CLIENTS (1U << 24)
+
+// Client state byte: the CLOCK reference bit
+#define REPLAY_CLIENT_REFERENCED 0x80
+// Ring response byte: technology << REPLAY_TECHNOLOGY_SHIFT | status - SUB_NOT_PAID, 0 for an empty entry
+#define REPLAY_TECHNOLOGY_SHIFT 2
+#define REPLAY_STATUS_MASK 0x03
+
+// A validated request as the replay window sees it: who sent it, and what it asked
+typedef struct
+{
+    uint32_t address;     // Client IPv4 address, network byte order
+    uint32_t client_id;   // 8 bits in version 1, 32 in version 2
+    uint32_t sequence_no; // Segment number in version 1, sequence number in version 2
+    uint32_t src_sub_no;
+    uint16_t port;        // Client port, network byte order
+    uint8_t version;      // Protocol version, 1 or 2
+    uint8_t technology;
+} replay_request_t;
+
+// Keys of a set's clients, (address, port, version, client_id), and the
+// database epoch each client's ring belongs to. version == 0 marks an empty way.
+typedef struct
+{
+    uint32_t address[REPLAY_WINDOW_WAYS];
+    uint32_t client_id[REPLAY_WINDOW_WAYS];
+    uint32_t epoch[REPLAY_WINDOW_WAYS];
+    uint16_t port[REPLAY_WINDOW_WAYS];
+    uint8_t version[REPLAY_WINDOW_WAYS];
+    uint8_t state[REPLAY_WINDOW_WAYS];
+} replay_set_t;
+_Static_assert(sizeof(replay_set_t) == 64, "a set must be one cache line");
+
+// One client's last responses, one per sequence number, the oldest overwritten first
+typedef struct
+{
+    uint32_t sequence_no[REPLAY_WINDOW_SIZE];
+    uint32_t src_sub_no[REPLAY_WINDOW_SIZE];
+    uint8_t response[REPLAY_WINDOW_SIZE];
+    uint8_t head; // Next entry to overwrite
+} replay_ring_t;
+_Static_assert(sizeof(replay_ring_t) == 64, "a ring must be one cache line");
+
+// Counters, read by other threads:
+typedef struct
+{
+    uint64_t hits;      // Duplicates answered from the window
+    uint64_t misses;
+    uint64_t evictions; // Clients replaced to make room for another
+} replay_window_stats_t;
+
+// Replay window of one worker, no locking. Clients are kept in a
+// set-associative table of a fixed size, so memory is bounded however many
+// clients there are: 128 bytes per client. Each set replaces its clients in
+// CLOCK order: a hit sets the client's reference bit, and the hand skips (and
+// clears) referenced clients when choosing a victim. A change of database
+// state starts a new epoch, which empties every client's ring when next used.
+typedef struct
+{
+    replay_set_t *sets;    // NULL when the window is off
+    replay_ring_t *rings;  // Ring of way w of set s at s * REPLAY_WINDOW_WAYS + w
+    uint8_t *hands;        // CLOCK hand of each set
+    uint32_t set_shift;    // 64 - log2(sets), for multiplicative hashing
+    uint64_t set_count;
+    uint32_t epoch;
+    uint64_t generation;   // Database generation of the current epoch
+    uint64_t version;      // subscriber_store_t.version then
+    replay_window_stats_t stats;
+} replay_window_t;
+
+/**
+ * @brief Allocate an empty window.
+ *
+ * @param window window to initialize
+ * @param clients capacity, rounded up to a power of two sets of REPLAY_WINDOW_WAYS,
+ *      REPLAY_WINDOW_MIN_CLIENTS - REPLAY_WINDOW_MAX_CLIENTS
+ */
+void replay_window_init(replay_window_t *window, unsigned int clients);
+
+/**
+ * @brief Release the window's clients.
+ *
+ * @param window window from replay_window_init()
+ */
+void replay_window_free(replay_window_t *window);
+
+/**
+ * @brief Bytes allocated for the window.
+ *
+ * @param window window from replay_window_init()
+ * @return size_t sets, rings and CLOCK hands
+ */
+size_t replay_window_memory_bytes(const replay_window_t *window);
+
+/**
+ * @brief Describe a validated version 1 request.
+ *
+ * @param request request to fill
+ * @param client sender's address
+ * @param packet validated request
+ */
+static inline void replay_request_v1(replay_request_t *request, const struct sockaddr_in *client,
+                                     const subscriber_packet_t *packet)
+{
+    request->address = client->sin_addr.s_addr;
+    request->port = client->sin_port;
+    request->version = 1;
+    request->client_id = packet->client_id;
+    request->sequence_no = packet->segment_no;
+    request->src_sub_no = packet->src_sub_no;
+    request->technology = packet->technology;
+}
+
+/**
+ * @brief Describe a validated version 2 request.
+ *
+ * @param request request to fill
+ * @param client sender's address
+ * @param packet_v2 validated request
+ */
+static inline void replay_request_v2(replay_request_t *request, const struct sockaddr_in *client,
+                                     const subscriber_packet_v2_t *packet_v2)
+{
+    request->address = client->sin_addr.s_addr;
+    request->port = client->sin_port;
+    request->version = SUBSCRIBER_PROTOCOL_VERSION;
+    request->client_id = packet_v2->client_id;
+    request->sequence_no = packet_v2->sequence_no;
+    request->src_sub_no = packet_v2->src_sub_no;
+    request->technology = packet_v2->technology;
+}
+
+/**
+ * @brief Keep the window valid for the database state about to be looked up
+ *      in: start a new epoch if the generation or in-place version changed.
+ *      Read the version before the lookups, so a change made during them
+ *      starts a new epoch at the next call.
+ *
+ * @param window window from replay_window_init()
+ * @param generation generation of the database the lookups use
+ * @param version subscriber_store_version() now
+ */
+static inline void replay_window_sync(replay_window_t *window, uint64_t generation, uint64_t version)
+{
+    if (window->generation == generation && window->version == version)
+        return;
+    window->epoch++;
+    window->generation = generation;
+    window->version = version;
+}
+
+/**
+ * @brief Set of a request's client.
+ *
+ * @param window window from replay_window_init()
+ * @param request validated request
+ * @return replay_set_t* the set
+ */
+static inline replay_set_t *replay_window_set(const replay_window_t *window, const replay_request_t *request)
+{
+    uint64_t key = ((uint64_t)request->address << 32 | request->client_id) * 0x9E3779B97F4A7C15ULL;
+
+    // A second round, as addresses and client IDs handed out in turn are correlated
+    key ^= (key >> 32) ^ ((uint64_t)request->port << 8 | request->version);
+    return &window->sets[(key * 0xC2B2AE3D27D4EB4FULL) >> window->set_shift];
+}
+
+/**
+ * @brief Prefetch a request's set, the first step of a batch.
+ *
+ * @param window window from replay_window_init()
+ * @param request validated request
+ */
+static inline void replay_window_prefetch(const replay_window_t *window, const replay_request_t *request)
+{
+    __builtin_prefetch(replay_window_set(window, request));
+}
+
+/**
+ * @brief Way of a set holding a request's client.
+ *
+ * @param set the request's set
+ * @param request validated request
+ * @return int the way, -1 if the client is not in the window
+ */
+static inline int replay_set_find(const replay_set_t *set, const replay_request_t *request)
+{
+    for (int way = 0; way < REPLAY_WINDOW_WAYS; way++)
+        if (set->address[way] == request->address && set->client_id[way] == request->client_id &&
+            set->port[way] == request->port && set->version[way] == request->version)
+            return way;
+    return -1;
+}
+
+/**
+ * @brief Prefetch a request's ring, after its set: the second step of a
+ *      batch, so each request's two cache misses overlap with the others'.
+ *
+ * @param window window from replay_window_init()
+ * @param request validated request
+ */
+static inline void replay_window_prefetch_ring(const replay_window_t *window, const replay_request_t *request)
+{
+    const replay_set_t *set = replay_window_set(window, request);
+    int way = replay_set_find(set, request);
+
+    if (way >= 0)
+        __builtin_prefetch(&window->rings[(set - window->sets) * REPLAY_WINDOW_WAYS + way]);
+}
+
+/**
+ * @brief Look for a request among its client's last responses: the same
+ *      sequence number, subscriber and technology in the current epoch.
+ *
+ * @param window window from replay_window_init(), synced
+ * @param request validated request
+ * @param status set to the response's status on a hit
+ * @return true if the request is a duplicate
+ */
+static inline bool replay_window_find(replay_window_t *window, const replay_request_t *request,
+                                      SUBSCRIBER_PACKET_TYPE *status)
+{
+    replay_set_t *set = replay_window_set(window, request);
+    int way = replay_set_find(set, request);
+
+    if (way >= 0 && set->epoch[way] == window->epoch)
+    {
+        const replay_ring_t *ring = &window->rings[(set - window->sets) * REPLAY_WINDOW_WAYS + way];
+        for (int e = 0; e < REPLAY_WINDOW_SIZE; e++)
+            if (ring->sequence_no[e] == request->sequence_no && ring->src_sub_no[e] == request->src_sub_no &&
+                ring->response[e] >> REPLAY_TECHNOLOGY_SHIFT == request->technology)
+            {
+                set->state[way] |= REPLAY_CLIENT_REFERENCED;
+                *status = (SUBSCRIBER_PACKET_TYPE)(SUB_NOT_PAID + (ring->response[e] & REPLAY_STATUS_MASK));
+                __atomic_store_n(&window->stats.hits, window->stats.hits + 1, __ATOMIC_RELAXED);
+                return true;
+            }
+    }
+    __atomic_store_n(&window->stats.misses, window->stats.misses + 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+/**
+ * @brief Remember a request's response after a miss, so a retransmission is
+ *      replayed. It replaces the ring's entry of the same sequence number if
+ *      there is one, the oldest entry otherwise. A client not in the window
+ *      takes an empty way of its set if there is one, otherwise the CLOCK
+ *      victim's.
+ *
+ * @param window window from replay_window_init(), synced before the lookup
+ * @param request validated request
+ * @param status looked-up status, SUB_NOT_PAID - SUB_ACC_OK
+ */
+void replay_window_insert(replay_window_t *window, const replay_request_t *request, SUBSCRIBER_PACKET_TYPE status);
+
+#endif
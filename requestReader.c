@@ -0,0 +1,230 @@
+/**
+ * @file requestReader.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the client's streaming request reader
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "requestReader.h"
+#include <fcntl.h>
+
+_Static_assert((REQUEST_QUEUE_CAPACITY & (REQUEST_QUEUE_CAPACITY - 1)) == 0, "queue capacity must be a power of two");
+_Static_assert(REQUEST_QUEUE_CAPACITY >= 2 * REQUEST_READER_BATCH, "queue must hold a batch on each side");
+
+/**
+ * @brief Next line of the input, without its newline. Lines longer than
+ *      REQUEST_READER_MAX_LINE are cut to that length.
+ *
+ * @param parser input being parsed
+ * @param line set to the line's first byte, valid until the next call
+ * @param length set to the line's length
+ * @return true if a line was read, false at the end of the input
+ */
+static bool parser_line(request_parser_t *parser, const char **line, size_t *length)
+{
+    for (;;)
+    {
+        char *start = parser->block + parser->position;
+        size_t remaining = parser->end - parser->position;
+        char *newline = memchr(start, '\n', remaining);
+        ssize_t n;
+
+        if (newline != NULL || (parser->eof && remaining > 0))
+        {
+            *line = start;
+            *length = newline != NULL ? (size_t)(newline - start) : remaining;
+            parser->position += newline != NULL ? *length + 1 : remaining;
+            return true;
+        }
+        if (parser->eof)
+            return false;
+
+        // Keep the partial line, cut to REQUEST_READER_MAX_LINE, and read the next block after it
+        if (remaining > REQUEST_READER_MAX_LINE)
+            remaining = REQUEST_READER_MAX_LINE;
+        memmove(parser->block, start, remaining);
+        parser->position = 0;
+        parser->end = remaining;
+        while ((n = read(parser->fd, parser->block + parser->end, REQUEST_READER_BLOCK_SIZE)) < 0)
+            if (errno != EINTR)
+                error("Error reading input file");
+        parser->end += n;
+        parser->eof = n == 0;
+    }
+}
+
+/**
+ * @brief Parse a line's number like atoi(): leading blanks, an optional sign,
+ *      then digits up to the first other character. No digits is 0.
+ *
+ * @param line line from parser_line()
+ * @param length line length
+ * @return int64_t number, wrapping on overflow
+ */
+static int64_t parse_number(const char *line, size_t length)
+{
+    const char *end = line + length;
+    uint64_t value = 0;
+    bool negative = false;
+
+    while (line < end && (*line == ' ' || *line == '\t' || *line == '\r'))
+        line++;
+    if (line < end && (*line == '-' || *line == '+'))
+        negative = *line++ == '-';
+    for (; line < end && *line >= '0' && *line <= '9'; line++)
+        value = value * 10 + (uint64_t)(*line - '0');
+    return (int64_t)(negative ? 0 - value : value);
+}
+
+/**
+ * @brief Parse the next request into a request packet.
+ *
+ * @param parser input being parsed
+ * @param packet request packet to fill
+ * @return true if all four lines of a request were read
+ */
+static bool parse_request(request_parser_t *parser, subscriber_packet_t *packet)
+{
+    int64_t fields[4]; // Client ID, segment number, technology, subscriber number
+    const char *line;
+    size_t length;
+
+    for (int field = 0; field < 4; field++)
+    {
+        if (!parser_line(parser, &line, &length))
+            return false;
+        fields[field] = parse_number(line, length);
+    }
+    reset_subscriber_packet(packet);
+    update_subscriber_packet(packet, (uint8_t)fields[0], SUB_ACC_PER, (uint8_t)(fields[1] % PACKET_GROUP_SIZE),
+                             (uint8_t)fields[2], (uint32_t)fields[3]);
+    return true;
+}
+
+/**
+ * @brief Append parsed requests to the queue, waiting for room.
+ *
+ * @param reader reader
+ * @param packets requests to queue
+ * @param count number of requests, up to REQUEST_READER_BATCH
+ * @param last whether these are the input's last requests
+ * @return true if queued, false if the reader is closing
+ */
+static bool queue_requests(request_reader_t *reader, const subscriber_packet_t *packets, unsigned int count, bool last)
+{
+    pthread_mutex_lock(&reader->lock);
+    while (!reader->stopping && REQUEST_QUEUE_CAPACITY - (reader->head - reader->tail) < count)
+        pthread_cond_wait(&reader->changed, &reader->lock);
+    if (reader->stopping)
+    {
+        pthread_mutex_unlock(&reader->lock);
+        return false;
+    }
+    for (unsigned int i = 0; i < count; i++)
+        reader->ring[(reader->head + i) & (REQUEST_QUEUE_CAPACITY - 1)] = packets[i];
+    reader->head += count;
+    reader->done = last;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    return true;
+}
+
+/**
+ * @brief Parser thread: parse the requests in batches and queue them.
+ *
+ * @param arg request_reader_t being read
+ * @return void* NULL
+ */
+static void *parse_requests(void *arg)
+{
+    request_reader_t *reader = arg;
+    request_parser_t *parser = &reader->parser;
+    unsigned int count;
+
+    do
+    {
+        for (count = 0; count < REQUEST_READER_BATCH && reader->parsed < reader->announced &&
+                        parse_request(parser, &parser->batch[count]);
+             count++)
+            reader->parsed++;
+    } while (queue_requests(reader, parser->batch, count, count < REQUEST_READER_BATCH) &&
+             count == REQUEST_READER_BATCH);
+    return NULL;
+}
+
+void request_reader_open(request_reader_t *reader, const char *filename)
+{
+    request_parser_t *parser = &reader->parser;
+    const char *line;
+    size_t length;
+
+    memset(reader, DEFAULT_VALUE, sizeof(*reader));
+    if (strcmp(filename, "-") == 0)
+        parser->fd = STDIN_FILENO;
+    else if ((parser->fd = open(filename, O_RDONLY)) < 0)
+        error("Error opening file");
+    posix_fadvise(parser->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    parser->block = malloc(REQUEST_READER_BLOCK_SIZE + REQUEST_READER_MAX_LINE);
+    reader->ring = malloc(REQUEST_QUEUE_CAPACITY * sizeof(subscriber_packet_t));
+    if (parser->block == NULL || reader->ring == NULL)
+        error("Error: Allocating request reader");
+
+    // Read the number of requests:
+    if (parser_line(parser, &line, &length))
+        reader->announced = (uint64_t)parse_number(line, length);
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    if (pthread_create(&reader->thread, NULL, parse_requests, reader) != 0)
+        error("Error: Starting request reader");
+}
+
+REQUEST_READ request_reader_next(request_reader_t *reader, subscriber_packet_t *packet, bool wait)
+{
+    if (reader->batch_position == reader->batch_count)
+    {
+        uint64_t queued;
+
+        // Take up to a batch from the queue
+        pthread_mutex_lock(&reader->lock);
+        while (wait && reader->head == reader->tail && !reader->done)
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        if ((queued = reader->head - reader->tail) == 0)
+        {
+            REQUEST_READ result = reader->done ? REQUEST_READ_END : REQUEST_READ_EMPTY;
+            pthread_mutex_unlock(&reader->lock);
+            return result;
+        }
+        reader->batch_count = queued < REQUEST_READER_BATCH ? (unsigned int)queued : REQUEST_READER_BATCH;
+        for (unsigned int i = 0; i < reader->batch_count; i++)
+            reader->batch[i] = reader->ring[(reader->tail + i) & (REQUEST_QUEUE_CAPACITY - 1)];
+        reader->tail += reader->batch_count;
+        reader->batch_position = 0;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+    }
+    *packet = reader->batch[reader->batch_position++];
+    return REQUEST_READ_OK;
+}
+
+void request_reader_close(request_reader_t *reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    reader->stopping = true;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->thread, NULL);
+
+    if (reader->parser.fd != STDIN_FILENO)
+        close(reader->parser.fd);
+    free(reader->parser.block);
+    free(reader->ring);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+}
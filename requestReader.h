@@ -0,0 +1,101 @@
+/**
+ * @file requestReader.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the client's streaming request reader: a parser
+ *      thread reads the input file in fixed blocks and hands request packets
+ *      to the sender through a bounded queue, so memory stays the same for
+ *      any input size
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef REQUESTREADER_H /* include guard */
+#define REQUESTREADER_H
+
+#include "customProtocol.h"
+#include <pthread.h>
+
+// Input read() size, and the longest line kept across a block boundary
+#define REQUEST_READER_BLOCK_SIZE (1 << 20)
+#define REQUEST_READER_MAX_LINE 256
+// Parsed requests waiting to be sent, and requests moved per queue lock
+#define REQUEST_QUEUE_CAPACITY 65536
+#define REQUEST_READER_BATCH 1024
+
+// Result of request_reader_next():
+typedef enum
+{
+    REQUEST_READ_OK,    // A request was returned
+    REQUEST_READ_EMPTY, // The parser has not caught up, try again later
+    REQUEST_READ_END    // Every request has been returned
+} REQUEST_READ;
+
+// Input being parsed, owned by the parser thread after request_reader_open():
+typedef struct
+{
+    int fd;
+    char *block;                                   // REQUEST_READER_BLOCK_SIZE + REQUEST_READER_MAX_LINE bytes
+    size_t position, end;                          // Unparsed bytes are block[position - end)
+    bool eof;                                      // read() returned 0
+    subscriber_packet_t batch[REQUEST_READER_BATCH]; // Parsed, not yet queued
+} request_parser_t;
+
+// Streaming request reader. The queue is a ring of REQUEST_QUEUE_CAPACITY
+// packets; the parser and the sender move whole batches under the lock, so
+// it is taken once per REQUEST_READER_BATCH requests.
+typedef struct
+{
+    uint64_t announced; // Request count on the file's first line
+    uint64_t parsed;    // Requests parsed so far, parser thread only
+
+    // Queue, under lock:
+    subscriber_packet_t *ring;
+    uint64_t head, tail; // Requests ever queued, and ever taken
+    bool done;           // The parser queued its last request
+    bool stopping;       // request_reader_close() asked the parser to stop
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // Signaled when the queue gains requests or room, or ends
+
+    // Sender side:
+    subscriber_packet_t batch[REQUEST_READER_BATCH]; // Taken from the queue
+    unsigned int batch_position, batch_count;
+
+    request_parser_t parser;
+    pthread_t thread;
+} request_reader_t;
+
+/**
+ * @brief Open a request file, read the request count on its first line, and
+ *      start parsing the requests on a thread of their own. Each request is
+ *      four lines: client ID, segment number, technology and subscriber number.
+ *
+ * @param reader reader to initialize
+ * @param filename request file, "-" for standard input
+ */
+void request_reader_open(request_reader_t *reader, const char *filename);
+
+/**
+ * @brief Take the next request, in file order. The parser stops after the
+ *      announced count, or at the end of the file; a last, incomplete request
+ *      is dropped.
+ *
+ * @param reader reader from request_reader_open()
+ * @param packet set to the request, with its segment number in 0 - PACKET_GROUP_SIZE-1
+ * @param wait block until the parser has a request, instead of returning REQUEST_READ_EMPTY
+ * @return REQUEST_READ whether a request was returned
+ */
+REQUEST_READ request_reader_next(request_reader_t *reader, subscriber_packet_t *packet, bool wait);
+
+/**
+ * @brief Stop the parser and release the reader.
+ *
+ * @param reader reader from request_reader_open()
+ */
+void request_reader_close(request_reader_t *reader);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * @file responseCache.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement allocating and emptying the response cache
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "responseCache.h"
+
+void response_cache_init(response_cache_t *cache, unsigned int entries)
+{
+    uint32_t bits = 0;
+
+    memset(cache, DEFAULT_VALUE, sizeof(*cache));
+    if (entries < RESPONSE_CACHE_MIN_ENTRIES)
+        entries = RESPONSE_CACHE_MIN_ENTRIES;
+    cache->set_count = 1;
+    while (cache->set_count * RESPONSE_CACHE_WAYS < entries)
+    {
+        cache->set_count <<= 1;
+        bits++;
+    }
+    cache->set_shift = 64 - bits;
+    cache->entries = aligned_alloc(RESPONSE_CACHE_WAYS * sizeof(response_cache_entry_t),
+                                   cache->set_count * RESPONSE_CACHE_WAYS * sizeof(response_cache_entry_t));
+    cache->hands = calloc(cache->set_count, sizeof(uint8_t));
+    if (cache->entries == NULL || cache->hands == NULL)
+        error("ERROR: Allocating response cache");
+    response_cache_clear(cache);
+}
+
+void response_cache_free(response_cache_t *cache)
+{
+    free(cache->entries);
+    free(cache->hands);
+    cache->entries = NULL;
+    cache->hands = NULL;
+}
+
+void response_cache_clear(response_cache_t *cache)
+{
+    memset(cache->entries, DEFAULT_VALUE, cache->set_count * RESPONSE_CACHE_WAYS * sizeof(response_cache_entry_t));
+}
@@ -0,0 +1,197 @@
+/**
+ * @file responseCache.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the server worker's response cache, which answers
+ *      retransmitted and repeated requests without a database lookup
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef RESPONSECACHE_H /* include guard */
+#define RESPONSECACHE_H
+
+#include "customProtocol.h"
+
+// Entries per set, 8 bytes each so a set is one cache line
+#define RESPONSE_CACHE_WAYS 8
+#define RESPONSE_CACHE_MIN_ENTRIES 64
+#define RESPONSE_CACHE_MAX_ENTRIES (1U << 24)
+
+// Entry status byte: status - SUB_NOT_PAID, and the CLOCK reference bit
+#define RESPONSE_CACHE_STATUS_MASK 0x03
+#define RESPONSE_CACHE_REFERENCED 0x80
+
+// One cached response, keyed by the request's subscriber, client and segment.
+// technology == 0 marks an empty entry.
+typedef struct
+{
+    uint32_t src_sub_no;
+    uint8_t technology;
+    uint8_t client_id;
+    uint8_t segment_no;
+    uint8_t status;
+} response_cache_entry_t;
+_Static_assert(sizeof(response_cache_entry_t) == 8, "RESPONSE_CACHE_WAYS entries must fill a cache line");
+
+// Counters, read by other threads:
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations; // Times the cache was emptied for a database change
+} response_cache_stats_t;
+
+// Set-associative response cache of one worker, no locking. Each set
+// replaces its entries in CLOCK order: a hit sets the entry's reference bit,
+// and the hand skips (and clears) referenced entries when choosing a victim.
+// Entries hold lookups in one database state, (generation, version); any
+// change of either empties the cache.
+typedef struct
+{
+    response_cache_entry_t *entries; // NULL when the cache is off
+    uint8_t *hands;                  // CLOCK hand of each set
+    uint32_t set_shift;              // 64 - log2(sets), for multiplicative hashing
+    uint64_t set_count;
+    uint64_t generation;             // Database generation the entries were looked up in
+    uint64_t version;                // subscriber_store_t.version then
+    response_cache_stats_t stats;
+} response_cache_t;
+
+/**
+ * @brief Allocate an empty cache.
+ *
+ * @param cache cache to initialize
+ * @param entries capacity, rounded up to a power of two sets of RESPONSE_CACHE_WAYS,
+ *      RESPONSE_CACHE_MIN_ENTRIES - RESPONSE_CACHE_MAX_ENTRIES
+ */
+void response_cache_init(response_cache_t *cache, unsigned int entries);
+
+/**
+ * @brief Release the cache's entries.
+ *
+ * @param cache cache from response_cache_init()
+ */
+void response_cache_free(response_cache_t *cache);
+
+/**
+ * @brief Empty the cache, keeping its counters.
+ *
+ * @param cache cache from response_cache_init()
+ */
+void response_cache_clear(response_cache_t *cache);
+
+/**
+ * @brief Keep the cache valid for the database state about to be looked up
+ *      in: empty it if the generation or in-place version changed. Read the
+ *      version before the lookups, so a change made during them empties the
+ *      cache at the next call.
+ *
+ * @param cache cache from response_cache_init()
+ * @param generation generation of the database the lookups use
+ * @param version subscriber_store_version() now
+ */
+static inline void response_cache_sync(response_cache_t *cache, uint64_t generation, uint64_t version)
+{
+    if (cache->generation == generation && cache->version == version)
+        return;
+    // Generations start at 1, so 0 is the new, still empty cache
+    if (cache->generation != 0)
+    {
+        response_cache_clear(cache);
+        __atomic_store_n(&cache->stats.invalidations, cache->stats.invalidations + 1, __ATOMIC_RELAXED);
+    }
+    cache->generation = generation;
+    cache->version = version;
+}
+
+/**
+ * @brief Set of a request's key.
+ *
+ * @param cache cache from response_cache_init()
+ * @param packet validated request
+ * @return response_cache_entry_t* first of the set's RESPONSE_CACHE_WAYS entries
+ */
+static inline response_cache_entry_t *response_cache_set(const response_cache_t *cache, const subscriber_packet_t *packet)
+{
+    uint64_t key = ((uint64_t)packet->src_sub_no << 24) | ((uint64_t)packet->technology << 16) |
+                   ((uint64_t)packet->client_id << 8) | packet->segment_no;
+
+    return &cache->entries[((key * 0x9E3779B97F4A7C15ULL) >> cache->set_shift) * RESPONSE_CACHE_WAYS];
+}
+
+/**
+ * @brief Whether an entry holds a request's key.
+ *
+ * @param entry cache entry
+ * @param packet validated request
+ * @return true if it does
+ */
+static inline bool response_cache_matches(const response_cache_entry_t *entry, const subscriber_packet_t *packet)
+{
+    return entry->src_sub_no == packet->src_sub_no && entry->technology == packet->technology &&
+           entry->client_id == packet->client_id && entry->segment_no == packet->segment_no;
+}
+
+/**
+ * @brief Look up a validated request's response.
+ *
+ * @param cache cache from response_cache_init(), synced
+ * @param packet validated request
+ * @param status set to the cached status on a hit
+ * @return true on a hit
+ */
+static inline bool response_cache_find(response_cache_t *cache, const subscriber_packet_t *packet,
+                                       SUBSCRIBER_PACKET_TYPE *status)
+{
+    response_cache_entry_t *set = response_cache_set(cache, packet);
+
+    for (int way = 0; way < RESPONSE_CACHE_WAYS; way++)
+        if (response_cache_matches(&set[way], packet))
+        {
+            set[way].status |= RESPONSE_CACHE_REFERENCED;
+            *status = (SUBSCRIBER_PACKET_TYPE)(SUB_NOT_PAID + (set[way].status & RESPONSE_CACHE_STATUS_MASK));
+            __atomic_store_n(&cache->stats.hits, cache->stats.hits + 1, __ATOMIC_RELAXED);
+            return true;
+        }
+    __atomic_store_n(&cache->stats.misses, cache->stats.misses + 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+/**
+ * @brief Cache a request's response after a miss. An empty entry of the set
+ *      is used if there is one, otherwise the CLOCK victim.
+ *
+ * @param cache cache from response_cache_init(), synced before the lookup
+ * @param packet validated request
+ * @param status looked-up status, SUB_NOT_PAID - SUB_ACC_OK
+ */
+static inline void response_cache_insert(response_cache_t *cache, const subscriber_packet_t *packet,
+                                         SUBSCRIBER_PACKET_TYPE status)
+{
+    response_cache_entry_t *set = response_cache_set(cache, packet), *victim = NULL;
+    uint8_t *hand = &cache->hands[(set - cache->entries) / RESPONSE_CACHE_WAYS];
+
+    for (int way = 0; way < RESPONSE_CACHE_WAYS && victim == NULL; way++)
+        if (set[way].technology == 0)
+            victim = &set[way];
+    while (victim == NULL)
+    {
+        if (set[*hand].status & RESPONSE_CACHE_REFERENCED)
+            set[*hand].status &= ~RESPONSE_CACHE_REFERENCED;
+        else
+            victim = &set[*hand];
+        *hand = (*hand + 1) % RESPONSE_CACHE_WAYS;
+    }
+    victim->src_sub_no = packet->src_sub_no;
+    victim->technology = packet->technology;
+    victim->client_id = packet->client_id;
+    victim->segment_no = packet->segment_no;
+    victim->status = (uint8_t)(status - SUB_NOT_PAID);
+}
+
+#endif
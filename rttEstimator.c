@@ -0,0 +1,175 @@
+/**
+ * @file rttEstimator.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the adaptive ACK timer and the latency histogram
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "rttEstimator.h"
+
+/**
+ * @brief Clamp the timeout to the estimator's bounds.
+ *
+ * @param estimator estimator
+ * @param rto_ns timeout
+ * @return uint64_t clamped timeout
+ */
+static uint64_t clamp_rto(const rtt_estimator_t *estimator, uint64_t rto_ns)
+{
+    if (rto_ns < estimator->min_rto_ns)
+        return estimator->min_rto_ns;
+    if (rto_ns > estimator->max_rto_ns)
+        return estimator->max_rto_ns;
+    return rto_ns;
+}
+
+void rtt_estimator_init(rtt_estimator_t *estimator, uint64_t initial_rto_ns, uint64_t min_rto_ns, uint64_t max_rto_ns)
+{
+    memset(estimator, DEFAULT_VALUE, sizeof(*estimator));
+    estimator->min_rto_ns = min_rto_ns;
+    estimator->max_rto_ns = max_rto_ns;
+    estimator->rto_ns = clamp_rto(estimator, initial_rto_ns);
+    estimator->random = monotonic_time_ns() | 1;
+}
+
+void rtt_estimator_sample(rtt_estimator_t *estimator, uint64_t rtt_ns)
+{
+    if (estimator->samples++ == 0)
+    {
+        estimator->srtt_ns = rtt_ns;
+        estimator->rttvar_ns = rtt_ns / 2;
+    }
+    else
+    {
+        uint64_t error = rtt_ns > estimator->srtt_ns ? rtt_ns - estimator->srtt_ns : estimator->srtt_ns - rtt_ns;
+        estimator->rttvar_ns = estimator->rttvar_ns - estimator->rttvar_ns / 4 + error / 4;
+        estimator->srtt_ns = estimator->srtt_ns - estimator->srtt_ns / 8 + rtt_ns / 8;
+    }
+    estimator->rto_ns = clamp_rto(estimator, estimator->srtt_ns + 4 * estimator->rttvar_ns);
+}
+
+uint64_t rtt_estimator_timeout(rtt_estimator_t *estimator, unsigned int attempts)
+{
+    uint64_t timeout = estimator->rto_ns;
+
+    if (attempts == 0)
+        return timeout;
+
+    // Exponential backoff, stopping at the upper clamp:
+    for (unsigned int i = 0; i < attempts && timeout < estimator->max_rto_ns; i++)
+        timeout <<= 1;
+    timeout = clamp_rto(estimator, timeout);
+
+    // A fixed timer stays fixed
+    if (estimator->min_rto_ns == estimator->max_rto_ns)
+        return timeout;
+
+    // Jitter in [-ACK_TIMER_JITTER_PERCENT, +ACK_TIMER_JITTER_PERCENT], then
+    // clamped again so it never takes the timer past its bounds:
+    estimator->random ^= estimator->random << 13;
+    estimator->random ^= estimator->random >> 7;
+    estimator->random ^= estimator->random << 17;
+    uint64_t span = timeout / 100 * ACK_TIMER_JITTER_PERCENT;
+    if (span > 0)
+        timeout = timeout - span + estimator->random % (2 * span + 1);
+    return clamp_rto(estimator, timeout);
+}
+
+/**
+ * @brief Bucket of a latency: exact below 2 * LATENCY_SUB_BUCKETS, then
+ *      LATENCY_SUB_BUCKETS buckets per power of two.
+ *
+ * @param latency_ns latency
+ * @return unsigned int bucket index
+ */
+static unsigned int latency_bucket(uint64_t latency_ns)
+{
+    if (latency_ns < 2 * LATENCY_SUB_BUCKETS)
+        return (unsigned int)latency_ns;
+    unsigned int shift = 63 - __builtin_clzll(latency_ns) - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (unsigned int)(latency_ns >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+/**
+ * @brief Lowest latency that falls in a bucket.
+ *
+ * @param bucket bucket index
+ * @return uint64_t latency in nanoseconds
+ */
+static uint64_t latency_bucket_value(unsigned int bucket)
+{
+    if (bucket < 2 * LATENCY_SUB_BUCKETS)
+        return bucket;
+    unsigned int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (uint64_t)(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+}
+
+void latency_histogram_init(latency_histogram_t *histogram)
+{
+    memset(histogram, DEFAULT_VALUE, sizeof(*histogram));
+    histogram->min_ns = UINT64_MAX;
+}
+
+void latency_histogram_record(latency_histogram_t *histogram, uint64_t latency_ns)
+{
+    histogram->buckets[latency_bucket(latency_ns)]++;
+    histogram->count++;
+    histogram->sum_ns += latency_ns;
+    if (latency_ns < histogram->min_ns)
+        histogram->min_ns = latency_ns;
+    if (latency_ns > histogram->max_ns)
+        histogram->max_ns = latency_ns;
+}
+
+void latency_histogram_merge(latency_histogram_t *into, const latency_histogram_t *from)
+{
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum_ns += from->sum_ns;
+    if (from->min_ns < into->min_ns)
+        into->min_ns = from->min_ns;
+    if (from->max_ns > into->max_ns)
+        into->max_ns = from->max_ns;
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram_t *histogram, double percentile)
+{
+    uint64_t rank, seen = 0;
+
+    if (histogram->count == 0)
+        return 0;
+    rank = (uint64_t)(percentile / 100.0 * histogram->count);
+    if (rank >= histogram->count)
+        rank = histogram->count - 1;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+            return latency_bucket_value(i);
+    }
+    return histogram->max_ns;
+}
+
+void latency_histogram_print(const latency_histogram_t *histogram, FILE *out, const char *label)
+{
+    if (histogram->count == 0)
+    {
+        fprintf(out, "%s: no samples\n", label);
+        return;
+    }
+    fprintf(out, "%s: %llu samples, min %.1f us, mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+            label, (unsigned long long)histogram->count, histogram->min_ns / 1e3,
+            (double)histogram->sum_ns / histogram->count / 1e3,
+            latency_histogram_percentile(histogram, 50) / 1e3,
+            latency_histogram_percentile(histogram, 90) / 1e3,
+            latency_histogram_percentile(histogram, 99) / 1e3,
+            latency_histogram_percentile(histogram, 99.9) / 1e3,
+            histogram->max_ns / 1e3);
+}
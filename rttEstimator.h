@@ -0,0 +1,121 @@
+/**
+ * @file rttEstimator.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the adaptive ACK timer (Jacobson/Karn RTT
+ *      estimation) and the latency histogram used to report RTT percentiles
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef RTTESTIMATOR_H /* include guard */
+#define RTTESTIMATOR_H
+
+#include "customProtocol.h"
+
+// Latency histogram: log-linear buckets, LATENCY_SUB_BUCKETS per power of two
+// (under 1.6% error), covering every uint64_t nanosecond value
+#define LATENCY_SUB_BUCKET_BITS 6
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+// Smoothed RTT estimator (RFC 6298 gains: alpha 1/8, beta 1/4, K = 4):
+typedef struct
+{
+    uint64_t srtt_ns;
+    uint64_t rttvar_ns;
+    uint64_t rto_ns;    // Timeout for an original transmission
+    uint64_t min_rto_ns;
+    uint64_t max_rto_ns;
+    uint64_t samples;
+    uint64_t random;    // xorshift state for the backoff jitter
+} rtt_estimator_t;
+
+// Latency histogram:
+typedef struct
+{
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t sum_ns;
+} latency_histogram_t;
+
+/**
+ * @brief Initialize the estimator with no samples.
+ *
+ * @param estimator estimator to initialize
+ * @param initial_rto_ns timeout until the first sample
+ * @param min_rto_ns lower clamp for the timeout
+ * @param max_rto_ns upper clamp for the timeout, also for backed-off retries
+ */
+void rtt_estimator_init(rtt_estimator_t *estimator, uint64_t initial_rto_ns, uint64_t min_rto_ns, uint64_t max_rto_ns);
+
+/**
+ * @brief Add an RTT sample. Per Karn's algorithm, only feed samples from
+ *      requests that were never retransmitted, retransmitted ones are ambiguous.
+ *
+ * @param estimator estimator to update
+ * @param rtt_ns measured round-trip time
+ */
+void rtt_estimator_sample(rtt_estimator_t *estimator, uint64_t rtt_ns);
+
+/**
+ * @brief ACK timer for a transmission: the current timeout doubled per
+ *      previous attempt, with +/- ACK_TIMER_JITTER_PERCENT jitter on retries
+ *      so clients that lost packets together don't retry together. The
+ *      result stays within the estimator's bounds, and a fixed timer
+ *      (min == max) gets no jitter.
+ *
+ * @param estimator estimator
+ * @param attempts retransmissions so far, 0 for the original
+ * @return uint64_t timeout in nanoseconds
+ */
+uint64_t rtt_estimator_timeout(rtt_estimator_t *estimator, unsigned int attempts);
+
+/**
+ * @brief Reset a histogram to empty.
+ *
+ * @param histogram histogram to clear
+ */
+void latency_histogram_init(latency_histogram_t *histogram);
+
+/**
+ * @brief Record one latency.
+ *
+ * @param histogram histogram to update
+ * @param latency_ns latency in nanoseconds
+ */
+void latency_histogram_record(latency_histogram_t *histogram, uint64_t latency_ns);
+
+/**
+ * @brief Add every sample of one histogram into another.
+ *
+ * @param into histogram to update
+ * @param from histogram to add
+ */
+void latency_histogram_merge(latency_histogram_t *into, const latency_histogram_t *from);
+
+/**
+ * @brief Latency at a percentile.
+ *
+ * @param histogram histogram
+ * @param percentile 0 - 100, e.g. 99.9
+ * @return uint64_t latency in nanoseconds (bucket lower bound), 0 if empty
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t *histogram, double percentile);
+
+/**
+ * @brief Print count, min, mean, p50, p90, p99, p999 and max in microseconds.
+ *
+ * @param histogram histogram
+ * @param out stream to print to
+ * @param label line prefix
+ */
+void latency_histogram_print(const latency_histogram_t *histogram, FILE *out, const char *label);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * @file sequenceWindow.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the client's window of in-flight version 2 requests
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "sequenceWindow.h"
+
+/**
+ * @brief Put a request's ACK timer in the bucket of its deadline tick. Timers
+ *      already due go in the current bucket, and ones past the wheel's span in
+ *      its last, to be moved on when that bucket is passed.
+ *
+ * @param window client window
+ * @param slot request's slot
+ */
+static void timer_link(sequence_window_t *window, uint32_t slot)
+{
+    sequence_request_t *request = &window->requests[slot];
+    uint64_t tick = request->deadline_ns >> SEQUENCE_TIMER_TICK_SHIFT;
+    unsigned int bucket;
+
+    if (tick < window->timer_tick)
+        tick = window->timer_tick;
+    if (tick > window->timer_tick + SEQUENCE_TIMER_SLOTS - 1)
+        tick = window->timer_tick + SEQUENCE_TIMER_SLOTS - 1;
+    bucket = tick & (SEQUENCE_TIMER_SLOTS - 1);
+
+    request->timer_bucket = bucket;
+    request->timer_prev = SEQUENCE_TIMER_NONE;
+    request->timer_next = window->timers[bucket];
+    if (request->timer_next != SEQUENCE_TIMER_NONE)
+        window->requests[request->timer_next].timer_prev = slot;
+    window->timers[bucket] = slot;
+    window->timer_bits[bucket / 64] |= 1ULL << (bucket % 64);
+}
+
+/**
+ * @brief Take a request's ACK timer out of its bucket.
+ *
+ * @param window client window
+ * @param slot request's slot
+ */
+static void timer_unlink(sequence_window_t *window, uint32_t slot)
+{
+    sequence_request_t *request = &window->requests[slot];
+
+    if (request->timer_next != SEQUENCE_TIMER_NONE)
+        window->requests[request->timer_next].timer_prev = request->timer_prev;
+    if (request->timer_prev != SEQUENCE_TIMER_NONE)
+        window->requests[request->timer_prev].timer_next = request->timer_next;
+    else
+    {
+        window->timers[request->timer_bucket] = request->timer_next;
+        if (request->timer_next == SEQUENCE_TIMER_NONE)
+            window->timer_bits[request->timer_bucket / 64] &= ~(1ULL << (request->timer_bucket % 64));
+    }
+}
+
+void sequence_window_init(sequence_window_t *window, unsigned int window_size, uint32_t first_sequence)
+{
+    uint32_t slot_count = 2;
+
+    memset(window, DEFAULT_VALUE, sizeof(*window));
+    while (slot_count < 2 * window_size)
+        slot_count <<= 1;
+    if ((window->requests = calloc(slot_count, sizeof(sequence_request_t))) == NULL)
+        error("Error: Allocating sequence window");
+    window->slot_mask = slot_count - 1;
+    window->next_sequence = first_sequence;
+    window->window_size = window_size;
+    for (unsigned int bucket = 0; bucket < SEQUENCE_TIMER_SLOTS; bucket++)
+        window->timers[bucket] = SEQUENCE_TIMER_NONE;
+}
+
+void sequence_window_free(sequence_window_t *window)
+{
+    free(window->requests);
+    window->requests = NULL;
+}
+
+sequence_request_t *sequence_window_add(sequence_window_t *window, const subscriber_packet_v2_t *packet,
+                                        uint64_t request_no, uint32_t owner, uint64_t now_ns, uint64_t timeout_ns)
+{
+    sequence_request_t *request;
+    uint32_t slot;
+
+    // Skip the sequence numbers whose slot is still taken
+    while (window->requests[window->next_sequence & window->slot_mask].in_flight)
+        window->next_sequence++;
+    slot = window->next_sequence & window->slot_mask;
+    request = &window->requests[slot];
+
+    // An empty wheel starts at the current tick rather than walking the idle time
+    if (window->in_flight_count == 0)
+        window->timer_tick = now_ns >> SEQUENCE_TIMER_TICK_SHIFT;
+
+    request->packet = *packet;
+    request->packet.sequence_no = window->next_sequence++;
+    request->request_no = request_no;
+    request->sent_ns = now_ns;
+    request->deadline_ns = now_ns + timeout_ns;
+    request->attempts = 0;
+    request->owner = owner;
+    request->in_flight = true;
+    timer_link(window, slot);
+    window->in_flight_count++;
+    return request;
+}
+
+sequence_request_t *sequence_window_match(sequence_window_t *window, const subscriber_packet_v2_t *response)
+{
+    sequence_request_t *request = &window->requests[response->sequence_no & window->slot_mask];
+
+    if (!request->in_flight ||
+        request->packet.sequence_no != response->sequence_no ||
+        request->packet.client_id != response->client_id ||
+        request->packet.technology != response->technology ||
+        request->packet.src_sub_no != response->src_sub_no)
+        return NULL;
+    return request;
+}
+
+void sequence_window_remove(sequence_window_t *window, sequence_request_t *request)
+{
+    timer_unlink(window, request - window->requests);
+    request->in_flight = false;
+    window->in_flight_count--;
+}
+
+void sequence_window_rearm(sequence_window_t *window, sequence_request_t *request, uint64_t now_ns, uint64_t timeout_ns)
+{
+    uint32_t slot = request - window->requests;
+
+    timer_unlink(window, slot);
+    request->sent_ns = now_ns;
+    request->deadline_ns = now_ns + timeout_ns;
+    timer_link(window, slot);
+}
+
+sequence_request_t *sequence_window_next_expired(sequence_window_t *window, uint64_t now_ns)
+{
+    uint64_t now_tick = now_ns >> SEQUENCE_TIMER_TICK_SHIFT;
+
+    // Only whole ticks in the past, so every timer of a bucket is due
+    while (window->timer_tick < now_tick && window->in_flight_count > 0)
+    {
+        uint32_t slot = window->timers[window->timer_tick & (SEQUENCE_TIMER_SLOTS - 1)];
+        if (slot == SEQUENCE_TIMER_NONE)
+        {
+            window->timer_tick++;
+            continue;
+        }
+        if (window->requests[slot].deadline_ns <= now_ns)
+            return &window->requests[slot];
+        // Past the wheel's span when it was linked: move it on, to a later bucket
+        timer_unlink(window, slot);
+        timer_link(window, slot);
+    }
+    return NULL;
+}
+
+uint64_t sequence_window_next_deadline(const sequence_window_t *window)
+{
+    unsigned int start = window->timer_tick & (SEQUENCE_TIMER_SLOTS - 1), words = SEQUENCE_TIMER_SLOTS / 64;
+
+    if (window->in_flight_count == 0)
+        return UINT64_MAX;
+    // First bucket in use from the current one on, wrapping around
+    for (unsigned int i = 0; i <= words; i++)
+    {
+        unsigned int word = (start / 64 + i) % words;
+        uint64_t bits = window->timer_bits[word];
+        if (i == 0)
+            bits &= ~0ULL << (start % 64);
+        else if (i == words)
+            bits &= (1ULL << (start % 64)) - 1;
+        if (bits != 0)
+        {
+            unsigned int bucket = word * 64 + __builtin_ctzll(bits);
+            uint64_t tick = window->timer_tick + ((bucket - start) & (SEQUENCE_TIMER_SLOTS - 1));
+            return (tick + 1) << SEQUENCE_TIMER_TICK_SHIFT;
+        }
+    }
+    return UINT64_MAX;
+}
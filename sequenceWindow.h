@@ -0,0 +1,153 @@
+/**
+ * @file sequenceWindow.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the client's window of in-flight version 2
+ *      requests, matched to responses by sequence number, with the ACK timers
+ *      on a timer wheel so the window can hold many thousands of requests
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SEQUENCEWINDOW_H /* include guard */
+#define SEQUENCEWINDOW_H
+
+#include "customProtocol.h"
+
+// Largest window, in requests in flight
+#define MAX_SEQUENCE_WINDOW (1U << 22)
+// ACK timer wheel: 2^SEQUENCE_TIMER_TICK_SHIFT ns (about 1 ms) per bucket, and
+// SEQUENCE_TIMER_SLOTS buckets, about 4.3 s, longer than any ACK timer
+#define SEQUENCE_TIMER_TICK_SHIFT 20
+#define SEQUENCE_TIMER_SLOTS 4096
+#define SEQUENCE_TIMER_NONE UINT32_MAX
+_Static_assert(((uint64_t)SEQUENCE_TIMER_SLOTS << SEQUENCE_TIMER_TICK_SHIFT) > ACK_TIMER_WAIT_TIME_MS * 1000000ULL,
+               "the timer wheel must span the longest ACK timer");
+
+// One in-flight request:
+typedef struct
+{
+    subscriber_packet_v2_t packet;   // As sent, with its sequence number, for retransmission
+    uint64_t request_no;             // Position in the input, for reporting
+    uint64_t sent_ns;                // Last (re)transmission
+    uint64_t deadline_ns;            // ACK timer expiry
+    unsigned int attempts;           // Retransmissions so far, 0 for the original
+    uint32_t owner;                  // Caller's tag, e.g. the logical client that sent it
+    uint32_t timer_prev, timer_next; // Other requests in its timer wheel bucket
+    uint32_t timer_bucket;
+    bool in_flight;
+} sequence_request_t;
+
+// Window of in-flight requests. Each request gets the next sequence number
+// whose slot (sequence_no & slot_mask) is free, so a request that is still
+// being retried never holds up the ones after it. There are at least twice
+// as many slots as requests in flight, so a free one is near.
+typedef struct
+{
+    sequence_request_t *requests; // Slots, indexed by sequence_no & slot_mask
+    uint32_t slot_mask;
+    uint32_t next_sequence;
+    unsigned int in_flight_count;
+    unsigned int window_size;
+
+    // ACK timers, bucketed by deadline tick. Buckets before timer_tick have
+    // been expired; a bit per bucket marks the ones in use.
+    uint32_t timers[SEQUENCE_TIMER_SLOTS];
+    uint64_t timer_bits[SEQUENCE_TIMER_SLOTS / 64];
+    uint64_t timer_tick;
+} sequence_window_t;
+
+/**
+ * @brief Allocate an empty window.
+ *
+ * @param window window to initialize
+ * @param window_size maximum requests in flight, 1 - MAX_SEQUENCE_WINDOW
+ * @param first_sequence sequence number of the first request
+ */
+void sequence_window_init(sequence_window_t *window, unsigned int window_size, uint32_t first_sequence);
+
+/**
+ * @brief Release the window's slots.
+ *
+ * @param window window from sequence_window_init()
+ */
+void sequence_window_free(sequence_window_t *window);
+
+/**
+ * @brief Whether another request may be sent now.
+ *
+ * @param window client window
+ * @return true if fewer than window_size requests are in flight
+ */
+static inline bool sequence_window_has_room(const sequence_window_t *window)
+{
+    return window->in_flight_count < window->window_size;
+}
+
+/**
+ * @brief Give a new request its sequence number and add it, before it is sent.
+ *
+ * @param window client window, must have room
+ * @param packet request, its sequence number is set in the window's copy
+ * @param request_no position in the input
+ * @param owner caller's tag
+ * @param now_ns send time
+ * @param timeout_ns ACK timer, below the wheel's span
+ * @return sequence_request_t* the in-flight request, send its packet
+ */
+sequence_request_t *sequence_window_add(sequence_window_t *window, const subscriber_packet_v2_t *packet,
+                                        uint64_t request_no, uint32_t owner, uint64_t now_ns, uint64_t timeout_ns);
+
+/**
+ * @brief Find the in-flight request a response answers, by sequence number,
+ *      checked against the request's client ID, subscriber and technology.
+ *
+ * @param window client window
+ * @param response received response
+ * @return sequence_request_t* the request, NULL for a stale or unknown response
+ */
+sequence_request_t *sequence_window_match(sequence_window_t *window, const subscriber_packet_v2_t *response);
+
+/**
+ * @brief Remove a completed or abandoned request.
+ *
+ * @param window client window
+ * @param request request from sequence_window_add()
+ */
+void sequence_window_remove(sequence_window_t *window, sequence_request_t *request);
+
+/**
+ * @brief Restart a request's ACK timer after a retransmission.
+ *
+ * @param window client window
+ * @param request in-flight request
+ * @param now_ns retransmission time
+ * @param timeout_ns ACK timer, below the wheel's span
+ */
+void sequence_window_rearm(sequence_window_t *window, sequence_request_t *request, uint64_t now_ns, uint64_t timeout_ns);
+
+/**
+ * @brief Find an in-flight request whose ACK timer has expired. Timers expire
+ *      a whole tick at a time, up to one tick late. The caller must remove or
+ *      rearm the request before asking for the next one.
+ *
+ * @param window client window
+ * @param now_ns current time
+ * @return sequence_request_t* an expired request, NULL if none
+ */
+sequence_request_t *sequence_window_next_expired(sequence_window_t *window, uint64_t now_ns);
+
+/**
+ * @brief When sequence_window_next_expired() may next return a request: the
+ *      end of the earliest tick with a timer in it.
+ *
+ * @param window client window
+ * @return uint64_t time, UINT64_MAX when nothing is in flight
+ */
+uint64_t sequence_window_next_deadline(const sequence_window_t *window);
+
+#endif
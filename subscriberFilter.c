@@ -0,0 +1,77 @@
+/**
+ * @file subscriberFilter.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the negative-lookup Bloom filter
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "subscriberFilter.h"
+
+/**
+ * @brief Set a key's bits in its block.
+ *
+ * @param filter filter built by subscriber_filter_build()
+ * @param hash subscriber_filter_hash() of the key
+ */
+static void set_key_bits(subscriber_filter_t *filter, uint64_t hash)
+{
+    subscriber_filter_block_t *block = (subscriber_filter_block_t *)subscriber_filter_block(filter, hash);
+
+    for (int w = 0; w < SUBSCRIBER_FILTER_BLOCK_WORDS; w++)
+        __atomic_fetch_or(&block->words[w], 1U << (((uint32_t)hash * subscriber_filter_salts[w]) >> 27), __ATOMIC_RELEASE);
+}
+
+void subscriber_filter_init(subscriber_filter_t *filter, size_t keys)
+{
+    uint64_t bits = keys * SUBSCRIBER_FILTER_BITS_PER_KEY;
+    uint64_t block_bits = 8 * sizeof(subscriber_filter_block_t);
+
+    filter->block_count = (bits + block_bits - 1) / block_bits;
+    if (filter->block_count == 0)
+        filter->block_count = 1;
+    filter->blocks = aligned_alloc(sizeof(subscriber_filter_block_t), filter->block_count * sizeof(subscriber_filter_block_t));
+    if (filter->blocks == NULL)
+        error("ERROR: Allocating subscriber filter");
+    memset(filter->blocks, DEFAULT_VALUE, filter->block_count * sizeof(subscriber_filter_block_t));
+}
+
+void subscriber_filter_build(subscriber_filter_t *filter, const subscriber_index_t *index, size_t reserve)
+{
+    subscriber_filter_init(filter, index->count + reserve);
+    for (uint64_t i = 0; i < index->capacity; i++)
+        if (index->slots[i].technology != 0)
+            set_key_bits(filter, subscriber_filter_hash(index->slots[i].src_sub_no, index->slots[i].technology));
+}
+
+void subscriber_filter_copy(subscriber_filter_t *copy, const subscriber_filter_t *filter)
+{
+    copy->block_count = filter->block_count;
+    copy->blocks = aligned_alloc(sizeof(subscriber_filter_block_t), filter->block_count * sizeof(subscriber_filter_block_t));
+    if (copy->blocks == NULL)
+        error("ERROR: Allocating subscriber filter");
+    memcpy(copy->blocks, filter->blocks, filter->block_count * sizeof(subscriber_filter_block_t));
+}
+
+void subscriber_filter_free(subscriber_filter_t *filter)
+{
+    free(filter->blocks);
+    filter->blocks = NULL;
+    filter->block_count = 0;
+}
+
+void subscriber_filter_add(subscriber_filter_t *filter, uint32_t src_sub_no, uint8_t technology)
+{
+    set_key_bits(filter, subscriber_filter_hash(src_sub_no, technology));
+}
+
+double subscriber_filter_false_positive_rate(const subscriber_filter_stats_t *stats)
+{
+    uint64_t absent = stats->negatives + stats->false_positives;
+    return absent ? (double)stats->false_positives / absent : 0.0;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file subscriberFilter.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the negative-lookup Bloom filter in front of the
+ *      subscriber index, so unknown subscribers are answered from cache
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SUBSCRIBERFILTER_H /* include guard */
+#define SUBSCRIBERFILTER_H
+
+#include "customProtocol.h"
+#include "subscriberIndex.h"
+#include "subscriberTable.h"
+
+// Filter size per subscriber. A split block Bloom filter at 12 bits per key
+// has a false positive rate of about 0.5%.
+#define SUBSCRIBER_FILTER_BITS_PER_KEY 12
+#define SUBSCRIBER_FILTER_BLOCK_WORDS 8
+
+// One block, half a cache line. A key sets one bit in each word.
+typedef struct
+{
+    uint32_t words[SUBSCRIBER_FILTER_BLOCK_WORDS];
+} __attribute__((aligned(32))) subscriber_filter_block_t;
+
+// Split block Bloom filter over the index's (src_sub_no, technology) keys.
+// A lookup reads one block: no bits missing means the key may be stored,
+// any bit missing means it definitely is not. Deleted keys keep their bits
+// until the next rebuild (a reload, growth or compaction).
+typedef struct
+{
+    subscriber_filter_block_t *blocks; // NULL when the filter is off
+    uint64_t block_count;
+} subscriber_filter_t;
+
+// Filter outcome counters, for one worker or summed:
+typedef struct
+{
+    uint64_t checks;          // Keys tested
+    uint64_t negatives;       // Answered SUB_NOT_EXIST by the filter alone
+    uint64_t false_positives; // Passed the filter but not in the index
+} subscriber_filter_stats_t;
+
+/**
+ * @brief Allocate an empty filter sized for a number of keys.
+ *
+ * @param filter filter to initialize
+ * @param keys keys the filter is sized for
+ */
+void subscriber_filter_init(subscriber_filter_t *filter, size_t keys);
+
+/**
+ * @brief Build a filter holding the index's keys, tombstones included.
+ *
+ * @param filter filter to initialize
+ * @param index index to summarize
+ * @param reserve keys that can be added later within the filter's sizing
+ */
+void subscriber_filter_build(subscriber_filter_t *filter, const subscriber_index_t *index, size_t reserve);
+
+/**
+ * @brief Copy a filter into new blocks first touched by the calling thread.
+ *
+ * @param copy filter to initialize
+ * @param filter filter to copy, not changed meanwhile
+ */
+void subscriber_filter_copy(subscriber_filter_t *copy, const subscriber_filter_t *filter);
+
+/**
+ * @brief Release the filter's blocks.
+ *
+ * @param filter filter built by subscriber_filter_build()
+ */
+void subscriber_filter_free(subscriber_filter_t *filter);
+
+/**
+ * @brief Add a key while readers use the filter. Add it before storing it in
+ *      the index, so a reader that finds it in the index also passes the filter.
+ *
+ * @param filter filter built by subscriber_filter_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ */
+void subscriber_filter_add(subscriber_filter_t *filter, uint32_t src_sub_no, uint8_t technology);
+
+/**
+ * @brief Measured false positive rate: the share of keys not in the index
+ *      that still passed the filter.
+ *
+ * @param stats counters
+ * @return double rate, 0 - 1
+ */
+double subscriber_filter_false_positive_rate(const subscriber_filter_stats_t *stats);
+
+// Bit salts, one per block word (from the Parquet split block Bloom filter)
+static const uint32_t subscriber_filter_salts[SUBSCRIBER_FILTER_BLOCK_WORDS] = {
+    0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU, 0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U};
+
+/**
+ * @brief Filter hash of a key. The block comes from the well-mixed high half
+ *      of subscriber_key_hash(), the bits from both halves folded together.
+ *
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return uint64_t hash
+ */
+static inline uint64_t subscriber_filter_hash(uint32_t src_sub_no, uint8_t technology)
+{
+    uint64_t hash = subscriber_key_hash(src_sub_no, technology);
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * @brief The block a key's bits are in.
+ *
+ * @param filter filter built by subscriber_filter_build()
+ * @param hash subscriber_filter_hash() of the key
+ * @return const subscriber_filter_block_t* block
+ */
+static inline const subscriber_filter_block_t *subscriber_filter_block(const subscriber_filter_t *filter, uint64_t hash)
+{
+    return &filter->blocks[((hash >> 32) * filter->block_count) >> 32];
+}
+
+/**
+ * @brief Whether a key may be stored.
+ *
+ * @param filter filter built by subscriber_filter_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return false if the key is definitely not stored
+ */
+static inline bool subscriber_filter_may_contain(const subscriber_filter_t *filter, uint32_t src_sub_no, uint8_t technology)
+{
+    uint64_t hash = subscriber_filter_hash(src_sub_no, technology);
+    const subscriber_filter_block_t *block = subscriber_filter_block(filter, hash);
+    uint32_t missing = 0;
+
+    for (int w = 0; w < SUBSCRIBER_FILTER_BLOCK_WORDS; w++)
+        missing |= ~__atomic_load_n(&block->words[w], __ATOMIC_RELAXED) & (1U << (((uint32_t)hash * subscriber_filter_salts[w]) >> 27));
+    return missing == 0;
+}
+
+/**
+ * @brief Look up a subscriber, answering definite misses from the filter.
+ *      Same result as subscriber_index_lookup().
+ *
+ * @param filter filter over the index, blocks NULL to always use the index
+ * @param index subscriber index
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @param stats counters to update
+ * @return SUBSCRIBER_PACKET_TYPE SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ */
+static inline SUBSCRIBER_PACKET_TYPE subscriber_filter_lookup(const subscriber_filter_t *filter, const subscriber_index_t *index,
+                                                              uint32_t src_sub_no, uint8_t technology,
+                                                              subscriber_filter_stats_t *stats)
+{
+    SUBSCRIBER_PACKET_TYPE status;
+
+    if (filter->blocks == NULL)
+        return subscriber_index_lookup(index, src_sub_no, technology);
+    stats->checks++;
+    if (!subscriber_filter_may_contain(filter, src_sub_no, technology))
+    {
+        stats->negatives++;
+        return SUB_NOT_EXIST;
+    }
+    status = subscriber_index_lookup(index, src_sub_no, technology);
+    stats->false_positives += status == SUB_NOT_EXIST;
+    return status;
+}
+
+/**
+ * @brief subscriber_filter_lookup() for a packed table and its overlay index.
+ *      Same result as subscriber_table_lookup().
+ *
+ * @param filter filter over the table and overlay, blocks NULL to skip it
+ * @param table packed subscriber table
+ * @param overlay heap index of changed subscribers
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @param stats counters to update
+ * @return SUBSCRIBER_PACKET_TYPE SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ */
+static inline SUBSCRIBER_PACKET_TYPE subscriber_filter_lookup_table(const subscriber_filter_t *filter,
+                                                                    const subscriber_table_t *table,
+                                                                    const subscriber_index_t *overlay,
+                                                                    uint32_t src_sub_no, uint8_t technology,
+                                                                    subscriber_filter_stats_t *stats)
+{
+    SUBSCRIBER_PACKET_TYPE status;
+
+    if (filter->blocks == NULL)
+        return subscriber_table_lookup(table, overlay, src_sub_no, technology);
+    stats->checks++;
+    if (!subscriber_filter_may_contain(filter, src_sub_no, technology))
+    {
+        stats->negatives++;
+        return SUB_NOT_EXIST;
+    }
+    status = subscriber_table_lookup(table, overlay, src_sub_no, technology);
+    stats->false_positives += status == SUB_NOT_EXIST;
+    return status;
+}
+
+#endif
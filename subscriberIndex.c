@@ -0,0 +1,324 @@
+/**
+ * @file subscriberIndex.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement the hash-indexed subscriber lookup used by the server
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "subscriberIndex.h"
+#include <limits.h>
+
+void subscriber_index_build(
+    subscriber_index_t *index, const verification_database_t verification_database[], size_t db_size)
+{
+    subscriber_index_build_reserved(index, verification_database, db_size, 0);
+}
+
+void subscriber_index_build_reserved(
+    subscriber_index_t *index, const verification_database_t verification_database[], size_t db_size, size_t reserve)
+{
+    uint64_t capacity = SUBSCRIBER_INDEX_MIN_CAPACITY;
+    uint32_t bits = 4; // log2(SUBSCRIBER_INDEX_MIN_CAPACITY)
+
+    // Keep the load factor at or below SUBSCRIBER_INDEX_MAX_LOAD_PERCENT, within
+    // the capacity subscriber_index_map() accepts:
+    while (capacity * SUBSCRIBER_INDEX_MAX_LOAD_PERCENT / 100 < db_size + reserve)
+    {
+        if (capacity == SUBSCRIBER_INDEX_MAX_CAPACITY)
+        {
+            errno = EFBIG;
+            error("ERROR: Subscriber database too large for the index");
+        }
+        capacity <<= 1;
+        bits++;
+    }
+
+    index->slots = calloc(capacity, sizeof(subscriber_slot_t));
+    if (index->slots == NULL)
+        error("ERROR: Allocating subscriber index");
+    index->capacity = capacity;
+    index->mask = capacity - 1;
+    index->shift = 64 - bits;
+    index->count = 0;
+    index->deleted = 0;
+    index->mapping = NULL;
+    index->mapping_size = 0;
+
+    for (size_t n = 0; n < db_size; n++)
+    {
+        uint32_t src_sub_no = verification_database[n].src_sub_no;
+        uint8_t technology = (uint8_t)verification_database[n].technology;
+        uint64_t i = subscriber_key_hash(src_sub_no, technology) >> index->shift;
+
+        // Entries with an invalid technology can never match a valid packet
+        if (technology < SUB_2G || technology > SUB_5G)
+            continue;
+
+        while (index->slots[i].technology != 0 &&
+               !(index->slots[i].src_sub_no == src_sub_no && index->slots[i].technology == technology))
+            i = (i + 1) & index->mask;
+
+        // Duplicate key: keep the first entry, like the linear scan does
+        if (index->slots[i].technology != 0)
+            continue;
+
+        index->slots[i].src_sub_no = src_sub_no;
+        index->slots[i].technology = technology;
+        index->slots[i].paid = verification_database[n].paid ? SUBSCRIBER_SLOT_PAID : SUBSCRIBER_SLOT_NOT_PAID;
+        index->count++;
+    }
+}
+
+void subscriber_index_copy(subscriber_index_t *copy, const subscriber_index_t *index)
+{
+    *copy = *index;
+    copy->slots = malloc(subscriber_index_memory_bytes(index));
+    if (copy->slots == NULL)
+        error("ERROR: Allocating subscriber index");
+    memcpy(copy->slots, index->slots, subscriber_index_memory_bytes(index));
+    copy->mapping = NULL;
+    copy->mapping_size = 0;
+}
+
+SUBSCRIBER_UPDATE subscriber_index_update(
+    subscriber_index_t *index, uint32_t src_sub_no, uint8_t technology, uint8_t paid, bool add)
+{
+    uint64_t i = subscriber_key_hash(src_sub_no, technology) >> index->shift;
+    subscriber_slot_t *slot, updated = {.src_sub_no = src_sub_no, .technology = technology, .paid = paid};
+    uint64_t word, probes;
+
+    for (probes = 0; probes < index->capacity; probes++, i = (i + 1) & index->mask)
+    {
+        slot = &index->slots[i];
+        if (slot->technology == 0 || (slot->src_sub_no == src_sub_no && slot->technology == technology))
+            break;
+    }
+    // Only a corrupt image has neither the key nor an empty slot
+    if (probes == index->capacity)
+        return SUBSCRIBER_UPDATE_FULL;
+
+    // Stored, possibly as a tombstone, or the empty slot that ended the probe
+    bool stored = slot->technology != 0;
+    bool was_deleted = stored && slot->paid == SUBSCRIBER_SLOT_DELETED;
+    if ((!stored || was_deleted) && !add)
+        return SUBSCRIBER_UPDATE_MISSING;
+    if (was_deleted && paid == SUBSCRIBER_SLOT_DELETED)
+        return SUBSCRIBER_UPDATE_CHANGED;
+    if (!stored && (index->count + 1) * 100 > index->capacity * SUBSCRIBER_INDEX_MAX_LOAD_PERCENT)
+        return SUBSCRIBER_UPDATE_FULL;
+
+    // One store of the whole slot, readers load it as one word
+    memcpy(&word, &updated, sizeof(word));
+    __atomic_store_n((uint64_t *)slot, word, __ATOMIC_RELEASE);
+    if (!stored)
+        index->count++;
+    if (paid == SUBSCRIBER_SLOT_DELETED)
+        index->deleted++;
+    else if (was_deleted)
+        index->deleted--;
+    return stored && !was_deleted ? SUBSCRIBER_UPDATE_CHANGED : SUBSCRIBER_UPDATE_ADDED;
+}
+
+void subscriber_index_free(subscriber_index_t *index)
+{
+    if (index->mapping)
+        munmap(index->mapping, index->mapping_size);
+    else
+        free(index->slots);
+    memset(index, DEFAULT_VALUE, sizeof(*index));
+}
+
+SUBSCRIBER_PACKET_TYPE verify_subscriber_indexed(
+    const subscriber_index_t *index, subscriber_packet_t *subscriber_packet)
+{
+    return subscriber_index_lookup(index, subscriber_packet->src_sub_no, subscriber_packet->technology);
+}
+
+uint64_t subscriber_index_checksum(const subscriber_index_t *index)
+{
+    const uint8_t *bytes = (const uint8_t *)index->slots;
+    size_t size = index->capacity * sizeof(subscriber_slot_t);
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Write an image.
+ *
+ * @param index index to write
+ * @param filename image file to create
+ * @return const char* NULL if written, otherwise what failed (errno is set)
+ */
+static const char *save_image(const subscriber_index_t *index, const char *filename)
+{
+    subscriber_image_header_t header;
+    char temp_name[PATH_MAX];
+    FILE *fp;
+
+    memset(&header, DEFAULT_VALUE, sizeof(header));
+    memcpy(header.magic, SUBSCRIBER_IMAGE_MAGIC, SUBSCRIBER_IMAGE_MAGIC_SIZE);
+    header.version = SUBSCRIBER_IMAGE_VERSION;
+    header.slot_size = sizeof(subscriber_slot_t);
+    header.count = index->count;
+    header.capacity = index->capacity;
+    header.shift = index->shift;
+    header.slots_offset = sizeof(header);
+    header.checksum = subscriber_index_checksum(index);
+
+    // Write a temporary file and rename it over the image, so a server
+    // mapping or reloading the old image never sees a partial one
+    if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename) >= (int)sizeof(temp_name))
+    {
+        errno = ENAMETOOLONG;
+        return "ERROR: Image filename too long";
+    }
+    fp = fopen(temp_name, "wb");
+    if (fp == NULL)
+        return "Error opening image file";
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(index->slots, sizeof(subscriber_slot_t), index->capacity, fp) != index->capacity)
+    {
+        fclose(fp);
+        unlink(temp_name);
+        return "ERROR: Writing subscriber image";
+    }
+    if (fclose(fp) != 0)
+    {
+        unlink(temp_name);
+        return "ERROR: Closing subscriber image";
+    }
+    if (rename(temp_name, filename) != 0)
+    {
+        unlink(temp_name);
+        return "ERROR: Renaming subscriber image";
+    }
+    return NULL;
+}
+
+void subscriber_index_save(const subscriber_index_t *index, const char *filename)
+{
+    const char *problem = save_image(index, filename);
+    if (problem)
+        error(problem);
+}
+
+bool subscriber_index_try_save(const subscriber_index_t *index, const char *filename)
+{
+    const char *problem = save_image(index, filename);
+    if (problem)
+        fprintf(stderr, "Warning: %s: %s (%s)\n", filename, problem, strerror(errno));
+    return problem == NULL;
+}
+
+bool is_subscriber_image(const char *filename)
+{
+    char magic[SUBSCRIBER_IMAGE_MAGIC_SIZE];
+    FILE *fp = fopen(filename, "rb");
+    bool is_image;
+
+    if (fp == NULL)
+        return false;
+    is_image = fread(magic, sizeof(magic), 1, fp) == 1 &&
+               memcmp(magic, SUBSCRIBER_IMAGE_MAGIC, SUBSCRIBER_IMAGE_MAGIC_SIZE) == 0;
+    fclose(fp);
+    return is_image;
+}
+
+/**
+ * @brief Map and validate an image.
+ *
+ * @param index index to fill
+ * @param filename subscriber image
+ * @return const char* NULL if mapped, otherwise what is wrong (errno is set
+ *      when a system call failed)
+ */
+static const char *map_image(subscriber_index_t *index, const char *filename)
+{
+    const subscriber_image_header_t *header;
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return "Error opening image file";
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return "ERROR: fstat subscriber image";
+    }
+    if ((size_t)st.st_size < sizeof(subscriber_image_header_t))
+    {
+        close(fd);
+        return "ERROR: Subscriber image truncated";
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return "ERROR: mmap subscriber image";
+
+    // Validate the header against this build and the file size:
+    header = mapping;
+    const char *problem = NULL;
+    if (memcmp(header->magic, SUBSCRIBER_IMAGE_MAGIC, SUBSCRIBER_IMAGE_MAGIC_SIZE) != 0)
+        problem = "ERROR: Not a subscriber image";
+    else if (header->version != SUBSCRIBER_IMAGE_VERSION || header->slot_size != sizeof(subscriber_slot_t))
+        problem = "ERROR: Subscriber image version or slot size not supported";
+    else if (header->capacity < SUBSCRIBER_INDEX_MIN_CAPACITY || header->capacity > SUBSCRIBER_INDEX_MAX_CAPACITY ||
+             (header->capacity & (header->capacity - 1)) != 0 ||
+             header->shift != 64 - (uint32_t)__builtin_ctzll(header->capacity) ||
+             header->count >= header->capacity ||
+             header->slots_offset % sizeof(subscriber_slot_t) != 0 ||
+             header->slots_offset > (uint64_t)st.st_size ||
+             header->capacity > ((uint64_t)st.st_size - header->slots_offset) / sizeof(subscriber_slot_t))
+        problem = "ERROR: Subscriber image header corrupt";
+    if (problem)
+    {
+        munmap(mapping, st.st_size);
+        errno = EINVAL;
+        return problem;
+    }
+
+    index->slots = (subscriber_slot_t *)((char *)mapping + header->slots_offset);
+    index->capacity = header->capacity;
+    index->mask = header->capacity - 1;
+    index->shift = header->shift;
+    index->count = header->count;
+    index->deleted = 0;
+    index->mapping = mapping;
+    index->mapping_size = st.st_size;
+    return NULL;
+}
+
+void subscriber_index_map(subscriber_index_t *index, const char *filename)
+{
+    const char *problem = map_image(index, filename);
+    if (problem)
+        error(problem);
+}
+
+bool subscriber_index_try_map(subscriber_index_t *index, const char *filename)
+{
+    const char *problem = map_image(index, filename);
+    if (problem)
+        fprintf(stderr, "Warning: %s: %s (%s)\n", filename, problem, strerror(errno));
+    return problem == NULL;
+}
+
+bool subscriber_index_verify_image(const subscriber_index_t *index)
+{
+    const subscriber_image_header_t *header = index->mapping;
+    return header != NULL && subscriber_index_checksum(index) == header->checksum;
+}
@@ -0,0 +1,291 @@
+/**
+ * @file subscriberIndex.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the hash-indexed subscriber lookup used by the server
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SUBSCRIBERINDEX_H /* include guard */
+#define SUBSCRIBERINDEX_H
+
+#include "customProtocol.h"
+
+// Index sizing: capacity is the next power of two >= count / load factor
+#define SUBSCRIBER_INDEX_MAX_LOAD_PERCENT 70
+#define SUBSCRIBER_INDEX_MIN_CAPACITY 16
+// Enough for every (src_sub_no, technology) key, 2^34, within the load factor
+#define SUBSCRIBER_INDEX_MAX_CAPACITY (1ULL << 35)
+
+// Binary subscriber image written by dbcompile and memory-mapped by myserver:
+#define SUBSCRIBER_IMAGE_MAGIC "SUBIMAGE"
+#define SUBSCRIBER_IMAGE_MAGIC_SIZE 8
+#define SUBSCRIBER_IMAGE_VERSION 1
+
+// Values of subscriber_slot_t.paid. A deleted subscriber keeps its slot as a
+// tombstone, so probes for keys stored after it still find them.
+#define SUBSCRIBER_SLOT_NOT_PAID 0
+#define SUBSCRIBER_SLOT_PAID 1
+#define SUBSCRIBER_SLOT_DELETED 2
+// Returned by subscriber_index_find() for a key without a slot
+#define SUBSCRIBER_SLOT_ABSENT 0xFF
+
+// Open-addressing slot, 8 bytes so 8 slots share one cache line.
+// technology == 0 marks an empty slot (valid technologies are 2 - 5).
+// Readers load a slot as one 64-bit word, so a live update is atomic.
+typedef struct
+{
+    uint32_t src_sub_no;
+    uint8_t technology;
+    uint8_t paid;
+    uint16_t reserved;
+} subscriber_slot_t;
+_Static_assert(sizeof(subscriber_slot_t) == sizeof(uint64_t), "a slot must load as one word");
+
+// Custom Protocol Subscriber Index, built once from the verification database:
+typedef struct
+{
+    subscriber_slot_t *slots;
+    uint64_t capacity; // Always a power of two
+    uint64_t mask;     // capacity - 1
+    uint32_t shift;    // 64 - log2(capacity), for multiplicative hashing
+    uint64_t count;    // Distinct (src_sub_no, technology) keys stored
+    uint64_t deleted;  // Of those, tombstones left by subscriber_index_update()
+    void *mapping;     // Non-NULL when slots live in a mapped image
+    size_t mapping_size;
+} subscriber_index_t;
+
+// Result of subscriber_index_update():
+typedef enum
+{
+    SUBSCRIBER_UPDATE_CHANGED, // Existing subscriber changed or deleted
+    SUBSCRIBER_UPDATE_ADDED,   // New subscriber stored
+    SUBSCRIBER_UPDATE_MISSING, // No such subscriber to change or delete
+    SUBSCRIBER_UPDATE_FULL     // Adding would exceed the load factor, rebuild larger
+} SUBSCRIBER_UPDATE;
+
+// Subscriber image header. The slot array follows at slots_offset, in the
+// same layout and order as subscriber_index_t, so a mapped image is served
+// as is. Native byte order; slot_size catches layout mismatches.
+typedef struct
+{
+    char magic[SUBSCRIBER_IMAGE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t count;
+    uint64_t capacity;
+    uint32_t shift;
+    uint32_t reserved;
+    uint64_t slots_offset;
+    uint64_t checksum; // FNV-1a over the slot array
+} subscriber_image_header_t;
+
+/**
+ * @brief Hash the (src_sub_no, technology) lookup key to a 64-bit value.
+ *      Fibonacci hashing: the high bits of the product are well mixed.
+ *
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return uint64_t hash value, use the high bits
+ */
+static inline uint64_t subscriber_key_hash(uint32_t src_sub_no, uint8_t technology)
+{
+    return (((uint64_t)src_sub_no << 8) | technology) * 0x9E3779B97F4A7C15ULL;
+}
+
+/**
+ * @brief Build the hash index from a verification database. The first entry
+ *      wins for duplicate keys, matching the linear scan in verify_subscriber().
+ *      Exits if it would need more than SUBSCRIBER_INDEX_MAX_CAPACITY slots,
+ *      as subscriber_index_map() refuses such an image.
+ *
+ * @param index index to initialize
+ * @param verification_database read from verification_database.txt
+ * @param db_size number of database entries
+ */
+void subscriber_index_build(
+    subscriber_index_t *index, const verification_database_t verification_database[], size_t db_size);
+
+/**
+ * @brief subscriber_index_build() with room for more subscribers to be added
+ *      by subscriber_index_update() before the index must be rebuilt.
+ *
+ * @param index index to initialize
+ * @param verification_database entries to index
+ * @param db_size number of database entries
+ * @param reserve subscribers that can be added within the load factor
+ */
+void subscriber_index_build_reserved(
+    subscriber_index_t *index, const verification_database_t verification_database[], size_t db_size, size_t reserve);
+
+/**
+ * @brief Release the memory held by the index.
+ *
+ * @param index index built by subscriber_index_build()
+ */
+void subscriber_index_free(subscriber_index_t *index);
+
+/**
+ * @brief Copy an index, or a mapped image, into new heap memory first
+ *      touched by the calling thread, so a thread pinned to a NUMA node gets
+ *      a copy on that node.
+ *
+ * @param copy index to initialize, same capacity and slot order as index
+ * @param index index to copy, not changed meanwhile
+ */
+void subscriber_index_copy(subscriber_index_t *copy, const subscriber_index_t *index);
+
+/**
+ * @brief Change one subscriber in an index that readers are using. Every
+ *      change is one atomic store, so concurrent lookups see the subscriber
+ *      either before or after it. Only one thread may update an index, and
+ *      it must not be a mapped image.
+ *
+ * @param index heap index built by subscriber_index_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @param paid SUBSCRIBER_SLOT_PAID, _NOT_PAID, or _DELETED to delete
+ * @param add true to add the subscriber if it isn't stored. With _DELETED,
+ *      a tombstone is stored even for a key the index doesn't hold.
+ * @return SUBSCRIBER_UPDATE what was done
+ */
+SUBSCRIBER_UPDATE subscriber_index_update(
+    subscriber_index_t *index, uint32_t src_sub_no, uint8_t technology, uint8_t paid, bool add);
+
+/**
+ * @brief Write the index as a subscriber image. The image is written to
+ *      filename.tmp and renamed into place, so it can replace the image of a
+ *      running server.
+ *
+ * @param index index built by subscriber_index_build()
+ * @param filename image file to create
+ */
+void subscriber_index_save(const subscriber_index_t *index, const char *filename);
+
+/**
+ * @brief Like subscriber_index_save(), but a failed write is reported on
+ *      stderr instead of exiting, for compacting a running server's database.
+ *
+ * @param index index to write
+ * @param filename image file to create
+ * @return true if written
+ */
+bool subscriber_index_try_save(const subscriber_index_t *index, const char *filename);
+
+/**
+ * @brief Check whether a file starts with the subscriber image magic.
+ *
+ * @param filename file to check
+ * @return true if the file is a subscriber image
+ */
+bool is_subscriber_image(const char *filename);
+
+/**
+ * @brief Map a subscriber image read-only and serve the index from it. Only
+ *      the header is validated, so this takes the same time for any database
+ *      size and the pages are shared with other processes mapping the image.
+ *
+ * @param index index to initialize, subscriber_index_free() unmaps it
+ * @param filename image written by subscriber_index_save()
+ */
+void subscriber_index_map(subscriber_index_t *index, const char *filename);
+
+/**
+ * @brief Like subscriber_index_map(), but a missing or malformed image is
+ *      reported on stderr instead of exiting, for reloading a running server.
+ *
+ * @param index index to fill
+ * @param filename subscriber image
+ * @return true if mapped
+ */
+bool subscriber_index_try_map(subscriber_index_t *index, const char *filename);
+
+/**
+ * @brief Compute the image checksum over the index's slot array.
+ *
+ * @param index built or mapped index
+ * @return uint64_t FNV-1a checksum
+ */
+uint64_t subscriber_index_checksum(const subscriber_index_t *index);
+
+/**
+ * @brief Validate a mapped image's checksum. Reads the whole image.
+ *
+ * @param index index initialized by subscriber_index_map()
+ * @return true if the slot array matches the checksum in the header
+ */
+bool subscriber_index_verify_image(const subscriber_index_t *index);
+
+/**
+ * @brief Memory held by the index's slot array.
+ *
+ * @param index index built by subscriber_index_build()
+ * @return size_t bytes
+ */
+static inline size_t subscriber_index_memory_bytes(const subscriber_index_t *index)
+{
+    return index->capacity * sizeof(subscriber_slot_t);
+}
+
+/**
+ * @brief Find a subscriber's slot in the index.
+ *
+ * @param index index built by subscriber_index_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return uint8_t the slot's paid value, SUBSCRIBER_SLOT_ABSENT if it has no slot
+ */
+static inline uint8_t subscriber_index_find(const subscriber_index_t *index, uint32_t src_sub_no, uint8_t technology)
+{
+    uint64_t i = subscriber_key_hash(src_sub_no, technology) >> index->shift;
+    subscriber_slot_t slot;
+
+    // Linear probing; the table is never full, so an empty slot ends the probe.
+    // A corrupt mapped image may have no empty slot, so stop after a full turn.
+    for (uint64_t probes = 0; probes < index->capacity; probes++, i = (i + 1) & index->mask)
+    {
+        uint64_t word = __atomic_load_n((const uint64_t *)&index->slots[i], __ATOMIC_RELAXED);
+        memcpy(&slot, &word, sizeof(slot));
+        if (slot.technology == 0)
+            return SUBSCRIBER_SLOT_ABSENT;
+        if (slot.src_sub_no == src_sub_no && slot.technology == technology)
+            return slot.paid;
+    }
+    return SUBSCRIBER_SLOT_ABSENT;
+}
+
+/**
+ * @brief Look up a subscriber in the index.
+ *
+ * @param index index built by subscriber_index_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return SUBSCRIBER_PACKET_TYPE SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ */
+static inline SUBSCRIBER_PACKET_TYPE subscriber_index_lookup(
+    const subscriber_index_t *index, uint32_t src_sub_no, uint8_t technology)
+{
+    uint8_t paid = subscriber_index_find(index, src_sub_no, technology);
+
+    return paid == SUBSCRIBER_SLOT_PAID       ? SUB_ACC_OK
+           : paid == SUBSCRIBER_SLOT_NOT_PAID ? SUB_NOT_PAID
+                                              : SUB_NOT_EXIST;
+}
+
+/**
+ * @brief Verify if subscriber is in database and has paid or not, using the index.
+ *      Same result as verify_subscriber() on the database the index was built from.
+ *
+ * @param index index built by subscriber_index_build()
+ * @param subscriber_packet input subscriber packet
+ * @return SUBSCRIBER_PACKET_TYPE
+ */
+SUBSCRIBER_PACKET_TYPE verify_subscriber_indexed(
+    const subscriber_index_t *index, subscriber_packet_t *subscriber_packet);
+
+#endif
@@ -0,0 +1,678 @@
+/**
+ * @file subscriberStore.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement loading, publishing and reclaiming verification database
+ *      generations, and delta updates with their log
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "subscriberStore.h"
+
+/**
+ * @brief The live subscribers of a database: its index's, and for a packed
+ *      database the packed table's that the overlay index doesn't change.
+ *
+ * @param database database to read, not changed meanwhile
+ * @param rows set to the subscribers, free() them
+ * @return size_t number of subscribers
+ */
+static size_t collect_subscribers(const subscriber_database_t *database, verification_database_t **rows)
+{
+    const subscriber_index_t *index = &database->index;
+    const subscriber_table_t *packed = &database->packed;
+    size_t n = 0;
+
+    *rows = malloc((packed->count + index->count + 1) * sizeof(verification_database_t));
+    if (*rows == NULL)
+        error("ERROR: Allocating subscriber rows");
+    if (packed->entries)
+    {
+        subscriber_table_collect(packed, *rows);
+        for (uint64_t i = 0; i < packed->count; i++)
+            if (subscriber_index_find(index, (*rows)[i].src_sub_no, (*rows)[i].technology) == SUBSCRIBER_SLOT_ABSENT)
+                (*rows)[n++] = (*rows)[i];
+    }
+    for (uint64_t i = 0; i < index->capacity; i++)
+    {
+        const subscriber_slot_t *slot = &index->slots[i];
+        if (slot->technology == 0 || slot->paid == SUBSCRIBER_SLOT_DELETED)
+            continue;
+        (*rows)[n].src_sub_no = slot->src_sub_no;
+        (*rows)[n].technology = (SUBSCRIBER_TECHNOLOGY)slot->technology;
+        (*rows)[n].paid = slot->paid == SUBSCRIBER_SLOT_PAID;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Move a loaded database's subscribers into a packed table, with an
+ *      empty overlay index in place of the index or mapped image.
+ *
+ * @param database database to convert, no reader uses it yet
+ * @param rows its subscribers, or NULL to read them from the index
+ * @param n number of rows
+ */
+static void pack_database(subscriber_database_t *database, verification_database_t *rows, size_t n)
+{
+    verification_database_t *collected = NULL;
+
+    if (rows == NULL)
+    {
+        n = collect_subscribers(database, &collected);
+        rows = collected;
+    }
+    subscriber_table_build(&database->packed, rows, n);
+    free(collected);
+    if (database->index.slots)
+        subscriber_index_free(&database->index);
+    database->db_size = database->packed.count;
+    subscriber_index_build_reserved(&database->index, NULL, 0, subscriber_table_overlay_keys(&database->packed));
+}
+
+subscriber_database_t *subscriber_database_load(const char *filename, bool checked, bool packed)
+{
+    subscriber_database_t *database = calloc(1, sizeof(subscriber_database_t));
+    uint64_t load_start = monotonic_time_ns();
+
+    if (database == NULL)
+        error("ERROR: Allocating subscriber database");
+    if (is_subscriber_image(filename))
+    {
+        if (!checked)
+            subscriber_index_map(&database->index, filename);
+        else if (!subscriber_index_try_map(&database->index, filename) ||
+                 !subscriber_index_verify_image(&database->index))
+        {
+            if (database->index.mapping)
+                fprintf(stderr, "Warning: %s: Subscriber image checksum mismatch\n", filename);
+            subscriber_database_free(database);
+            return NULL;
+        }
+        database->db_size = database->index.count;
+        if (packed)
+            pack_database(database, NULL, 0);
+    }
+    else
+    {
+        if (!checked)
+            database->db_size = read_verification_database(&database->table, (char *)filename);
+        else if (!try_read_verification_database(&database->table, filename, &database->db_size))
+        {
+            free(database);
+            return NULL;
+        }
+        if (packed)
+        {
+            pack_database(database, database->table, database->db_size);
+            free(database->table);
+            database->table = NULL;
+        }
+        else
+            subscriber_index_build(&database->index, database->table, database->db_size);
+    }
+    database->load_ns = monotonic_time_ns() - load_start;
+    return database;
+}
+
+void subscriber_database_free(subscriber_database_t *database)
+{
+    if (database == NULL)
+        return;
+    for (unsigned int node = 1; node < NUMA_MAX_NODES; node++)
+        subscriber_database_free(database->replicas[node]);
+    if (database->index.slots)
+        subscriber_index_free(&database->index);
+    subscriber_table_free(&database->packed);
+    subscriber_filter_free(&database->filter);
+    free(database->table);
+    free(database);
+}
+
+/**
+ * @brief Build a database's negative-lookup filter over all its subscribers.
+ *
+ * @param database database without a filter, no reader uses it yet
+ * @param reserve subscribers that can be added later within the filter's sizing
+ */
+static void build_filter(subscriber_database_t *database, size_t reserve)
+{
+    verification_database_t *rows;
+    size_t n;
+
+    if (database->packed.entries == NULL)
+    {
+        subscriber_filter_build(&database->filter, &database->index, reserve);
+        return;
+    }
+    n = collect_subscribers(database, &rows);
+    subscriber_filter_init(&database->filter, n + reserve);
+    for (size_t i = 0; i < n; i++)
+        subscriber_filter_add(&database->filter, rows[i].src_sub_no, rows[i].technology);
+    free(rows);
+}
+
+size_t subscriber_database_lookup_bytes(const subscriber_database_t *database)
+{
+    size_t bytes = subscriber_index_memory_bytes(&database->index) + database->filter.block_count * sizeof(subscriber_filter_block_t);
+
+    if (database->packed.entries)
+        bytes += subscriber_table_memory_bytes(&database->packed);
+    return bytes;
+}
+
+/**
+ * @brief Copy a database's lookup structures into memory of the NUMA node
+ *      the calling thread is pinned to. Thread entry point.
+ *
+ * @param arg database to copy, replaced by the replica
+ * @return void* NULL
+ */
+static void *copy_replica(void *arg)
+{
+    subscriber_database_t **database = arg;
+    subscriber_database_t *replica = calloc(1, sizeof(subscriber_database_t));
+
+    if (replica == NULL)
+        error("ERROR: Allocating subscriber database replica");
+    subscriber_index_copy(&replica->index, &(*database)->index);
+    if ((*database)->packed.entries)
+        subscriber_table_copy(&replica->packed, &(*database)->packed);
+    if ((*database)->filter.blocks)
+        subscriber_filter_copy(&replica->filter, &(*database)->filter);
+    replica->db_size = (*database)->db_size;
+    replica->load_ns = (*database)->load_ns;
+    *database = replica;
+    return NULL;
+}
+
+/**
+ * @brief Give a database a replica on every NUMA node but node 0, copied by
+ *      one thread per node in parallel so first touch places it there.
+ *
+ * @param store store the database is for
+ * @param database database without replicas, no reader uses it yet
+ */
+static void replicate_database(const subscriber_store_t *store, subscriber_database_t *database)
+{
+    pthread_t threads[NUMA_MAX_NODES];
+    subscriber_database_t *copies[NUMA_MAX_NODES];
+
+    if (store->numa == NULL)
+        return;
+    for (unsigned int node = 1; node < store->numa->node_count; node++)
+    {
+        copies[node] = database;
+        numa_topology_start(store->numa, node, &threads[node], copy_replica, &copies[node]);
+    }
+    for (unsigned int node = 1; node < store->numa->node_count; node++)
+    {
+        pthread_join(threads[node], NULL);
+        database->replicas[node] = copies[node];
+    }
+}
+
+void subscriber_store_init(subscriber_store_t *store, subscriber_database_t *database, unsigned int reader_count,
+                           bool filter, const numa_topology_t *numa)
+{
+    store->filter = filter;
+    store->packed = database->packed.entries != NULL;
+    store->numa = numa;
+    if (filter)
+        build_filter(database, store->packed ? subscriber_table_overlay_keys(&database->packed) : 0);
+    replicate_database(store, database);
+    database->generation = 1;
+    store->current = database;
+    store->grace_period = 1;
+    store->version = 0;
+    store->reader_count = reader_count;
+    store->readers = aligned_alloc(sizeof(subscriber_store_reader_t), reader_count * sizeof(subscriber_store_reader_t));
+    if (store->readers == NULL)
+        error("ERROR: Allocating subscriber store readers");
+    memset(store->readers, DEFAULT_VALUE, reader_count * sizeof(subscriber_store_reader_t));
+    pthread_mutex_init(&store->publish_lock, NULL);
+    store->filename = NULL;
+    store->log_fd = -1;
+    store->log_records = 0;
+    store->log_start_ns = 0;
+}
+
+/**
+ * @brief Start a grace period and wait until every reader has been offline
+ *      or quiescent since it started. After this, no reader holds a database
+ *      pointer read before the call.
+ *
+ * @param store store
+ */
+static void wait_for_readers(subscriber_store_t *store)
+{
+    uint64_t period = __atomic_add_fetch(&store->grace_period, 1, __ATOMIC_SEQ_CST);
+    struct timespec poll_interval = {.tv_sec = 0, .tv_nsec = SUBSCRIBER_STORE_GRACE_POLL_NS};
+
+    for (unsigned int r = 0; r < store->reader_count; r++)
+        for (;;)
+        {
+            uint64_t seen = __atomic_load_n(&store->readers[r].grace_period, __ATOMIC_SEQ_CST);
+            if (seen == 0 || seen >= period)
+                break;
+            nanosleep(&poll_interval, NULL);
+        }
+}
+
+/**
+ * @brief Publish a new generation and free the old one once readers are done
+ *      with it. The caller holds publish_lock.
+ *
+ * @param store store
+ * @param database new generation, owned by the store
+ */
+static void swap_generation(subscriber_store_t *store, subscriber_database_t *database)
+{
+    subscriber_database_t *old;
+
+    replicate_database(store, database);
+    database->generation = store->current->generation + 1;
+    for (unsigned int node = 1; node < NUMA_MAX_NODES; node++)
+        if (database->replicas[node])
+            database->replicas[node]->generation = database->generation;
+    old = __atomic_exchange_n(&store->current, database, __ATOMIC_SEQ_CST);
+    wait_for_readers(store);
+    subscriber_database_free(old);
+}
+
+void subscriber_store_publish(subscriber_store_t *store, subscriber_database_t *database)
+{
+    pthread_mutex_lock(&store->publish_lock);
+    swap_generation(store, database);
+    pthread_mutex_unlock(&store->publish_lock);
+}
+
+/**
+ * @brief Copy a database into a new heap index without tombstones, with room
+ *      to add half as many subscribers again, and its filter if the store has
+ *      one. A packed database is copied into a new packed table with the
+ *      overlay merged in, and an empty overlay.
+ *
+ * @param store store the copy is for
+ * @param database database to copy, not changed meanwhile
+ * @return subscriber_database_t* copy, generation unset
+ */
+static subscriber_database_t *rebuild_database(const subscriber_store_t *store, const subscriber_database_t *database)
+{
+    subscriber_database_t *copy = calloc(1, sizeof(subscriber_database_t));
+    uint64_t start = monotonic_time_ns();
+    verification_database_t *rows;
+    size_t reserve;
+
+    if (copy == NULL)
+        error("ERROR: Allocating subscriber database");
+    copy->db_size = collect_subscribers(database, &rows);
+    if (store->packed)
+    {
+        pack_database(copy, rows, copy->db_size);
+        reserve = subscriber_table_overlay_keys(&copy->packed);
+    }
+    else
+    {
+        reserve = copy->db_size / 2 + 1;
+        subscriber_index_build_reserved(&copy->index, rows, copy->db_size, reserve);
+    }
+    free(rows);
+    if (store->filter)
+        build_filter(copy, reserve);
+    copy->load_ns = monotonic_time_ns() - start;
+    return copy;
+}
+
+/**
+ * @brief Apply a delta to a packed database. Paid changes of subscribers in
+ *      the packed table flip their paid bit in place, everything else goes to
+ *      the overlay index, where a tombstone hides a deleted table subscriber.
+ *
+ * @param database packed database, only changed by the caller
+ * @param delta update to apply
+ * @param paid SUBSCRIBER_SLOT_* value the delta stores
+ * @return SUBSCRIBER_UPDATE what was done
+ */
+static SUBSCRIBER_UPDATE apply_packed_delta(subscriber_database_t *database, const subscriber_delta_t *delta, uint8_t paid)
+{
+    SUBSCRIBER_PACKET_TYPE before = subscriber_table_lookup(&database->packed, &database->index, delta->src_sub_no,
+                                                            delta->technology);
+    SUBSCRIBER_UPDATE result;
+
+    if (delta->op != SUBSCRIBER_DELTA_INSERT && before == SUB_NOT_EXIST)
+        return SUBSCRIBER_UPDATE_MISSING;
+    if (delta->op == SUBSCRIBER_DELTA_PAID &&
+        subscriber_index_find(&database->index, delta->src_sub_no, delta->technology) == SUBSCRIBER_SLOT_ABSENT)
+    {
+        subscriber_table_set_paid(&database->packed, delta->src_sub_no, delta->technology, delta->paid);
+        return SUBSCRIBER_UPDATE_CHANGED;
+    }
+    result = subscriber_index_update(&database->index, delta->src_sub_no, delta->technology, paid,
+                                     delta->op != SUBSCRIBER_DELTA_PAID);
+    if (result == SUBSCRIBER_UPDATE_FULL)
+        return result;
+    if (delta->op == SUBSCRIBER_DELTA_DELETE)
+        database->db_size--;
+    else if (delta->op == SUBSCRIBER_DELTA_INSERT && before == SUB_NOT_EXIST)
+    {
+        database->db_size++;
+        return SUBSCRIBER_UPDATE_ADDED;
+    }
+    return SUBSCRIBER_UPDATE_CHANGED;
+}
+
+/**
+ * @brief Apply a delta to a database's index.
+ *
+ * @param database heap database, only changed by the caller
+ * @param delta update to apply
+ * @return SUBSCRIBER_UPDATE what was done
+ */
+static SUBSCRIBER_UPDATE apply_delta(subscriber_database_t *database, const subscriber_delta_t *delta)
+{
+    uint8_t paid = delta->paid ? SUBSCRIBER_SLOT_PAID : SUBSCRIBER_SLOT_NOT_PAID;
+    SUBSCRIBER_UPDATE result;
+
+    if (delta->op == SUBSCRIBER_DELTA_DELETE)
+        paid = SUBSCRIBER_SLOT_DELETED;
+    // Filter first: a reader that finds the new key in the index must pass the filter
+    if (delta->op == SUBSCRIBER_DELTA_INSERT && database->filter.blocks)
+        subscriber_filter_add(&database->filter, delta->src_sub_no, delta->technology);
+    if (database->packed.entries)
+        return apply_packed_delta(database, delta, paid);
+    result = subscriber_index_update(&database->index, delta->src_sub_no, delta->technology, paid,
+                                     delta->op == SUBSCRIBER_DELTA_INSERT);
+    if (result == SUBSCRIBER_UPDATE_ADDED)
+        database->db_size++;
+    else if (result == SUBSCRIBER_UPDATE_CHANGED && delta->op == SUBSCRIBER_DELTA_DELETE)
+        database->db_size--;
+    return result;
+}
+
+/**
+ * @brief Apply a delta to a database and each of its replicas. They are
+ *      identical copies, so the same update lands in the same slots.
+ *
+ * @param database heap database, only changed by the caller
+ * @param delta update to apply
+ * @return SUBSCRIBER_UPDATE what was done
+ */
+static SUBSCRIBER_UPDATE apply_delta_replicated(subscriber_database_t *database, const subscriber_delta_t *delta)
+{
+    SUBSCRIBER_UPDATE result = apply_delta(database, delta);
+
+    if (result != SUBSCRIBER_UPDATE_FULL && result != SUBSCRIBER_UPDATE_MISSING)
+        for (unsigned int node = 1; node < NUMA_MAX_NODES; node++)
+            if (database->replicas[node])
+                apply_delta(database->replicas[node], delta);
+    return result;
+}
+
+/**
+ * @brief Replay the delta log onto a database that is not published yet.
+ *      Records that no longer apply, e.g. deleting a subscriber the database
+ *      file doesn't have, are skipped.
+ *
+ * @param store store whose log to replay
+ * @param database database to update, may be replaced by a larger copy
+ * @return uint64_t records replayed
+ */
+static uint64_t replay_log(const subscriber_store_t *store, subscriber_database_t **database)
+{
+    char line[SUBSCRIBER_DELTA_MAX_LENGTH * 2];
+    uint64_t records = 0, skipped = 0;
+    subscriber_delta_t delta;
+    FILE *fp = fopen(store->log_path, "r");
+
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        records++;
+        if (!parse_subscriber_delta(line, &delta))
+        {
+            skipped++;
+            continue;
+        }
+
+        // A mapped image is read-only, a full index can't take another key
+        SUBSCRIBER_UPDATE result = SUBSCRIBER_UPDATE_FULL;
+        if (!(*database)->index.mapping)
+            result = apply_delta(*database, &delta);
+        if (result == SUBSCRIBER_UPDATE_FULL)
+        {
+            subscriber_database_t *copy = rebuild_database(store, *database);
+            subscriber_database_free(*database);
+            *database = copy;
+            result = apply_delta(*database, &delta);
+        }
+        skipped += result == SUBSCRIBER_UPDATE_MISSING;
+    }
+    fclose(fp);
+    if (skipped)
+        fprintf(stderr, "Warning: %llu of %llu delta records in %s did not apply\n",
+                (unsigned long long)skipped, (unsigned long long)records, store->log_path);
+    return records;
+}
+
+uint64_t subscriber_store_open_log(subscriber_store_t *store, const char *filename)
+{
+    subscriber_database_t *database;
+    uint64_t records = 0;
+    struct stat st;
+
+    if (snprintf(store->log_path, sizeof(store->log_path), "%s" SUBSCRIBER_DELTA_LOG_SUFFIX, filename) >=
+        (int)sizeof(store->log_path))
+        error("ERROR: Delta log path too long");
+    pthread_mutex_lock(&store->publish_lock);
+    store->filename = filename;
+    // Readers may use the current generation, so the log is replayed onto a copy
+    if (stat(store->log_path, &st) == 0 && st.st_size > 0)
+    {
+        database = rebuild_database(store, store->current);
+        records = replay_log(store, &database);
+        swap_generation(store, database);
+    }
+    store->log_records = records;
+    store->log_start_ns = monotonic_time_ns();
+    pthread_mutex_unlock(&store->publish_lock);
+    return records;
+}
+
+const subscriber_database_t *subscriber_store_reload(subscriber_store_t *store)
+{
+    subscriber_database_t *database = subscriber_database_load(store->filename, true, store->packed);
+
+    if (database == NULL || database->db_size == 0)
+    {
+        subscriber_database_free(database);
+        return NULL;
+    }
+    pthread_mutex_lock(&store->publish_lock);
+    replay_log(store, &database);
+    if (store->filter && database->filter.blocks == NULL)
+        build_filter(database, store->packed ? subscriber_table_overlay_keys(&database->packed) : 0);
+    swap_generation(store, database);
+    pthread_mutex_unlock(&store->publish_lock);
+    return database;
+}
+
+const char *subscriber_store_apply(subscriber_store_t *store, const subscriber_delta_t *delta)
+{
+    char record[SUBSCRIBER_DELTA_MAX_LENGTH + 1];
+    const char *problem = NULL;
+    SUBSCRIBER_UPDATE result;
+    int length;
+
+    pthread_mutex_lock(&store->publish_lock);
+    if (store->log_fd < 0 &&
+        (store->log_fd = open(store->log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+    {
+        pthread_mutex_unlock(&store->publish_lock);
+        return "can't open the delta log";
+    }
+
+    // Mapped images are read-only, and a full index can't take another key:
+    // continue in a copy, published before the delta is applied to it
+    if (store->current->index.mapping)
+        swap_generation(store, rebuild_database(store, store->current));
+    result = apply_delta_replicated(store->current, delta);
+    if (result == SUBSCRIBER_UPDATE_FULL)
+    {
+        swap_generation(store, rebuild_database(store, store->current));
+        result = apply_delta_replicated(store->current, delta);
+    }
+
+    if (result == SUBSCRIBER_UPDATE_MISSING)
+        problem = "no such subscriber";
+    else
+    {
+        // After the slot stores, so a reader that sees the new version sees them
+        __atomic_add_fetch(&store->version, 1, __ATOMIC_RELEASE);
+        length = format_subscriber_delta(delta, record);
+        record[length++] = '\n';
+        if (write(store->log_fd, record, length) != length)
+            problem = "applied, but writing the delta log failed";
+        else if (store->log_records++ == 0)
+            store->log_start_ns = monotonic_time_ns();
+    }
+    pthread_mutex_unlock(&store->publish_lock);
+    return problem;
+}
+
+bool subscriber_store_compact_due(const subscriber_store_t *store, uint64_t now_ns)
+{
+    return store->log_records >= SUBSCRIBER_DELTA_COMPACT_RECORDS ||
+           (store->log_records > 0 && now_ns - store->log_start_ns >= SUBSCRIBER_DELTA_COMPACT_INTERVAL_NS);
+}
+
+/**
+ * @brief Write subscribers as a text database file, replacing it with a rename.
+ *
+ * @param rows subscribers
+ * @param n number of subscribers
+ * @param filename database file
+ * @return true if written
+ */
+static bool write_text_database(const verification_database_t rows[], size_t n, const char *filename)
+{
+    char temp_name[PATH_MAX];
+    FILE *fp;
+    bool written;
+
+    if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename) >= (int)sizeof(temp_name) ||
+        (fp = fopen(temp_name, "w")) == NULL)
+        return false;
+    written = fprintf(fp, "%zu\n", n) > 0;
+    for (size_t i = 0; i < n && written; i++)
+        written = fprintf(fp, "%u\n%d\n%d\n", rows[i].src_sub_no, rows[i].technology, rows[i].paid) > 0;
+    written = fflush(fp) == 0 && written && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0 || !written || rename(temp_name, filename) != 0)
+    {
+        unlink(temp_name);
+        return false;
+    }
+    return true;
+}
+
+bool subscriber_store_compact(subscriber_store_t *store)
+{
+    subscriber_database_t *database;
+    bool written = true;
+
+    pthread_mutex_lock(&store->publish_lock);
+    database = rebuild_database(store, store->current);
+    if (is_subscriber_image(store->filename) && !store->packed)
+        written = subscriber_index_try_save(&database->index, store->filename);
+    else
+    {
+        verification_database_t *rows;
+        size_t n = collect_subscribers(database, &rows);
+        if (is_subscriber_image(store->filename))
+        {
+            // A packed database has no full index to save, so one is built for the image
+            subscriber_index_t image;
+            subscriber_index_build(&image, rows, n);
+            written = subscriber_index_try_save(&image, store->filename);
+            subscriber_index_free(&image);
+        }
+        else
+            written = write_text_database(rows, n, store->filename);
+        free(rows);
+    }
+    if (!written)
+    {
+        fprintf(stderr, "Warning: Compacting into %s: %s\n", store->filename, strerror(errno));
+        subscriber_database_free(database);
+        pthread_mutex_unlock(&store->publish_lock);
+        return false;
+    }
+
+    // The file now has every delta, so the log starts over
+    swap_generation(store, database);
+    if (truncate(store->log_path, 0) != 0 && errno != ENOENT)
+        fprintf(stderr, "Warning: Emptying %s: %s\n", store->log_path, strerror(errno));
+    store->log_records = 0;
+    pthread_mutex_unlock(&store->publish_lock);
+    return true;
+}
+
+// Delta operation names, indexed by SUBSCRIBER_DELTA_OP
+static const char *const delta_op_names[SUBSCRIBER_DELTA_OP_COUNT] = {"insert", "paid", "delete"};
+
+bool parse_subscriber_delta(const char *text, subscriber_delta_t *delta)
+{
+    unsigned long long values[3] = {0};
+    size_t length = strcspn(text, " \t");
+    unsigned int op, fields;
+    char *end;
+
+    for (op = 0; op < SUBSCRIBER_DELTA_OP_COUNT; op++)
+        if (strlen(delta_op_names[op]) == length && strncmp(text, delta_op_names[op], length) == 0)
+            break;
+    if (op == SUBSCRIBER_DELTA_OP_COUNT)
+        return false;
+    text += length;
+
+    // src_sub_no and technology, and the paid flag unless deleting
+    fields = op == SUBSCRIBER_DELTA_DELETE ? 2 : 3;
+    for (unsigned int f = 0; f < fields; f++)
+    {
+        text += strspn(text, " \t");
+        if (*text < '0' || *text > '9')
+            return false;
+        errno = 0;
+        values[f] = strtoull(text, &end, 10);
+        if (errno != 0)
+            return false;
+        text = end;
+    }
+    text += strspn(text, " \t");
+    if (*text != '\0' || values[0] > UINT32_MAX || values[1] < SUB_2G || values[1] > SUB_5G || values[2] > 1)
+        return false;
+
+    delta->op = op;
+    delta->src_sub_no = (uint32_t)values[0];
+    delta->technology = (uint8_t)values[1];
+    delta->paid = values[2] != 0;
+    return true;
+}
+
+int format_subscriber_delta(const subscriber_delta_t *delta, char buffer[SUBSCRIBER_DELTA_MAX_LENGTH])
+{
+    if (delta->op == SUBSCRIBER_DELTA_DELETE)
+        return snprintf(buffer, SUBSCRIBER_DELTA_MAX_LENGTH, "%s %u %u", delta_op_names[delta->op],
+                        delta->src_sub_no, delta->technology);
+    return snprintf(buffer, SUBSCRIBER_DELTA_MAX_LENGTH, "%s %u %u %d", delta_op_names[delta->op],
+                    delta->src_sub_no, delta->technology, delta->paid);
+}
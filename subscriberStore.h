@@ -0,0 +1,309 @@
+/**
+ * @file subscriberStore.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the published subscriber database: loaded
+ *      generations swapped in with an atomic pointer and freed by
+ *      quiescent-state based reclamation, so readers never block or lock,
+ *      and delta updates applied in place and kept in a compacted log
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SUBSCRIBERSTORE_H /* include guard */
+#define SUBSCRIBERSTORE_H
+
+#include "customProtocol.h"
+#include "subscriberIndex.h"
+#include "subscriberFilter.h"
+#include "subscriberTable.h"
+#include "numaTopology.h"
+#include <pthread.h>
+#include <limits.h>
+
+// How often a publisher rechecks readers that are still in the old generation
+#define SUBSCRIBER_STORE_GRACE_POLL_NS 1000000
+
+// Delta log, next to the database file. It is compacted into the database
+// file once it holds this many records, or its oldest record is this old.
+#define SUBSCRIBER_DELTA_LOG_SUFFIX ".delta"
+#define SUBSCRIBER_DELTA_COMPACT_RECORDS 10000
+#define SUBSCRIBER_DELTA_COMPACT_INTERVAL_NS 60000000000ULL
+// Longest delta record, e.g. "insert 4294967295 5 1"
+#define SUBSCRIBER_DELTA_MAX_LENGTH 64
+
+// Delta update operations, also the delta log record names:
+typedef enum
+{
+    SUBSCRIBER_DELTA_INSERT, // insert <src_sub_no> <technology> <paid>, adds or replaces
+    SUBSCRIBER_DELTA_PAID,   // paid <src_sub_no> <technology> <paid>, existing subscribers only
+    SUBSCRIBER_DELTA_DELETE, // delete <src_sub_no> <technology>
+    SUBSCRIBER_DELTA_OP_COUNT
+} SUBSCRIBER_DELTA_OP;
+
+// One delta update:
+typedef struct
+{
+    SUBSCRIBER_DELTA_OP op;
+    uint32_t src_sub_no;
+    uint8_t technology;
+    bool paid;
+} subscriber_delta_t;
+
+// One loaded verification database. A packed database keeps its subscribers
+// in the packed table, and index is the overlay of subscribers changed since:
+// lookups check it first, paid changes flip the table's bit in place, and
+// inserts and deletes go to the overlay, merged into a new table when full.
+typedef struct subscriber_database
+{
+    subscriber_index_t index;
+    subscriber_table_t packed;      // Packed table, entries NULL unless packed
+    subscriber_filter_t filter;     // Negative-lookup filter, blocks NULL when off
+    verification_database_t *table; // Parsed text rows, NULL for a mapped image
+    size_t db_size;                 // Rows read, or keys in a mapped image
+    uint64_t generation;            // 1 for the database loaded at startup
+    uint64_t load_ns;               // Time to read and index the file
+    // Copies of index, packed and filter in the memory of NUMA nodes 1 - ...,
+    // all NULL for a single copy. Node 0 reads the database itself. Each copy
+    // is first touched by a thread pinned to its node, so the kernel places it
+    // there. Delta updates change every copy, and a new generation is copied
+    // before it is published.
+    struct subscriber_database *replicas[NUMA_MAX_NODES];
+} subscriber_database_t;
+
+// Reader state, one cache line per reader so readers don't share lines:
+typedef struct
+{
+    uint64_t grace_period; // Last grace period seen, 0 while offline
+} __attribute__((aligned(64))) subscriber_store_reader_t;
+
+// Published database. Readers (server workers) load current with one atomic
+// load. A publisher swaps in a new generation, then waits until every reader
+// has passed a quiescent state (or is offline) before freeing the old one.
+typedef struct
+{
+    subscriber_database_t *current;
+    uint64_t grace_period; // Bumped by every publish, starts at 1
+    uint64_t version;      // Bumped after every delta applied in place, for caches of lookups
+    subscriber_store_reader_t *readers;
+    unsigned int reader_count;
+    pthread_mutex_t publish_lock; // Serializes publishers and delta updates, never taken by readers
+    bool filter;                  // Every generation gets a negative-lookup filter
+    bool packed;                  // Every generation is packed
+    const numa_topology_t *numa;  // Every generation is replicated on each node, NULL for one copy
+
+    // Writer side, under publish_lock:
+    const char *filename;        // Database file, reloaded and compacted in place
+    char log_path[PATH_MAX];     // filename + SUBSCRIBER_DELTA_LOG_SUFFIX
+    int log_fd;                  // Delta log opened for appending, -1 until the first delta
+    uint64_t log_records;        // Records in the delta log
+    uint64_t log_start_ns;       // When the first of them was logged
+} subscriber_store_t;
+
+/**
+ * @brief Load a verification database: map a compiled subscriber image, or
+ *      read the text file and build its index.
+ *
+ * @param filename text database or subscriber image
+ * @param checked false to exit on a bad file (startup), true to report it and
+ *      return NULL (reload). Checked image loads also verify the checksum, and
+ *      checked text loads require the rows to match the entry count.
+ * @param packed keep the subscribers in a packed table instead, with an empty
+ *      overlay index. The text rows are not kept and an image is unmapped.
+ * @return subscriber_database_t* loaded database
+ */
+subscriber_database_t *subscriber_database_load(const char *filename, bool checked, bool packed);
+
+/**
+ * @brief Release a database, its index and its replicas.
+ *
+ * @param database database from subscriber_database_load()
+ */
+void subscriber_database_free(subscriber_database_t *database);
+
+/**
+ * @brief Initialize the store with its first database. Every reader starts offline.
+ *      Reloads are packed if the first database is.
+ *
+ * @param store store to initialize
+ * @param database first generation, owned by the store
+ * @param reader_count readers that will call the reader functions, ids 0 - reader_count-1
+ * @param filter build a negative-lookup filter for every generation
+ * @param numa replicate every generation on each of these NUMA nodes, by
+ *      threads pinned to them, or NULL. The database itself serves node 0.
+ */
+void subscriber_store_init(subscriber_store_t *store, subscriber_database_t *database, unsigned int reader_count,
+                           bool filter, const numa_topology_t *numa);
+
+/**
+ * @brief Memory held by a database's lookup structures, the size of each replica.
+ *
+ * @param database loaded database
+ * @return size_t bytes of index (or overlay), packed table and filter
+ */
+size_t subscriber_database_lookup_bytes(const subscriber_database_t *database);
+
+/**
+ * @brief Attach the database file's delta log to the store and replay it onto
+ *      the current generation. Deltas are only kept once this is called.
+ *
+ * @param store store initialized from filename
+ * @param filename database file the store was loaded from
+ * @return uint64_t delta records replayed
+ */
+uint64_t subscriber_store_open_log(subscriber_store_t *store, const char *filename);
+
+/**
+ * @brief Publish a new database and free the old one once no reader can
+ *      still use it. Blocks the caller, never the readers.
+ *
+ * @param store store
+ * @param database new generation, owned by the store
+ */
+void subscriber_store_publish(subscriber_store_t *store, subscriber_database_t *database);
+
+/**
+ * @brief Load the database file again, replay the delta log onto it, and
+ *      publish it. A file that can't be loaded, or holds no subscribers, is
+ *      reported and not published.
+ *
+ * @param store store with its log open
+ * @return const subscriber_database_t* new generation, NULL if not reloaded.
+ *      Valid until the caller's next store update.
+ */
+const subscriber_database_t *subscriber_store_reload(subscriber_store_t *store);
+
+/**
+ * @brief Apply a delta to the current generation in place and append it to
+ *      the delta log. Readers stay lock-free: each change is one atomic slot
+ *      store, made in every replica. A mapped image, or an index too full to
+ *      add to, is first copied into a new generation.
+ *
+ * @param store store with its log open
+ * @param delta update to apply
+ * @return const char* NULL if applied, otherwise why not
+ */
+const char *subscriber_store_apply(subscriber_store_t *store, const subscriber_delta_t *delta);
+
+/**
+ * @brief Whether the delta log is due to be compacted.
+ *
+ * @param store store with its log open
+ * @param now_ns monotonic_time_ns()
+ * @return true if SUBSCRIBER_DELTA_COMPACT_RECORDS or _INTERVAL_NS is reached
+ */
+bool subscriber_store_compact_due(const subscriber_store_t *store, uint64_t now_ns);
+
+/**
+ * @brief Compact the delta log: rebuild the current generation without
+ *      tombstones, write it over the database file (text or image, as the
+ *      file was) with a rename, publish it, and empty the log.
+ *
+ * @param store store with its log open
+ * @return bool true if compacted
+ */
+bool subscriber_store_compact(subscriber_store_t *store);
+
+/**
+ * @brief Parse a delta, e.g. "paid 4086668821 3 1".
+ *
+ * @param text delta record or control command, without the newline
+ * @param delta parsed delta
+ * @return true if well formed
+ */
+bool parse_subscriber_delta(const char *text, subscriber_delta_t *delta);
+
+/**
+ * @brief Format a delta as parse_subscriber_delta() reads it.
+ *
+ * @param delta delta to format
+ * @param buffer output, SUBSCRIBER_DELTA_MAX_LENGTH bytes
+ * @return int length written
+ */
+int format_subscriber_delta(const subscriber_delta_t *delta, char buffer[SUBSCRIBER_DELTA_MAX_LENGTH]);
+
+/**
+ * @brief Current database. Only valid while the reader is online, until its
+ *      next subscriber_store_offline() or subscriber_store_quiescent().
+ *
+ * @param store store
+ * @return const subscriber_database_t* current generation
+ */
+static inline const subscriber_database_t *subscriber_store_read(const subscriber_store_t *store)
+{
+    return __atomic_load_n(&store->current, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Count of deltas applied in place so far. A cache of lookups in one
+ *      generation is stale once this changes; read it before the lookups.
+ *
+ * @param store store
+ * @return uint64_t version
+ */
+static inline uint64_t subscriber_store_version(const subscriber_store_t *store)
+{
+    return __atomic_load_n(&store->version, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Current database as a reader on a NUMA node sees it: the node's
+ *      replica if the generation has one. Valid like subscriber_store_read().
+ *
+ * @param store store
+ * @param node reader's NUMA node
+ * @return const subscriber_database_t* current generation or its replica
+ */
+static inline const subscriber_database_t *subscriber_store_read_node(const subscriber_store_t *store, unsigned int node)
+{
+    const subscriber_database_t *database = subscriber_store_read(store);
+
+    return database->replicas[node] ? database->replicas[node] : database;
+}
+
+/**
+ * @brief Mark a reader as not holding any database, e.g. before blocking in
+ *      epoll_wait(), so publishers don't wait for it.
+ *
+ * @param store store
+ * @param reader reader id
+ */
+static inline void subscriber_store_offline(subscriber_store_t *store, unsigned int reader)
+{
+    __atomic_store_n(&store->readers[reader].grace_period, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Mark a reader as about to read the database again.
+ *
+ * @param store store
+ * @param reader reader id
+ */
+static inline void subscriber_store_online(subscriber_store_t *store, unsigned int reader)
+{
+    __atomic_store_n(&store->readers[reader].grace_period,
+                     __atomic_load_n(&store->grace_period, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    // Pairs with the publisher's check: it sees this reader online, or this
+    // reader's next subscriber_store_read() sees the new database.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Report that the reader holds no database pointer obtained before
+ *      this call, for readers that stay online.
+ *
+ * @param store store
+ * @param reader reader id
+ */
+static inline void subscriber_store_quiescent(subscriber_store_t *store, unsigned int reader)
+{
+    __atomic_store_n(&store->readers[reader].grace_period,
+                     __atomic_load_n(&store->grace_period, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
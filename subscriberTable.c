@@ -0,0 +1,174 @@
+/**
+ * @file subscriberTable.c
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Implement building and updating the packed subscriber table
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "subscriberTable.h"
+
+/**
+ * @brief Write one packed entry. Only for tables no reader uses yet.
+ *
+ * @param table table being built
+ * @param i entry position
+ * @param value remainder << 1 | paid
+ */
+static void write_entry(subscriber_table_t *table, uint64_t i, uint64_t value)
+{
+    uint64_t bit = i * table->entry_bits, shift = bit & 63;
+    uint64_t mask = (1ULL << table->entry_bits) - 1;
+    uint64_t *word = &table->entries[bit >> 6];
+
+    word[0] = (word[0] & ~(mask << shift)) | (value << shift);
+    if (shift + table->entry_bits > 64)
+        word[1] = (word[1] & ~(mask >> (64 - shift))) | (value >> (64 - shift));
+}
+
+/**
+ * @brief Sort a bucket's entries by remainder, keeping the first of equal
+ *      remainders. Insertion sort: buckets hold a few entries.
+ *
+ * @param values entries in row order
+ * @param n number of entries
+ * @return uint64_t entries left
+ */
+static uint64_t sort_bucket(uint64_t values[], uint64_t n)
+{
+    uint64_t kept = 0;
+
+    // Stable, so duplicates stay in row order
+    for (uint64_t i = 1; i < n; i++)
+    {
+        uint64_t value = values[i], j = i;
+        for (; j > 0 && (values[j - 1] >> 1) > (value >> 1); j--)
+            values[j] = values[j - 1];
+        values[j] = value;
+    }
+    for (uint64_t i = 0; i < n; i++)
+        if (kept == 0 || (values[i] >> 1) != (values[kept - 1] >> 1))
+            values[kept++] = values[i];
+    return kept;
+}
+
+void subscriber_table_build(subscriber_table_t *table, const verification_database_t verification_database[], size_t db_size)
+{
+    uint64_t *values = NULL, largest = 0, written = 0;
+
+    if (db_size > UINT32_MAX)
+        error("ERROR: Packed subscriber table holds less than 2^32 subscribers");
+
+    // 2^bucket_bits buckets of 8 - 16 keys each
+    table->bucket_bits = 0;
+    while (table->bucket_bits < SUBSCRIBER_TABLE_KEY_BITS - 1 &&
+           (2ULL << (table->bucket_bits + SUBSCRIBER_TABLE_BUCKET_KEYS_LOG2)) <= db_size)
+        table->bucket_bits++;
+    table->bucket_count = 1ULL << table->bucket_bits;
+    table->remainder_bits = SUBSCRIBER_TABLE_KEY_BITS - table->bucket_bits;
+    table->entry_bits = table->remainder_bits + 1;
+    table->entry_words = (db_size * table->entry_bits + 63) / 64 + 1;
+    table->buckets = calloc(table->bucket_count + 1, sizeof(uint32_t));
+    table->entries = calloc(table->entry_words, sizeof(uint64_t));
+    if (table->buckets == NULL || table->entries == NULL)
+        error("ERROR: Allocating packed subscriber table");
+
+    // Count the rows per bucket, then place them in row order
+    for (size_t n = 0; n < db_size; n++)
+    {
+        uint8_t technology = (uint8_t)verification_database[n].technology;
+        if (technology >= SUB_2G && technology <= SUB_5G)
+            table->buckets[(subscriber_table_hash(verification_database[n].src_sub_no, technology) >> table->remainder_bits) + 1]++;
+    }
+    for (uint64_t b = 0; b < table->bucket_count; b++)
+    {
+        if (table->buckets[b + 1] > largest)
+            largest = table->buckets[b + 1];
+        table->buckets[b + 1] += table->buckets[b];
+    }
+    for (size_t n = 0; n < db_size; n++)
+    {
+        uint8_t technology = (uint8_t)verification_database[n].technology;
+        if (technology < SUB_2G || technology > SUB_5G)
+            continue;
+        uint64_t hash = subscriber_table_hash(verification_database[n].src_sub_no, technology);
+        uint64_t remainder = hash & ((1ULL << table->remainder_bits) - 1);
+        // buckets[b] is the next free position of bucket b until it is sorted
+        write_entry(table, table->buckets[hash >> table->remainder_bits]++, remainder << 1 | verification_database[n].paid);
+    }
+
+    // Sort each bucket and drop duplicate keys, moving entries down over them.
+    // buckets[b] now holds the end of bucket b, which is where b + 1 starts.
+    values = malloc((largest ? largest : 1) * sizeof(uint64_t));
+    if (values == NULL)
+        error("ERROR: Allocating packed subscriber table");
+    for (uint64_t b = 0, start = 0; b < table->bucket_count; b++)
+    {
+        uint64_t end = table->buckets[b], n = end - start;
+        for (uint64_t i = 0; i < n; i++)
+            values[i] = subscriber_table_entry(table, start + i);
+        n = sort_bucket(values, n);
+        table->buckets[b] = written;
+        for (uint64_t i = 0; i < n; i++)
+            write_entry(table, written++, values[i]);
+        start = end;
+    }
+    table->buckets[table->bucket_count] = written;
+    table->count = written;
+    free(values);
+}
+
+void subscriber_table_free(subscriber_table_t *table)
+{
+    free(table->entries);
+    free(table->buckets);
+    memset(table, DEFAULT_VALUE, sizeof(*table));
+}
+
+void subscriber_table_copy(subscriber_table_t *copy, const subscriber_table_t *table)
+{
+    *copy = *table;
+    copy->entries = malloc(table->entry_words * sizeof(uint64_t));
+    copy->buckets = malloc((table->bucket_count + 1) * sizeof(uint32_t));
+    if (copy->entries == NULL || copy->buckets == NULL)
+        error("ERROR: Allocating packed subscriber table");
+    memcpy(copy->entries, table->entries, table->entry_words * sizeof(uint64_t));
+    memcpy(copy->buckets, table->buckets, (table->bucket_count + 1) * sizeof(uint32_t));
+}
+
+void subscriber_table_collect(const subscriber_table_t *table, verification_database_t rows[])
+{
+    for (uint64_t b = 0; b < table->bucket_count; b++)
+        for (uint64_t i = table->buckets[b]; i < table->buckets[b + 1]; i++)
+        {
+            uint64_t entry = subscriber_table_entry(table, i);
+            uint64_t hash = (b << table->remainder_bits) | (entry >> 1);
+            uint64_t key = (hash * SUBSCRIBER_TABLE_INVERSE) & SUBSCRIBER_TABLE_KEY_MASK;
+            rows[i].src_sub_no = (uint32_t)(key >> 2);
+            rows[i].technology = (SUBSCRIBER_TECHNOLOGY)(SUB_2G + (key & 3));
+            rows[i].paid = entry & 1;
+        }
+}
+
+bool subscriber_table_set_paid(subscriber_table_t *table, uint32_t src_sub_no, uint8_t technology, bool paid)
+{
+    uint64_t entry, i = subscriber_table_position(table, src_sub_no, technology, &entry);
+    uint64_t bit, *word;
+
+    if (i == table->count)
+        return false;
+
+    // The paid bit is the entry's lowest bit, always within one word
+    bit = i * table->entry_bits;
+    word = &table->entries[bit >> 6];
+    if (paid)
+        __atomic_fetch_or(word, 1ULL << (bit & 63), __ATOMIC_RELEASE);
+    else
+        __atomic_fetch_and(word, ~(1ULL << (bit & 63)), __ATOMIC_RELEASE);
+    return true;
+}
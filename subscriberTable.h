@@ -0,0 +1,225 @@
+/**
+ * @file subscriberTable.h
+ * @author Benjamin Wang (bwang4@scu.edu, ID: 1179478)
+ * @brief Client using customized protocol on top of UDP protocol for requesting
+ *      identification from server for access permission to the cellular network.
+ *      Header file defining the packed subscriber table: a sorted, bit-packed
+ *      array of (src_sub_no, technology, paid) at about 2 bytes per subscriber,
+ *      for databases too large for the hash index
+ * @version 0.3
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SUBSCRIBERTABLE_H /* include guard */
+#define SUBSCRIBERTABLE_H
+
+#include "customProtocol.h"
+#include "subscriberIndex.h"
+
+// Packed key: src_sub_no in the high 32 bits, technology - SUB_2G in the low 2
+#define SUBSCRIBER_TABLE_KEY_BITS 34
+#define SUBSCRIBER_TABLE_KEY_MASK ((1ULL << SUBSCRIBER_TABLE_KEY_BITS) - 1)
+
+// Keys are scrambled by an odd multiplier mod 2^34, a bijection, so clustered
+// phone numbers still spread evenly over the buckets and keys can be decoded
+#define SUBSCRIBER_TABLE_MULTIPLIER 0x17F4A7C15ULL
+#define SUBSCRIBER_TABLE_INVERSE 0x19937733DULL
+_Static_assert(((SUBSCRIBER_TABLE_MULTIPLIER * SUBSCRIBER_TABLE_INVERSE) & SUBSCRIBER_TABLE_KEY_MASK) == 1,
+               "the inverse must undo the multiplier");
+
+// Buckets hold 8 - 16 keys on average, log2 of the lower bound
+#define SUBSCRIBER_TABLE_BUCKET_KEYS_LOG2 3
+
+// Most subscribers the overlay index of changes takes before it is merged
+// into a new table. Its 256 KiB of slots stay in cache.
+#define SUBSCRIBER_TABLE_OVERLAY_KEYS 16384
+
+// Packed subscriber table. The scrambled key's high bucket_bits pick a bucket,
+// the rest (remainder_bits) are stored. Each entry is (remainder << 1 | paid),
+// entry_bits wide, packed back to back and sorted by remainder within its
+// bucket. For 100M subscribers entries are 12 bits, plus 2 - 4 bits of
+// bucket directory per subscriber.
+typedef struct
+{
+    uint64_t *entries;       // Bit-packed entries, NULL when the table is not used
+    uint32_t *buckets;       // bucket_count + 1 entry positions, bucket b is buckets[b] - buckets[b + 1]
+    uint64_t count;          // Subscribers stored
+    uint64_t bucket_count;   // 1 << bucket_bits
+    uint32_t bucket_bits;
+    uint32_t remainder_bits; // SUBSCRIBER_TABLE_KEY_BITS - bucket_bits
+    uint32_t entry_bits;     // remainder_bits + 1 paid bit
+    size_t entry_words;      // uint64_t words in entries, one spare so reads never run past it
+} subscriber_table_t;
+
+/**
+ * @brief Build the table from verification database rows. The first row wins
+ *      for duplicate keys, like subscriber_index_build(), and rows with an
+ *      invalid technology are skipped.
+ *
+ * @param table table to initialize
+ * @param verification_database rows
+ * @param db_size number of rows, below 2^32
+ */
+void subscriber_table_build(subscriber_table_t *table, const verification_database_t verification_database[], size_t db_size);
+
+/**
+ * @brief Release the table's memory.
+ *
+ * @param table table built by subscriber_table_build()
+ */
+void subscriber_table_free(subscriber_table_t *table);
+
+/**
+ * @brief Copy a table into new memory first touched by the calling thread.
+ *
+ * @param copy table to initialize
+ * @param table table to copy, not changed meanwhile
+ */
+void subscriber_table_copy(subscriber_table_t *copy, const subscriber_table_t *table);
+
+/**
+ * @brief Decode every subscriber in the table, in table order.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param rows table->count rows to fill
+ */
+void subscriber_table_collect(const subscriber_table_t *table, verification_database_t rows[]);
+
+/**
+ * @brief Change a stored subscriber's paid status while readers use the
+ *      table. The paid bit is changed with one atomic operation.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @param paid new paid status
+ * @return true if the subscriber is stored
+ */
+bool subscriber_table_set_paid(subscriber_table_t *table, uint32_t src_sub_no, uint8_t technology, bool paid);
+
+/**
+ * @brief Memory held by the table's entries and bucket directory.
+ *
+ * @param table table built by subscriber_table_build()
+ * @return size_t bytes
+ */
+static inline size_t subscriber_table_memory_bytes(const subscriber_table_t *table)
+{
+    return table->entry_words * sizeof(uint64_t) + (table->bucket_count + 1) * sizeof(uint32_t);
+}
+
+/**
+ * @brief Subscribers the overlay index of a table takes: half as many as the
+ *      table holds, at most SUBSCRIBER_TABLE_OVERLAY_KEYS.
+ *
+ * @param table table built by subscriber_table_build()
+ * @return size_t overlay reserve for subscriber_index_build_reserved()
+ */
+static inline size_t subscriber_table_overlay_keys(const subscriber_table_t *table)
+{
+    return table->count / 2 < SUBSCRIBER_TABLE_OVERLAY_KEYS ? table->count / 2 + 1 : SUBSCRIBER_TABLE_OVERLAY_KEYS;
+}
+
+/**
+ * @brief Scrambled packed key of a subscriber.
+ *
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return uint64_t SUBSCRIBER_TABLE_KEY_BITS bits: bucket, then remainder
+ */
+static inline uint64_t subscriber_table_hash(uint32_t src_sub_no, uint8_t technology)
+{
+    uint64_t key = ((uint64_t)src_sub_no << 2) | ((technology - SUB_2G) & 3);
+    return (key * SUBSCRIBER_TABLE_MULTIPLIER) & SUBSCRIBER_TABLE_KEY_MASK;
+}
+
+/**
+ * @brief Read one packed entry. Words are loaded atomically, so only the paid
+ *      bit subscriber_table_set_paid() changes can differ between two reads.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param i entry position
+ * @return uint64_t remainder << 1 | paid
+ */
+static inline uint64_t subscriber_table_entry(const subscriber_table_t *table, uint64_t i)
+{
+    uint64_t bit = i * table->entry_bits, shift = bit & 63;
+    uint64_t low = __atomic_load_n(&table->entries[bit >> 6], __ATOMIC_RELAXED);
+    uint64_t high = __atomic_load_n(&table->entries[(bit >> 6) + 1], __ATOMIC_RELAXED);
+
+    // An entry may straddle two words. Both are always combined, without a
+    // branch to mispredict; the double shift is defined for shift == 0 too.
+    return ((low >> shift) | (high << 1 << (63 - shift))) & ((1ULL << table->entry_bits) - 1);
+}
+
+/**
+ * @brief Position of a subscriber's entry.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @param entry set to the entry when found
+ * @return uint64_t position, table->count if not stored
+ */
+static inline uint64_t subscriber_table_position(
+    const subscriber_table_t *table, uint32_t src_sub_no, uint8_t technology, uint64_t *entry)
+{
+    uint64_t hash = subscriber_table_hash(src_sub_no, technology);
+    uint64_t bucket = hash >> table->remainder_bits, remainder = hash & ((1ULL << table->remainder_bits) - 1);
+
+    // Technologies outside 2G - 5G would alias a valid one in 2 bits
+    if ((uint8_t)(technology - SUB_2G) > SUB_5G - SUB_2G)
+        return table->count;
+    for (uint64_t i = table->buckets[bucket], end = table->buckets[bucket + 1]; i < end; i++)
+    {
+        *entry = subscriber_table_entry(table, i);
+        if ((*entry >> 1) >= remainder)
+            return (*entry >> 1) == remainder ? i : table->count;
+    }
+    return table->count;
+}
+
+/**
+ * @brief Look up a subscriber in the table.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return uint8_t SUBSCRIBER_SLOT_PAID, _NOT_PAID, or SUBSCRIBER_SLOT_ABSENT
+ */
+static inline uint8_t subscriber_table_find(const subscriber_table_t *table, uint32_t src_sub_no, uint8_t technology)
+{
+    uint64_t entry = 0;
+
+    if (subscriber_table_position(table, src_sub_no, technology, &entry) == table->count)
+        return SUBSCRIBER_SLOT_ABSENT;
+    return entry & 1 ? SUBSCRIBER_SLOT_PAID : SUBSCRIBER_SLOT_NOT_PAID;
+}
+
+/**
+ * @brief Look up a subscriber in a packed table and the overlay index that
+ *      holds the subscribers changed since the table was built. The overlay
+ *      wins, and a tombstone in it hides the table's entry.
+ *
+ * @param table table built by subscriber_table_build()
+ * @param overlay heap index of changed subscribers
+ * @param src_sub_no subscriber number (phone number)
+ * @param technology subscriber technology (2G - 5G)
+ * @return SUBSCRIBER_PACKET_TYPE SUB_ACC_OK, SUB_NOT_PAID or SUB_NOT_EXIST
+ */
+static inline SUBSCRIBER_PACKET_TYPE subscriber_table_lookup(
+    const subscriber_table_t *table, const subscriber_index_t *overlay, uint32_t src_sub_no, uint8_t technology)
+{
+    uint8_t paid = subscriber_index_find(overlay, src_sub_no, technology);
+
+    if (paid == SUBSCRIBER_SLOT_ABSENT)
+        paid = subscriber_table_find(table, src_sub_no, technology);
+    return paid == SUBSCRIBER_SLOT_PAID       ? SUB_ACC_OK
+           : paid == SUBSCRIBER_SLOT_NOT_PAID ? SUB_NOT_PAID
+                                              : SUB_NOT_EXIST;
+}
+
+#endif